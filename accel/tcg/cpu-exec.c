@@ -25,6 +25,7 @@
 #include "trace.h"
 #include "disas/disas.h"
 #include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
@@ -932,6 +933,80 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
 #endif
 }
 
+#ifdef CONFIG_USER_ONLY
+static bool tb_spec_probe_page(CPUArchState *env, target_ulong page,
+                               int mmu_idx)
+{
+    void *host;
+    int flags = probe_access_flags(env, page, 1, MMU_INST_FETCH,
+                                   mmu_idx, true, &host, 0);
+
+    return !(flags & TLB_INVALID_MASK) && host != NULL;
+}
+#else
+/*
+ * Only use what the TLB already holds: filling it would walk the guest
+ * page tables, which sets accessed bits (x86, Arm with hardware A/D
+ * updates, PPC reference bits) on pages the guest never fetched from.
+ */
+static bool tb_spec_probe_page(CPUArchState *env, target_ulong page,
+                               int mmu_idx)
+{
+    target_ulong addr_code = tlb_entry(env, mmu_idx, page)->addr_code;
+
+    return tlb_hit(addr_code, page) && !(addr_code & TLB_FLAGS_MASK);
+}
+#endif
+
+/*
+ * Check, without any guest-visible side effect, that code at @pc can be
+ * fetched from RAM.  The page following @pc is checked too, since a
+ * block starting at @pc may end with an insn straddling the boundary.
+ */
+static bool tb_spec_probe(CPUArchState *env, target_ulong pc)
+{
+    int mmu_idx = cpu_mmu_index(env, true);
+    target_ulong page = pc & TARGET_PAGE_MASK;
+
+    return tb_spec_probe_page(env, page, mmu_idx) &&
+           tb_spec_probe_page(env, page + TARGET_PAGE_SIZE, mmu_idx);
+}
+
+/*
+ * Having just translated @tb for a miss at @pc, translate up to
+ * tb_spec_depth blocks that follow it in guest memory, assuming the
+ * cpu state is unchanged.  Straight-line code that is reached for the
+ * first time is then found by tb_lookup() instead of going back to the
+ * translator once per block.  If the guess of the successor state is
+ * wrong, the speculative block is never looked up and is discarded at
+ * the next flush.
+ */
+static void tb_gen_successors(CPUState *cpu, TranslationBlock *tb,
+                              target_ulong pc, target_ulong cs_base,
+                              uint32_t flags, uint32_t cflags)
+{
+    CPUArchState *env = cpu->env_ptr;
+    unsigned n;
+
+    /* Only speculate for ordinary blocks; see check_for_breakpoints. */
+    if (cflags != curr_cflags(cpu) || !QTAILQ_EMPTY(&cpu->breakpoints)) {
+        return;
+    }
+
+    for (n = 0; n < tb_spec_depth; n++) {
+        /* Stop at MMIO and at blocks that crossed a page. */
+        if (tb_page_addr0(tb) == -1 || tb_page_addr1(tb) != -1) {
+            return;
+        }
+        pc += tb->size;
+        if (!tb_spec_probe(env, pc) ||
+            tb_htable_lookup(cpu, pc, cs_base, flags, cflags)) {
+            return;
+        }
+        tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+    }
+}
+
 /* main execution loop */
 
 static int __attribute__((noinline))
@@ -976,6 +1051,9 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
 
                 mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                if (tb_spec_depth) {
+                    tb_gen_successors(cpu, tb, pc, cs_base, flags, cflags);
+                }
                 mmap_unlock();
 
                 /*
@@ -231,8 +231,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
-    desc->large_page_addr = -1;
-    desc->large_page_mask = -1;
+    desc->n_large_pages = 0;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -320,10 +319,11 @@ static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
     }
 }
 
-void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                      size_t *plpage, size_t *plpage_full)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, lpage = 0, lpage_full = 0;
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -331,10 +331,14 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
         full += qatomic_read(&env_tlb(env)->c.full_flush_count);
         part += qatomic_read(&env_tlb(env)->c.part_flush_count);
         elide += qatomic_read(&env_tlb(env)->c.elide_flush_count);
+        lpage += qatomic_read(&env_tlb(env)->c.lpage_flush_count);
+        lpage_full += qatomic_read(&env_tlb(env)->c.lpage_full_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *plpage = lpage;
+    *plpage_full = lpage_full;
 }
 
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
@@ -491,19 +495,107 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
-static void tlb_flush_page_locked(CPUArchState *env, int midx,
-                                  target_ulong page)
+/* Return true if @te maps any page within [@first, @last].  */
+static bool tlb_entry_in_range(const CPUTLBEntry *te,
+                               target_ulong first, target_ulong last)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    target_ulong addrs[3] = {
+        te->addr_read, tlb_addr_write(te), te->addr_code
+    };
+    int i;
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+    for (i = 0; i < ARRAY_SIZE(addrs); i++) {
+        target_ulong addr = addrs[i];
+
+        if (!(addr & TLB_INVALID_MASK) &&
+            (addr & TARGET_PAGE_MASK) - first <= last - first) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Flush every entry mapping a page within the large page region
+ * [@first, @last].  Small regions are flushed page by page; for
+ * regions with more pages than there are tlb entries, it is cheaper
+ * to scan the whole tlb once.
+ */
+static void tlb_flush_region_locked(CPUArchState *env, int midx,
+                                    target_ulong first, target_ulong last)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    target_ulong n_pages = ((last - first) >> TARGET_PAGE_BITS) + 1;
+    size_t i;
+
+    if (n_pages <= tlb_n_entries(f)) {
+        target_ulong page = first;
+
+        for (i = 0; i < n_pages; i++, page += TARGET_PAGE_SIZE) {
+            if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
     } else {
+        for (i = 0; i < tlb_n_entries(f); i++) {
+            CPUTLBEntry *te = &f->table[i];
+
+            if (tlb_entry_in_range(te, first, last)) {
+                memset(te, -1, sizeof(*te));
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        CPUTLBEntry *te = &d->vtable[i];
+
+        if (tlb_entry_in_range(te, first, last)) {
+            memset(te, -1, sizeof(*te));
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+}
+
+/*
+ * Flush, and stop tracking, every large page region that intersects
+ * [@first, @last].  Return true if there was any.
+ */
+static bool tlb_flush_large_pages_locked(CPUArchState *env, int midx,
+                                         target_ulong first,
+                                         target_ulong last)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    unsigned n = 0, i = 0;
+
+    while (i < d->n_large_pages) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+        target_ulong lp_first = lp->addr;
+        target_ulong lp_last = lp->addr | ~lp->mask;
+
+        if (lp_first > last || lp_last < first) {
+            i++;
+            continue;
+        }
+        tlb_debug("flushing large page midx %d ("
+                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                  midx, lp->addr, lp->mask);
+        *lp = d->large_page[--d->n_large_pages];
+        tlb_flush_region_locked(env, midx, lp_first, lp_last);
+        n++;
+    }
+    if (n) {
+        qatomic_set(&env_tlb(env)->c.lpage_flush_count,
+                    env_tlb(env)->c.lpage_flush_count + n);
+    }
+    return n != 0;
+}
+
+static void tlb_flush_page_locked(CPUArchState *env, int midx,
+                                  target_ulong page)
+{
+    /* If the page is part of a large page, flush all of it.  */
+    if (!tlb_flush_large_pages_locked(env, midx, page, page)) {
         if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
             tlb_n_used_entries_dec(env, midx);
         }
@@ -737,16 +829,29 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     }
 
     /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
+     * Check if we need to flush due to large pages.  A masked flush
+     * also hits aliases of the range outside of it, which the large
+     * page regions cannot describe, so flush everything in that case.
      */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-        return;
+    if (bits < TARGET_LONG_BITS) {
+        target_ulong last = addr + len - 1;
+        unsigned i;
+
+        for (i = 0; i < d->n_large_pages; i++) {
+            CPUTLBLargePage *lp = &d->large_page[i];
+
+            if (lp->addr <= last && (lp->addr | ~lp->mask) >= addr) {
+                tlb_debug("forcing full flush midx %d ("
+                          TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                          midx, lp->addr, lp->mask);
+                tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+                qatomic_set(&env_tlb(env)->c.lpage_full_flush_count,
+                            env_tlb(env)->c.lpage_full_flush_count + 1);
+                return;
+            }
+        }
+    } else {
+        tlb_flush_large_pages_locked(env, midx, addr, addr + len - 1);
     }
 
     for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
@@ -1081,28 +1186,47 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB does not support large pages, so remember the areas covered by
+   large pages and flush all of an area if any page in it is invalidated.  */
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
                                target_ulong vaddr, target_ulong size)
 {
-    target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+    CPUTLBLargePage *best = NULL;
     target_ulong lp_mask = ~(size - 1);
+    target_ulong best_mask = 0;
+    unsigned i;
+
+    for (i = 0; i < d->n_large_pages; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+        target_ulong mask = lp->mask & lp_mask;
 
-    if (lp_addr == (target_ulong)-1) {
-        /* No previous large page.  */
-        lp_addr = vaddr;
+        while (((lp->addr ^ vaddr) & mask) != 0) {
+            mask <<= 1;
+        }
+        if (mask == lp->mask) {
+            /* Already covered by this region.  */
+            return;
+        }
+        /* Remember the region that would grow the least.  */
+        if (!best || mask > best_mask) {
+            best = lp;
+            best_mask = mask;
+        }
+    }
+
+    if (d->n_large_pages < CPU_TLB_LARGE_PAGES) {
+        CPUTLBLargePage *lp = &d->large_page[d->n_large_pages++];
+
+        lp->addr = vaddr & lp_mask;
+        lp->mask = lp_mask;
     } else {
-        /* Extend the existing region to include the new page.
+        /* Out of regions: extend the closest one to include the new page.
            This is a compromise between unnecessary flushes and
            the cost of maintaining a full variable size TLB.  */
-        lp_mask &= env_tlb(env)->d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ vaddr) & lp_mask) != 0) {
-            lp_mask <<= 1;
-        }
+        best->addr &= best_mask;
+        best->mask = best_mask;
     }
-    env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
 }
 
 /*
@@ -1370,7 +1494,9 @@ static uint64_t io_readx(CPUArchState *env, CPUTLBEntryFull *full,
         cpu_io_recompile(cpu, retaddr);
     }
 
-    {
+    if (mr->ops->lockless) {
+        r = memory_region_dispatch_read(mr, mr_offset, &val, op, full->attrs);
+    } else {
         QEMU_IOTHREAD_LOCK_GUARD();
         r = memory_region_dispatch_read(mr, mr_offset, &val, op, full->attrs);
     }
@@ -1425,7 +1551,9 @@ static void io_writex(CPUArchState *env, CPUTLBEntryFull *full,
      */
     save_iotlb_data(cpu, section, mr_offset);
 
-    {
+    if (mr->ops->lockless) {
+        r = memory_region_dispatch_write(mr, mr_offset, val, op, full->attrs);
+    } else {
         QEMU_IOTHREAD_LOCK_GUARD();
         r = memory_region_dispatch_write(mr, mr_offset, val, op, full->attrs);
     }
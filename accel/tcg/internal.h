@@ -40,6 +40,7 @@ void tb_invalidate_phys_range_fast(ram_addr_t ram_addr,
                                    unsigned size,
                                    uintptr_t retaddr);
 G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
+unsigned page_smc_max(tb_page_addr_t *addr);
 #endif /* CONFIG_SOFTMMU */
 
 TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
@@ -64,6 +65,13 @@ static inline target_ulong log_pc(CPUState *cpu, const TranslationBlock *tb)
     }
 }
 
+/*
+ * Maximum number of fall-through successors that are translated
+ * speculatively after a TB miss; zero disables speculation.
+ */
+#define TB_SPEC_MAX_DEPTH  8
+extern unsigned tb_spec_depth;
+
 extern int64_t max_delay;
 extern int64_t max_advance;
 
@@ -35,6 +35,9 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_smc_skip_count;
+    unsigned tb_code_unprotect_count;
+    unsigned tb_code_bitmap_count;
 };
 
 extern TBContext tb_ctx;
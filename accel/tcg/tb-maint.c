@@ -18,8 +18,10 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
 #include "qemu/interval-tree.h"
 #include "qemu/qtree.h"
+#include "qemu/rcu.h"
 #include "exec/cputlb.h"
 #include "exec/log.h"
 #include "exec/exec-all.h"
@@ -188,10 +190,26 @@ static int v_l2_levels;
 
 static void *l1_map[V_L1_MAX_SIZE];
 
+/* Freed with RCU, see PageDesc.code_bitmap */
+typedef struct PageCodeBitmap {
+    struct rcu_head rcu;
+    unsigned long bits[];
+} PageCodeBitmap;
+
 struct PageDesc {
     QemuSpin lock;
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
+    /*
+     * Bytes of this page covered by TBs, or NULL.  Bits are set with the
+     * page lock held and the bitmap is freed only once the page holds no
+     * TBs, so this is a superset of the bytes translated from and may be
+     * tested without the lock, within an RCU critical section; see
+     * tb_invalidate_phys_range_fast.
+     */
+    PageCodeBitmap *code_bitmap;
+    /* number of TBs invalidated by writes to this page */
+    unsigned smc_count;
 };
 
 void page_table_config_init(void)
@@ -567,6 +585,22 @@ static void page_collection_unlock(struct page_collection *set)
     g_free(set);
 }
 
+/*
+ * Free the code bitmap of @p, which holds no TBs anymore, so that pages
+ * that stop holding code don't keep it.  Lockless readers may still be
+ * looking at it, hence the RCU.  Called with @p->lock held.
+ */
+static void page_code_bitmap_free(PageDesc *p)
+{
+    PageCodeBitmap *bitmap = p->code_bitmap;
+
+    if (bitmap) {
+        qatomic_set(&p->code_bitmap, NULL);
+        g_free_rcu(bitmap, rcu);
+        qatomic_dec(&tb_ctx.tb_code_bitmap_count);
+    }
+}
+
 /* Set to NULL all the 'first_tb' fields in all PageDescs. */
 static void tb_remove_all_1(int level, void **lp)
 {
@@ -581,6 +615,7 @@ static void tb_remove_all_1(int level, void **lp)
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
+            page_code_bitmap_free(&pd[i]);
             page_unlock(&pd[i]);
         }
     } else {
@@ -601,6 +636,55 @@ static void tb_remove_all(void)
     }
 }
 
+/*
+ * Mark in the code bitmap of @p the bytes covered by @tb, which
+ * is the @n'th page of @tb.  Called with @p->lock held.
+ */
+static void page_code_bitmap_add(PageDesc *p, const TranslationBlock *tb,
+                                 unsigned int n)
+{
+    tb_page_addr_t tb_last = tb_page_addr0(tb) + tb->size - 1;
+    unsigned long start, last;
+
+    if (!p->code_bitmap) {
+        PageCodeBitmap *bitmap;
+
+        bitmap = g_malloc0(sizeof(*bitmap) + BITS_TO_LONGS(TARGET_PAGE_SIZE) *
+                                             sizeof(unsigned long));
+        /* Pairs with qatomic_load_acquire in page_code_overlaps. */
+        qatomic_store_release(&p->code_bitmap, bitmap);
+        qatomic_inc(&tb_ctx.tb_code_bitmap_count);
+    }
+
+    /* As in tb_invalidate_phys_page_range__locked. */
+    if (n == 0) {
+        start = tb_page_addr0(tb) & ~TARGET_PAGE_MASK;
+        last = MIN(tb_last, tb_page_addr0(tb) | ~TARGET_PAGE_MASK) &
+               ~TARGET_PAGE_MASK;
+    } else {
+        start = 0;
+        last = tb_last & ~TARGET_PAGE_MASK;
+    }
+    if (tb->size) {
+        bitmap_set_atomic(p->code_bitmap->bits, start, last - start + 1);
+    }
+}
+
+/*
+ * Return true if any byte of [@start, @start + @len) might be covered
+ * by a TB.  May be called without @p->lock held.
+ */
+static bool page_code_overlaps(PageDesc *p, tb_page_addr_t start,
+                               unsigned len)
+{
+    PageCodeBitmap *bitmap;
+    unsigned long nr = start & ~TARGET_PAGE_MASK;
+
+    RCU_READ_LOCK_GUARD();
+    bitmap = qatomic_load_acquire(&p->code_bitmap);
+    return bitmap && find_next_bit(bitmap->bits, nr + len, nr) < nr + len;
+}
+
 /*
  * Add the tb in the target page and protect it if necessary.
  * Called with @p->lock held.
@@ -612,6 +696,7 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
 
     assert_page_locked(p);
 
+    page_code_bitmap_add(p, tb, n);
     tb->page_next[n] = p->first_tb;
     page_already_protected = p->first_tb != 0;
     p->first_tb = (uintptr_t)tb | n;
@@ -1088,6 +1173,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 {
     TranslationBlock *tb;
     PageForEachNext n;
+    unsigned nb_invalidated = 0;
 #ifdef TARGET_HAS_PRECISE_SMC
     bool current_tb_modified = false;
     TranslationBlock *current_tb = retaddr ? tcg_tb_lookup(retaddr) : NULL;
@@ -1128,12 +1214,16 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
             }
 #endif /* TARGET_HAS_PRECISE_SMC */
             tb_phys_invalidate__locked(tb);
+            nb_invalidated++;
         }
     }
+    p->smc_count += nb_invalidated;
 
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
+        page_code_bitmap_free(p);
         tlb_unprotect_code(start);
+        qatomic_inc(&tb_ctx.tb_code_unprotect_count);
     }
 
 #ifdef TARGET_HAS_PRECISE_SMC
@@ -1229,10 +1319,78 @@ void tb_invalidate_phys_range_fast(ram_addr_t ram_addr,
                                    uintptr_t retaddr)
 {
     struct page_collection *pages;
+    PageDesc *p;
+
+    p = page_find(ram_addr >> TARGET_PAGE_BITS);
+    if (p == NULL) {
+        return;
+    }
+
+    /*
+     * Data that shares a page with code is written often; skip the
+     * page locks unless the write may hit translated bytes.  A TB
+     * being added concurrently is no different from one added just
+     * after the write.  Once the page holds no TBs, e.g. after a
+     * tb_flush, let the slow path below drop the write protection,
+     * or the page would keep trapping writes.
+     */
+    if (qatomic_read(&p->first_tb) && !page_code_overlaps(p, ram_addr, size)) {
+        qatomic_inc(&tb_ctx.tb_smc_skip_count);
+        return;
+    }
 
     pages = page_collection_lock(ram_addr, ram_addr + size - 1);
     tb_invalidate_phys_page_fast__locked(pages, ram_addr, size, retaddr);
     page_collection_unlock(pages);
 }
 
+static void page_smc_max_1(int level, void **lp, tb_page_addr_t index,
+                           tb_page_addr_t *max_index, unsigned *max_count)
+{
+    int i;
+
+    if (*lp == NULL) {
+        return;
+    }
+    if (level == 0) {
+        PageDesc *pd = *lp;
+
+        for (i = 0; i < V_L2_SIZE; ++i) {
+            unsigned count = qatomic_read(&pd[i].smc_count);
+
+            if (count > *max_count) {
+                *max_count = count;
+                *max_index = index | i;
+            }
+        }
+    } else {
+        void **pp = *lp;
+
+        for (i = 0; i < V_L2_SIZE; ++i) {
+            page_smc_max_1(level - 1, pp + i,
+                           index | ((tb_page_addr_t)i << (level * V_L2_BITS)),
+                           max_index, max_count);
+        }
+    }
+}
+
+/*
+ * Find the page with the most TBs invalidated by writes.  Return the
+ * number of such invalidations, or 0 if there were none.
+ */
+unsigned page_smc_max(tb_page_addr_t *addr)
+{
+    tb_page_addr_t max_index = 0;
+    unsigned max_count = 0;
+    int i;
+
+    for (i = 0; i < v_l1_size; i++) {
+        page_smc_max_1(v_l2_levels, l1_map + i,
+                       (tb_page_addr_t)i << v_l1_shift,
+                       &max_index, &max_count);
+    }
+    *addr = max_index << TARGET_PAGE_BITS;
+    return max_count;
+}
+
 #endif /* CONFIG_USER_ONLY */
@@ -44,6 +44,7 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint32_t spec_tb;
 };
 typedef struct TCGState TCGState;
 
@@ -109,6 +110,7 @@ static void tcg_accel_instance_init(Object *obj)
 }
 
 bool mttcg_enabled;
+unsigned tb_spec_depth;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -121,6 +123,7 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_spec_depth = s->spec_tb;
 
     page_init();
     tb_htable_init();
@@ -196,6 +199,34 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_spec_tb(Object *obj, Visitor *v,
+                            const char *name, void *opaque,
+                            Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->spec_tb;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_spec_tb(Object *obj, Visitor *v,
+                            const char *name, void *opaque,
+                            Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > TB_SPEC_MAX_DEPTH) {
+        error_setg(errp, "spec-tb must be at most %d", TB_SPEC_MAX_DEPTH);
+        return;
+    }
+
+    s->spec_tb = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -241,6 +272,13 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "spec-tb", "int",
+        tcg_get_spec_tb, tcg_set_spec_tb,
+        NULL, NULL);
+    object_class_property_set_description(oc, "spec-tb",
+        "Number of fall-through successors to translate ahead of "
+        "execution on a TB miss");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
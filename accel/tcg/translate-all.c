@@ -708,6 +708,9 @@ void dump_exec_info(GString *buf)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t flush_lpage, flush_lpage_full;
+    tb_page_addr_t smc_page;
+    unsigned smc_max;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -748,11 +751,25 @@ void dump_exec_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
-
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    g_string_append_printf(buf, "SMC skipped writes  %u\n",
+                           qatomic_read(&tb_ctx.tb_smc_skip_count));
+    g_string_append_printf(buf, "SMC unprotected pages %u\n",
+                           qatomic_read(&tb_ctx.tb_code_unprotect_count));
+    g_string_append_printf(buf, "code bitmaps        %u\n",
+                           qatomic_read(&tb_ctx.tb_code_bitmap_count));
+    smc_max = page_smc_max(&smc_page);
+    if (smc_max) {
+        g_string_append_printf(buf, "SMC hottest page    0x" TB_PAGE_ADDR_FMT
+                               " (%u TBs invalidated)\n", smc_page, smc_max);
+    }
+
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide,
+                     &flush_lpage, &flush_lpage_full);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB large page flushes %zu (%zu full)\n",
+                           flush_lpage, flush_lpage_full);
     tcg_dump_info(buf);
 }
 
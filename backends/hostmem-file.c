@@ -30,6 +30,7 @@ struct HostMemoryBackendFile {
     bool discard_data;
     bool is_pmem;
     bool readonly;
+    OnOffAuto rom;
 };
 
 static void
@@ -42,6 +43,7 @@ file_backend_memory_alloc(HostMemoryBackend *backend, Error **errp)
     HostMemoryBackendFile *fb = MEMORY_BACKEND_FILE(backend);
     uint32_t ram_flags;
     gchar *name;
+    bool rom;
 
     if (!backend->size) {
         error_setg(errp, "can't create backend with size 0");
@@ -52,13 +54,32 @@ file_backend_memory_alloc(HostMemoryBackend *backend, Error **errp)
         return;
     }
 
+    switch (fb->rom) {
+    case ON_OFF_AUTO_AUTO:
+        /* A file opened read-only has always been mapped as ROM. */
+        rom = fb->readonly;
+        break;
+    case ON_OFF_AUTO_ON:
+        rom = true;
+        break;
+    default:
+        rom = false;
+        break;
+    }
+    if (fb->readonly && !rom && backend->share) {
+        error_setg(errp, "a read-only file can only be writable by the guest"
+                   " if 'share' is off");
+        return;
+    }
+
     name = host_memory_backend_get_name(backend);
     ram_flags = backend->share ? RAM_SHARED : 0;
     ram_flags |= backend->reserve ? 0 : RAM_NORESERVE;
     ram_flags |= fb->is_pmem ? RAM_PMEM : 0;
+    ram_flags |= fb->readonly && !rom ? RAM_READONLY_FD : 0;
     memory_region_init_ram_from_file(&backend->mr, OBJECT(backend), name,
                                      backend->size, fb->align, ram_flags,
-                                     fb->mem_path, fb->readonly, errp);
+                                     fb->mem_path, rom, errp);
     g_free(name);
 #endif
 }
@@ -168,6 +189,27 @@ static void file_memory_backend_set_readonly(Object *obj, bool value,
     fb->readonly = value;
 }
 
+static int file_memory_backend_get_rom(Object *obj, Error **errp)
+{
+    HostMemoryBackendFile *fb = MEMORY_BACKEND_FILE(obj);
+
+    return fb->rom;
+}
+
+static void file_memory_backend_set_rom(Object *obj, int value, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+    HostMemoryBackendFile *fb = MEMORY_BACKEND_FILE(obj);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property 'rom' of %s.",
+                   object_get_typename(obj));
+        return;
+    }
+
+    fb->rom = value;
+}
+
 static void file_backend_unparent(Object *obj)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -204,6 +246,12 @@ file_backend_class_init(ObjectClass *oc, void *data)
     object_class_property_add_bool(oc, "readonly",
         file_memory_backend_get_readonly,
         file_memory_backend_set_readonly);
+    object_class_property_add_enum(oc, "rom", "OnOffAuto",
+        &OnOffAuto_lookup,
+        file_memory_backend_get_rom,
+        file_memory_backend_set_rom);
+    object_class_property_set_description(oc, "rom",
+        "Whether to create Read Only Memory (ROM)");
 }
 
 static void file_backend_instance_finalize(Object *o)
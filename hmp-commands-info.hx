@@ -241,12 +241,14 @@ ERST
 
     {
         .name       = "mtree",
-        .args_type  = "flatview:-f,dispatch_tree:-d,owner:-o,disabled:-D",
-        .params     = "[-f][-d][-o][-D]",
+        .args_type  = "flatview:-f,dispatch_tree:-d,owner:-o,disabled:-D,"
+                      "counts:-c",
+        .params     = "[-f][-d][-o][-D][-c]",
         .help       = "show memory tree (-f: dump flat view for address spaces;"
                       "-d: dump dispatch tree, valid with -f only);"
                       "-o: dump region owners/parents;"
-                      "-D: dump disabled regions",
+                      "-D: dump disabled regions;"
+                      "-c: dump I/O region access counts",
         .cmd        = hmp_info_mtree,
     },
 
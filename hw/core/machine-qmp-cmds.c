@@ -304,6 +304,138 @@ MemoryInfo *qmp_query_memory_size_summary(Error **errp)
     return mem_info;
 }
 
+#ifdef CONFIG_LINUX
+/* Pages checked per mincore() call or pagemap read */
+#define RESIDENCY_CHUNK_PAGES   16384
+
+#define PAGEMAP_SOFT_DIRTY      (1ULL << 55)
+#define PAGEMAP_SWAPPED         (1ULL << 62)
+
+typedef struct RamResidencyState {
+    RamBlockResidencyList **tail;
+    /* -1 unless soft-dirty bits are counted */
+    int pagemap_fd;
+    Error **errp;
+} RamResidencyState;
+
+static int query_ram_residency_one(RAMBlock *rb, void *opaque)
+{
+    RamResidencyState *s = opaque;
+    size_t page_size = qemu_real_host_page_size();
+    uint8_t *host = qemu_ram_get_host_addr(rb);
+    uint64_t npages = DIV_ROUND_UP(qemu_ram_get_used_length(rb), page_size);
+    uint64_t resident = 0, dirty = 0, swapped = 0;
+    g_autofree unsigned char *vec = NULL;
+    g_autofree uint64_t *entries = NULL;
+    RamBlockResidency *info;
+    uint64_t i, j, n;
+
+    if (!host) {
+        return 0;
+    }
+
+    vec = g_malloc(RESIDENCY_CHUNK_PAGES);
+    if (s->pagemap_fd >= 0) {
+        entries = g_new(uint64_t, RESIDENCY_CHUNK_PAGES);
+    }
+
+    for (i = 0; i < npages; i += n) {
+        uint8_t *addr = host + i * page_size;
+
+        n = MIN(npages - i, RESIDENCY_CHUNK_PAGES);
+        if (mincore(addr, n * page_size, vec) < 0) {
+            error_setg_errno(s->errp, errno,
+                             "Failed to get residency of RAM block '%s'",
+                             qemu_ram_get_idstr(rb));
+            return -1;
+        }
+        for (j = 0; j < n; j++) {
+            resident += vec[j] & 1;
+        }
+
+        if (s->pagemap_fd >= 0) {
+            size_t len = n * sizeof(uint64_t);
+            off_t offset = (uintptr_t)addr / page_size * sizeof(uint64_t);
+
+            if (pread(s->pagemap_fd, entries, len, offset) != len) {
+                error_setg_errno(s->errp, errno,
+                                 "Failed to read pagemap of RAM block '%s'",
+                                 qemu_ram_get_idstr(rb));
+                return -1;
+            }
+            for (j = 0; j < n; j++) {
+                dirty += !!(entries[j] & PAGEMAP_SOFT_DIRTY);
+                swapped += !!(entries[j] & PAGEMAP_SWAPPED);
+            }
+        }
+    }
+
+    info = g_new0(RamBlockResidency, 1);
+    info->name = g_strdup(qemu_ram_get_idstr(rb));
+    info->size = qemu_ram_get_used_length(rb);
+    info->page_size = qemu_ram_pagesize(rb);
+    info->resident = resident * page_size;
+    if (s->pagemap_fd >= 0) {
+        info->has_soft_dirty = true;
+        info->soft_dirty = dirty * page_size;
+        info->has_swapped = true;
+        info->swapped = swapped * page_size;
+    }
+    QAPI_LIST_APPEND(s->tail, info);
+    return 0;
+}
+
+RamBlockResidencyList *qmp_query_ram_residency(bool has_soft_dirty,
+                                               bool soft_dirty,
+                                               bool has_clear_soft_dirty,
+                                               bool clear_soft_dirty,
+                                               Error **errp)
+{
+    RamBlockResidencyList *head = NULL;
+    RamResidencyState s = {
+        .tail = &head,
+        .pagemap_fd = -1,
+        .errp = errp,
+    };
+    int ret;
+
+    if (has_soft_dirty && soft_dirty) {
+        s.pagemap_fd = qemu_open("/proc/self/pagemap", O_RDONLY, errp);
+        if (s.pagemap_fd < 0) {
+            return NULL;
+        }
+    }
+
+    ret = qemu_ram_foreach_block(query_ram_residency_one, &s);
+    if (s.pagemap_fd >= 0) {
+        close(s.pagemap_fd);
+    }
+    if (ret) {
+        qapi_free_RamBlockResidencyList(head);
+        return NULL;
+    }
+
+    if (has_clear_soft_dirty && clear_soft_dirty) {
+        int fd = qemu_open("/proc/self/clear_refs", O_WRONLY, errp);
+
+        if (fd < 0) {
+            qapi_free_RamBlockResidencyList(head);
+            return NULL;
+        }
+        /* 4 clears the soft-dirty bits, see proc(5) */
+        if (write(fd, "4", 1) != 1) {
+            error_setg_errno(errp, errno, "Failed to clear soft-dirty bits");
+            close(fd);
+            qapi_free_RamBlockResidencyList(head);
+            return NULL;
+        }
+        close(fd);
+    }
+
+    return head;
+}
+#endif
+
 static int qmp_x_query_rdma_foreach(Object *obj, void *opaque)
 {
     RdmaProvider *rdma;
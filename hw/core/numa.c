@@ -30,10 +30,12 @@
 #include "exec/ramlist.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
+#include "qemu/thread-context.h"
 #include "qapi/error.h"
 #include "qapi/opts-visitor.h"
 #include "qapi/qapi-visit-machine.h"
 #include "sysemu/qtest.h"
+#include "sysemu/tcg.h"
 #include "hw/core/cpu.h"
 #include "hw/mem/pc-dimm.h"
 #include "migration/vmstate.h"
@@ -749,6 +751,50 @@ void numa_cpu_pre_plug(const CPUArchId *slot, DeviceState *dev, Error **errp)
     }
 }
 
+void numa_cpu_set_affinity(MachineState *ms, CPUState *cpu)
+{
+    MachineClass *mc = MACHINE_GET_CLASS(ms);
+    CpuInstanceProperties props;
+    HostMemoryBackend *backend;
+    unsigned long *host_cpus;
+    Error *local_err = NULL;
+    int nbits, ret;
+
+    if (!ms->numa_affinity || !ms->numa_state ||
+        !ms->numa_state->num_nodes || !mc->cpu_index_to_instance_props) {
+        return;
+    }
+
+    /* Round-robin TCG runs all vCPUs in a single thread. */
+    if (tcg_enabled() && !qemu_tcg_mttcg_enabled()) {
+        return;
+    }
+
+    props = mc->cpu_index_to_instance_props(ms, cpu->cpu_index);
+    if (!props.has_node_id) {
+        return;
+    }
+    backend = ms->numa_state->nodes[props.node_id].node_memdev;
+    if (!backend || bitmap_empty(backend->host_nodes, MAX_NODES + 1)) {
+        return;
+    }
+
+    host_cpus = host_nodes_to_cpus(backend->host_nodes, MAX_NODES + 1,
+                                   &nbits, &local_err);
+    if (!host_cpus) {
+        warn_report_once("numa-affinity: %s", error_get_pretty(local_err));
+        error_free(local_err);
+        return;
+    }
+
+    ret = qemu_thread_set_affinity(cpu->thread, host_cpus, nbits);
+    if (ret) {
+        warn_report_once("numa-affinity: setting CPU affinity failed: %s",
+                         strerror(ret));
+    }
+    g_free(host_cpus);
+}
+
 static void numa_stat_memory_devices(NumaNodeMem node_mem[])
 {
     MemoryDeviceInfoList *info_list = qmp_memory_device_list();
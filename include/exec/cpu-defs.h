@@ -166,19 +166,31 @@ typedef struct CPUTLBEntryFull {
 #endif  /* !CONFIG_USER_ONLY */
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
+/* Number of large page regions tracked per MMU mode. */
+#define CPU_TLB_LARGE_PAGES 8
+
+/*
+ * A region covering one or more large pages allocated into the tlb.
+ * The region is matched if (addr & mask) == addr.
+ */
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * Describe regions covering all of the large pages allocated
+     * into the tlb.  When any page within a region is flushed, we
+     * must flush every entry within that region.  Once all slots are
+     * in use, new large pages widen the closest existing region.
      */
-    target_ulong large_page_addr;
-    target_ulong large_page_mask;
+    CPUTLBLargePage large_page[CPU_TLB_LARGE_PAGES];
+    unsigned n_large_pages;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -223,6 +235,10 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Large page regions flushed because a page within was flushed. */
+    size_t lpage_flush_count;
+    /* Masked range flushes that hit a large page region: full flush. */
+    size_t lpage_full_flush_count;
 } CPUTLBCommon;
 
 /*
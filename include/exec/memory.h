@@ -25,6 +25,7 @@
 #include "qemu/queue.h"
 #include "qemu/int128.h"
 #include "qemu/notify.h"
+#include "qemu/stats64.h"
 #include "qom/object.h"
 #include "qemu/rcu.h"
 
@@ -72,7 +73,10 @@ static inline void fuzz_dma_read_cb(size_t addr,
 /* Dirty tracking enabled because dirty limit */
 #define GLOBAL_DIRTY_LIMIT      (1U << 2)
 
-#define GLOBAL_DIRTY_MASK  (0x7)
+/* Dirty tracking kept between incremental snapshots */
+#define GLOBAL_DIRTY_SNAPSHOT   (1U << 3)
+
+#define GLOBAL_DIRTY_MASK  (0xf)
 
 extern unsigned int global_dirty_tracking;
 
@@ -232,6 +236,13 @@ typedef struct IOMMUTLBEvent {
 /* RAM that isn't accessible through normal means. */
 #define RAM_PROTECTED (1 << 8)
 
+/*
+ * The backing file is opened read-only, even though the guest may write
+ * to the RAM.  Only valid for private mappings, where guest writes are
+ * copied on write and never reach the file.
+ */
+#define RAM_READONLY_FD (1 << 9)
+
 static inline void iommu_notifier_init(IOMMUNotifier *n, IOMMUNotify fn,
                                        IOMMUNotifierFlag flags,
                                        hwaddr start, hwaddr end,
@@ -307,6 +318,14 @@ struct MemoryRegionOps {
          */
         bool unaligned;
     } impl;
+    /*
+     * If true, the callbacks are thread-safe and are called without
+     * the BQL held when the region is accessed from a vCPU thread.
+     * This is meant for read-mostly status registers that guests
+     * poll, and must not be set if the callbacks touch state that is
+     * protected by the BQL.
+     */
+    bool lockless;
 };
 
 typedef struct MemoryRegionClass {
@@ -791,6 +810,9 @@ struct MemoryRegion {
     unsigned ioeventfd_nb;
     MemoryRegionIoeventfd *ioeventfds;
     RamDiscardManager *rdm; /* Only for RAM */
+    /* Accesses dispatched to @ops, for "info mtree -c" */
+    Stat64 nb_reads;
+    Stat64 nb_writes;
 };
 
 struct IOMMUMemoryRegion {
@@ -1061,6 +1083,13 @@ struct MemoryListener {
     QTAILQ_ENTRY(MemoryListener) link_as;
 };
 
+typedef struct AddressSpaceMapClient {
+    QEMUBH *bh;
+    QLIST_ENTRY(AddressSpaceMapClient) link;
+} AddressSpaceMapClient;
+
+#define DEFAULT_MAX_BOUNCE_BUFFER_SIZE (4096)
+
 /**
  * struct AddressSpace: describes a mapping of addresses to #MemoryRegion objects
  */
@@ -1077,6 +1106,17 @@ struct AddressSpace {
     struct MemoryRegionIoeventfd *ioeventfds;
     QTAILQ_HEAD(, MemoryListener) listeners;
     QTAILQ_ENTRY(AddressSpace) address_spaces_link;
+
+    /*
+     * Maximum number of bytes of bounce buffers that address_space_map()
+     * may have outstanding for this address space at any one time.
+     */
+    size_t max_bounce_buffer_size;
+    /* Bytes of bounce buffers currently outstanding, accessed atomically. */
+    size_t bounce_buffer_size;
+    /* Callbacks to invoke when bounce buffer space frees up. */
+    QemuMutex map_client_list_lock;
+    QLIST_HEAD(, AddressSpaceMapClient) map_client_list;
 };
 
 typedef struct AddressSpaceDispatch AddressSpaceDispatch;
@@ -2476,7 +2516,8 @@ void memory_global_dirty_log_start(unsigned int flags);
  */
 void memory_global_dirty_log_stop(unsigned int flags);
 
-void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled);
+void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled,
+                bool counts);
 
 bool memory_region_access_valid(MemoryRegion *mr, hwaddr addr,
                                 unsigned size, bool is_write,
@@ -2813,8 +2854,13 @@ bool address_space_access_valid(AddressSpace *as, hwaddr addr, hwaddr len,
  * May return %NULL and set *@plen to zero(0), if resources needed to perform
  * the mapping are exhausted.
  * Use only for reads OR writes - not for read-modify-write operations.
- * Use cpu_register_map_client() to know when retrying the map operation is
- * likely to succeed.
+ * Use address_space_register_map_client() to know when retrying the map
+ * operation is likely to succeed.
+ *
+ * Regions that cannot be accessed directly are mapped through a bounce
+ * buffer.  Each address space allows at most its max_bounce_buffer_size
+ * bytes of bounce buffers to be outstanding, so devices with their own
+ * address space do not contend with each other.
  *
  * @as: #AddressSpace to be accessed
  * @addr: address within that address space
@@ -2839,6 +2885,29 @@ void *address_space_map(AddressSpace *as, hwaddr addr,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          bool is_write, hwaddr access_len);
 
+/*
+ * address_space_register_map_client: Register a callback to invoke when
+ * resources for address_space_map() are available again.
+ *
+ * address_space_map may fail when there are not enough resources
+ * available, such as when bounce buffer memory would exceed the limit.
+ * The callback can be used to retry the address_space_map operation.
+ * Note that the callback gets automatically removed after firing.
+ *
+ * @as: #AddressSpace to be accessed
+ * @bh: callback to invoke when address_space_map() retry is appropriate
+ */
+void address_space_register_map_client(AddressSpace *as, QEMUBH *bh);
+
+/*
+ * address_space_unregister_map_client: Unregister a callback that has
+ * previously been registered and not fired yet.
+ *
+ * @as: #AddressSpace to be accessed
+ * @bh: callback to unregister
+ */
+void address_space_unregister_map_client(AddressSpace *as, QEMUBH *bh);
+
 
 /* Internal functions, part of the implementation of address_space_read.  */
 MemTxResult address_space_read_full(AddressSpace *as, hwaddr addr,
@@ -354,41 +354,34 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
         long k;
         long nr = BITS_TO_LONGS(pages);
 
-        idx = (start >> TARGET_PAGE_BITS) / DIRTY_MEMORY_BLOCK_SIZE;
-        offset = BIT_WORD((start >> TARGET_PAGE_BITS) %
-                          DIRTY_MEMORY_BLOCK_SIZE);
-
         WITH_RCU_READ_LOCK_GUARD() {
             for (i = 0; i < DIRTY_MEMORY_NUM; i++) {
                 blocks[i] =
                     qatomic_rcu_read(&ram_list.dirty_memory[i])->blocks;
             }
 
-            for (k = 0; k < nr; k++) {
-                if (bitmap[k]) {
-                    unsigned long temp = leul_to_cpu(bitmap[k]);
+            /* Most of the log is usually clean, skip it in chunks.  */
+            for (k = bitmap_next_nonzero_word(bitmap, 0, nr); k < nr;
+                 k = bitmap_next_nonzero_word(bitmap, k + 1, nr)) {
+                unsigned long temp = leul_to_cpu(bitmap[k]);
 
-                    qatomic_or(&blocks[DIRTY_MEMORY_VGA][idx][offset], temp);
+                idx = (page + k) / BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE);
+                offset = (page + k) % BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE);
 
-                    if (global_dirty_tracking) {
-                        qatomic_or(
-                                &blocks[DIRTY_MEMORY_MIGRATION][idx][offset],
-                                temp);
-                        if (unlikely(
-                            global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
-                            total_dirty_pages += ctpopl(temp);
-                        }
-                    }
+                qatomic_or(&blocks[DIRTY_MEMORY_VGA][idx][offset], temp);
 
-                    if (tcg_enabled()) {
-                        qatomic_or(&blocks[DIRTY_MEMORY_CODE][idx][offset],
-                                   temp);
+                if (global_dirty_tracking) {
+                    qatomic_or(&blocks[DIRTY_MEMORY_MIGRATION][idx][offset],
+                               temp);
+                    if (unlikely(
+                        global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
+                        total_dirty_pages += ctpopl(temp);
                     }
                 }
 
-                if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
-                    offset = 0;
-                    idx++;
+                if (tcg_enabled()) {
+                    qatomic_or(&blocks[DIRTY_MEMORY_CODE][idx][offset],
+                               temp);
                 }
             }
         }
@@ -405,22 +398,21 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
          * bitmap-traveling is faster than memory-traveling (for addr...)
          * especially when most of the memory is not dirty.
          */
-        for (i = 0; i < len; i++) {
-            if (bitmap[i] != 0) {
-                c = leul_to_cpu(bitmap[i]);
-                if (unlikely(global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
-                    total_dirty_pages += ctpopl(c);
-                }
-                do {
-                    j = ctzl(c);
-                    c &= ~(1ul << j);
-                    page_number = (i * HOST_LONG_BITS + j) * hpratio;
-                    addr = page_number * TARGET_PAGE_SIZE;
-                    ram_addr = start + addr;
-                    cpu_physical_memory_set_dirty_range(ram_addr,
-                                       TARGET_PAGE_SIZE * hpratio, clients);
-                } while (c != 0);
+        for (i = bitmap_next_nonzero_word(bitmap, 0, len); i < len;
+             i = bitmap_next_nonzero_word(bitmap, i + 1, len)) {
+            c = leul_to_cpu(bitmap[i]);
+            if (unlikely(global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
+                total_dirty_pages += ctpopl(c);
             }
+            do {
+                j = ctzl(c);
+                c &= ~(1ul << j);
+                page_number = (i * HOST_LONG_BITS + j) * hpratio;
+                addr = page_number * TARGET_PAGE_SIZE;
+                ram_addr = start + addr;
+                cpu_physical_memory_set_dirty_range(ram_addr,
+                                   TARGET_PAGE_SIZE * hpratio, clients);
+            } while (c != 0);
         }
     }
 }
@@ -461,8 +453,8 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
     if (((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
          (start + rb->offset) &&
         !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1))) {
-        int k;
-        int nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
+        long k, i, n;
+        long nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
         unsigned long * const *src;
         unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
         unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
@@ -472,20 +464,24 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
         src = qatomic_rcu_read(
                 &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
 
-        for (k = page; k < page + nr; k++) {
-            if (src[idx][offset]) {
-                unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
+        /* One DirtyMemoryBlock at a time, skipping clean chunks.  */
+        for (k = page; k < page + nr; k += n) {
+            unsigned long *block = src[idx] + offset;
+
+            n = MIN(page + nr - k,
+                    BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE) - offset);
+            for (i = bitmap_next_nonzero_word(block, 0, n); i < n;
+                 i = bitmap_next_nonzero_word(block, i + 1, n)) {
+                unsigned long bits = qatomic_xchg(&block[i], 0);
                 unsigned long new_dirty;
-                new_dirty = ~dest[k];
-                dest[k] |= bits;
+                new_dirty = ~dest[k + i];
+                dest[k + i] |= bits;
                 new_dirty &= bits;
                 num_dirty += ctpopl(new_dirty);
             }
 
-            if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
-                offset = 0;
-                idx++;
-            }
+            offset = 0;
+            idx++;
         }
 
         if (rb->clear_bmap) {
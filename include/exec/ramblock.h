@@ -74,6 +74,28 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * With mapped-ram, the pages of the block have a fixed location in the
+     * migration file, starting at pages_offset.  file_bmap has a bit set
+     * for each page whose latest contents were written there; it is stored
+     * at bitmap_offset once the migration completes.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    uint64_t pages_offset;
+    /*
+     * Pages found dirty by the migration bitmap syncs of the current rate
+     * period, and the rate at which the guest dirties the block, averaged
+     * over the previous periods, in bytes per second.
+     */
+    uint64_t dirty_pages_period;
+    uint64_t dirty_rate;
+    /*
+     * With page-dedup, the hash of the contents last sent in full for
+     * each page, or 0 when the destination may hold anything else.
+     */
+    uint64_t *dedup_hash;
 };
 #endif
 #endif
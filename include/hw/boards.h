@@ -334,6 +334,7 @@ struct MachineState {
     char *dt_compatible;
     bool dump_guest_core;
     bool mem_merge;
+    bool numa_affinity;
     bool usb;
     bool usb_disabled;
     char *firmware;
@@ -196,6 +196,15 @@ struct VMStateDescription {
      * a QEMU_VM_SECTION_START section.
      */
     bool early_setup;
+    /*
+     * The state may be saved and loaded in a thread of its own, alongside
+     * the other independent sections of the same priority, when the
+     * parallel-device-state capability is enabled.  The callbacks then
+     * run while the BQL is held by another thread, so they must neither
+     * rely on holding it themselves nor touch state outside the device;
+     * no section of the same priority may depend on this one either.
+     */
+    bool independent;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
@@ -38,6 +38,7 @@
  * bitmap_set_atomic(dst, pos, nbits)           Set specified bit area with atomic ops
  * bitmap_clear(dst, pos, nbits)                Clear specified bit area
  * bitmap_test_and_clear_atomic(dst, pos, nbits)    Test and clear area
+ * bitmap_next_nonzero_word(src, pos, nwords)   Find next non-zero word
  * bitmap_find_next_zero_area(buf, len, pos, n, mask)  Find bit free area
  * bitmap_to_le(dst, src, nbits)      Convert bitmap to little endian
  * bitmap_from_le(dst, src, nbits)    Convert bitmap from little endian
@@ -256,6 +257,28 @@ bool bitmap_test_and_clear_atomic(unsigned long *map, long start, long nr);
 bool bitmap_test_and_clear(unsigned long *map, long start, long nr);
 void bitmap_copy_and_clear_atomic(unsigned long *dst, unsigned long *src,
                                   long nr);
+long bitmap_next_nonzero_word_slow(const unsigned long *map,
+                                   long start, long nr);
+
+/**
+ * bitmap_next_nonzero_word:
+ * @map: The address to base the search on
+ * @start: The word index to start searching at
+ * @nr: The bitmap size in words
+ *
+ * Return the index of the first non-zero word of @map in [@start, @nr),
+ * or @nr if there is none.  Long runs of zero words, as found in sparse
+ * dirty bitmaps, are skipped several words at a time.  The words are
+ * read without atomic operations, so concurrent updates may be missed.
+ */
+static inline long bitmap_next_nonzero_word(const unsigned long *map,
+                                            long start, long nr)
+{
+    if (start < nr && map[start]) {
+        return start;
+    }
+    return bitmap_next_nonzero_word_slow(map, start, nr);
+}
 unsigned long bitmap_find_next_zero_area(unsigned long *map,
                                          unsigned long size,
                                          unsigned long start,
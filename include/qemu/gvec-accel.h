@@ -0,0 +1,59 @@
+/*
+ * Host vector kernels for out-of-line gvec helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QEMU_GVEC_ACCEL_H
+#define QEMU_GVEC_ACCEL_H
+
+/*
+ * Compute D = A op B for OPRSZ bytes.  OPRSZ is a non-zero multiple
+ * of 8, as produced by simd_oprsz().  D may alias A and/or B.
+ */
+typedef void GVecAccelFn(void *d, const void *a, const void *b,
+                         intptr_t oprsz);
+
+/*
+ * The operations here are those for which the host has a single
+ * instruction, but for which the generic C loop cannot be vectorized
+ * well by the compiler.
+ */
+typedef struct GVecAccelOps {
+    const char *name;
+    GVecAccelFn *ssadd8;
+    GVecAccelFn *ssadd16;
+    GVecAccelFn *sssub8;
+    GVecAccelFn *sssub16;
+    GVecAccelFn *usadd8;
+    GVecAccelFn *usadd16;
+    GVecAccelFn *ussub8;
+    GVecAccelFn *ussub16;
+} GVecAccelOps;
+
+/* The implementation selected at startup for the running host. */
+extern const GVecAccelOps *gvec_accel_ops;
+
+/**
+ * gvec_accel_nth:
+ * @n: index
+ *
+ * Return the @n'th implementation usable on the running host, most
+ * preferred first, or NULL if there are fewer than @n + 1.  The last
+ * implementation is always the generic C one.  This is intended for
+ * testing and benchmarking.
+ */
+const GVecAccelOps *gvec_accel_nth(unsigned n);
+
+#endif /* QEMU_GVEC_ACCEL_H */
@@ -54,4 +54,13 @@ void thread_context_create_thread(ThreadContext *tc, QemuThread *thread,
                                   void *(*start_routine)(void *), void *arg,
                                   int mode);
 
+/*
+ * Return a bitmap of the host CPUs that belong to the host NUMA nodes set
+ * in @host_nodes, storing its size in bits in @nbits.  Fails if the nodes
+ * select no CPUs or host NUMA support is not available.
+ */
+unsigned long *host_nodes_to_cpus(const unsigned long *host_nodes,
+                                  unsigned long nr_nodes, int *nbits,
+                                  Error **errp);
+
 #endif /* SYSEMU_THREAD_CONTEXT_H */
@@ -109,5 +109,6 @@ extern QemuOptsList qemu_numa_opts;
 void numa_cpu_pre_plug(const struct CPUArchId *slot, DeviceState *dev,
                        Error **errp);
 bool numa_uses_legacy_mem(void);
+void numa_cpu_set_affinity(MachineState *ms, CPUState *cpu);
 
 #endif
@@ -545,6 +545,9 @@ typedef struct TCGProfile {
     int64_t code_time;
     int64_t la_time;
     int64_t opt_time;
+    int64_t opt_cse_count;
+    int64_t opt_ld_fwd_count;
+    int64_t opt_st_del_count;
     int64_t restore_count;
     int64_t restore_time;
     int64_t table_op_count[NB_OPS];
@@ -0,0 +1,115 @@
+/*
+ * QEMU live migration to and from a file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "channel.h"
+#include "file.h"
+#include "migration.h"
+#include "io/channel-file.h"
+#include "trace.h"
+
+/*
+ * The file name is kept so that the multifd channels, which write and
+ * read the guest pages at their own offsets, can open it on their own.
+ */
+static char *outgoing_filename;
+static char *incoming_filename;
+
+static int file_open_flags(int flags)
+{
+#ifdef O_DIRECT
+    if (migrate_direct_io()) {
+        flags |= O_DIRECT;
+    }
+#endif
+    return flags;
+}
+
+void file_start_outgoing_migration(MigrationState *s, const char *filename,
+                                   Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    trace_migration_file_outgoing(filename);
+
+    fioc = qio_channel_file_new_path(filename, O_CREAT | O_WRONLY | O_TRUNC,
+                                     0600, errp);
+    if (!fioc) {
+        return;
+    }
+
+    g_free(outgoing_filename);
+    outgoing_filename = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-outgoing");
+    migration_channel_connect(s, QIO_CHANNEL(fioc), NULL, NULL);
+    object_unref(OBJECT(fioc));
+}
+
+static gboolean file_accept_incoming_migration(QIOChannel *ioc,
+                                               GIOCondition condition,
+                                               gpointer opaque)
+{
+    migration_channel_process_incoming(ioc);
+    object_unref(OBJECT(ioc));
+    return G_SOURCE_REMOVE;
+}
+
+void file_start_incoming_migration(const char *filename, Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    trace_migration_file_incoming(filename);
+
+    fioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
+    if (!fioc) {
+        return;
+    }
+
+    g_free(incoming_filename);
+    incoming_filename = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-incoming");
+    qio_channel_add_watch_full(QIO_CHANNEL(fioc), G_IO_IN,
+                               file_accept_incoming_migration,
+                               NULL, NULL,
+                               g_main_context_get_thread_default());
+}
+
+/*
+ * Open another channel on the outgoing file for a multifd thread, and
+ * hand it over through @f as socket_send_channel_create() does.
+ */
+void file_send_channel_create(QIOTaskFunc f, void *data)
+{
+    QIOChannelFile *fioc;
+    QIOTask *task;
+    Error *err = NULL;
+
+    fioc = qio_channel_file_new_path(outgoing_filename,
+                                     file_open_flags(O_WRONLY), 0, &err);
+
+    task = qio_task_new(OBJECT(fioc), f, data, NULL);
+    if (!fioc) {
+        qio_task_set_error(task, err);
+    }
+    qio_task_complete(task);
+}
+
+QIOChannel *file_recv_channel_create(Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    fioc = qio_channel_file_new_path(incoming_filename,
+                                     file_open_flags(O_RDONLY), 0, errp);
+    if (!fioc) {
+        return NULL;
+    }
+    qio_channel_set_name(QIO_CHANNEL(fioc), "migration-file-loader");
+    return QIO_CHANNEL(fioc);
+}
@@ -17,13 +17,17 @@
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
 #include "migration/blocker.h"
 #include "exec.h"
 #include "fd.h"
+#include "file.h"
 #include "socket.h"
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/dirtylimit.h"
+#include "sysemu/kvm.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
@@ -104,6 +108,8 @@
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
+/* 0: fast lz4, 1-12: lz4-hc level */
+#define DEFAULT_MIGRATE_MULTIFD_LZ4_LEVEL 0
 
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
@@ -132,6 +138,7 @@ enum mig_rp_message_type {
     MIG_RP_MSG_REQ_PAGES,    /* data (start: be64, len: be32) */
     MIG_RP_MSG_RECV_BITMAP,  /* send recved_bitmap back to source */
     MIG_RP_MSG_RESUME_ACK,   /* tell source that we are ready to resume */
+    MIG_RP_MSG_REQ_PREFETCH, /* data (start: be64, len: be32, id: string) */
 
     MIG_RP_MSG_MAX
 };
@@ -167,7 +174,8 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_XBZRLE,
     MIGRATION_CAPABILITY_X_COLO,
     MIGRATION_CAPABILITY_VALIDATE_UUID,
-    MIGRATION_CAPABILITY_ZERO_COPY_SEND);
+    MIGRATION_CAPABILITY_ZERO_COPY_SEND,
+    MIGRATION_CAPABILITY_MAPPED_RAM);
 
 /* When we add fault tolerance, we could have several
    migrations at once.  For now we don't need to add
@@ -192,12 +200,18 @@ static bool migration_needs_multiple_sockets(void)
 static bool uri_supports_multi_channels(const char *uri)
 {
     return strstart(uri, "tcp:", NULL) || strstart(uri, "unix:", NULL) ||
-           strstart(uri, "vsock:", NULL);
+           strstart(uri, "vsock:", NULL) ||
+           (migrate_mapped_ram() && strstart(uri, "file:", NULL));
 }
 
 static bool
 migration_channels_and_uri_compatible(const char *uri, Error **errp)
 {
+    if (migrate_mapped_ram() && !strstart(uri, "file:", NULL)) {
+        error_setg(errp, "Capability mapped-ram requires a file: URI");
+        return false;
+    }
+
     if (migration_needs_multiple_sockets() &&
         !uri_supports_multi_channels(uri)) {
         error_setg(errp, "Migration requires multi-channel URIs (e.g. tcp)");
@@ -443,6 +457,35 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
     return migrate_send_rp_message(mis, msg_type, msglen, bufc);
 }
 
+/*
+ * Ask the source to send pages ahead of the faults that the destination
+ * expects, with a lower priority than the pages requested by faults.
+ *   rb: the RAMBlock to request the pages in
+ *   start: Address offset within the RB
+ *   len: Length in bytes required - must be a multiple of pagesize
+ *
+ * The RAMBlock name is always sent, so that last_rb is left to the page
+ * requests.
+ */
+int migrate_send_rp_message_req_prefetch(MigrationIncomingState *mis,
+                                         RAMBlock *rb, ram_addr_t start,
+                                         ram_addr_t len)
+{
+    uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
+    const char *rbname = qemu_ram_get_idstr(rb);
+    size_t rbname_len = strlen(rbname);
+
+    assert(rbname_len < 256);
+
+    *(uint64_t *)bufc = cpu_to_be64((uint64_t)start);
+    *(uint32_t *)(bufc + 8) = cpu_to_be32((uint32_t)len);
+    bufc[12] = rbname_len;
+    memcpy(bufc + 13, rbname, rbname_len);
+
+    return migrate_send_rp_message(mis, MIG_RP_MSG_REQ_PREFETCH,
+                                   13 + rbname_len, bufc);
+}
+
 int migrate_send_rp_req_pages(MigrationIncomingState *mis,
                               RAMBlock *rb, ram_addr_t start, uint64_t haddr)
 {
@@ -526,6 +569,8 @@ static void qemu_start_incoming_migration(const char *uri, Error **errp)
         exec_start_incoming_migration(p, errp);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_incoming_migration(p, errp);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_incoming_migration(p, errp);
     } else {
         error_setg(errp, "unknown migration protocol: %s", uri);
     }
@@ -742,7 +787,7 @@ void migration_fd_process_incoming(QEMUFile *f, Error **errp)
 static bool migration_should_start_incoming(bool main_channel)
 {
     /* Multifd doesn't start unless all channels are established */
-    if (migrate_use_multifd()) {
+    if (migrate_multifd_packets()) {
         return migration_has_all_channels();
     }
 
@@ -769,7 +814,7 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
     uint32_t channel_magic = 0;
     int ret = 0;
 
-    if (migrate_use_multifd() && !migrate_postcopy_ram() &&
+    if (migrate_multifd_packets() && !migrate_postcopy_ram() &&
         qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_READ_MSG_PEEK)) {
         /*
          * With multiple channels, it is possible that we receive channels
@@ -801,6 +846,10 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
 
     if (default_channel) {
         f = qemu_file_new_input(ioc);
+        /* Only the RAM setup section of the main channel passes fds */
+        if (migrate_ram_fd_passing() && qemu_file_can_pass_fd(f)) {
+            qemu_file_set_fd_passing(f, true);
+        }
 
         if (!migration_incoming_setup(f, errp)) {
             return;
@@ -844,7 +893,7 @@ bool migration_has_all_channels(void)
         return false;
     }
 
-    if (migrate_use_multifd()) {
+    if (migrate_multifd_packets()) {
         return multifd_recv_all_channels_created();
     }
 
@@ -994,6 +1043,8 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->multifd_zlib_level = s->parameters.multifd_zlib_level;
     params->has_multifd_zstd_level = true;
     params->multifd_zstd_level = s->parameters.multifd_zstd_level;
+    params->has_multifd_lz4_level = true;
+    params->multifd_lz4_level = s->parameters.multifd_lz4_level;
     params->has_xbzrle_cache_size = true;
     params->xbzrle_cache_size = s->parameters.xbzrle_cache_size;
     params->has_max_postcopy_bandwidth = true;
@@ -1016,6 +1067,9 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
                        s->parameters.block_bitmap_mapping);
     }
 
+    params->has_direct_io = true;
+    params->direct_io = s->parameters.direct_io;
+
     return params;
 }
 
@@ -1132,6 +1186,8 @@ static void populate_time_info(MigrationInfo *info, MigrationState *s)
     } else {
         info->has_expected_downtime = true;
         info->expected_downtime = s->expected_downtime;
+        info->has_predicted_downtime = true;
+        info->predicted_downtime = s->predicted_downtime;
     }
 }
 
@@ -1158,16 +1214,23 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->precopy_bytes = ram_counters.precopy_bytes;
     info->ram->downtime_bytes = ram_counters.downtime_bytes;
     info->ram->postcopy_bytes = stat64_get(&ram_atomic_counters.postcopy_bytes);
+    info->ram->dedup_pages = stat64_get(&ram_atomic_counters.dedup);
+
+    if (migrate_use_xbzrle() || migrate_multifd_xbzrle()) {
+        XBZRLECacheStats stats = xbzrle_counters;
 
-    if (migrate_use_xbzrle()) {
+        /* The rates are only computed on each dirty sync */
+        if (migrate_multifd_xbzrle()) {
+            multifd_xbzrle_get_counters(&stats);
+        }
         info->xbzrle_cache = g_malloc0(sizeof(*info->xbzrle_cache));
         info->xbzrle_cache->cache_size = migrate_xbzrle_cache_size();
-        info->xbzrle_cache->bytes = xbzrle_counters.bytes;
-        info->xbzrle_cache->pages = xbzrle_counters.pages;
-        info->xbzrle_cache->cache_miss = xbzrle_counters.cache_miss;
-        info->xbzrle_cache->cache_miss_rate = xbzrle_counters.cache_miss_rate;
-        info->xbzrle_cache->encoding_rate = xbzrle_counters.encoding_rate;
-        info->xbzrle_cache->overflow = xbzrle_counters.overflow;
+        info->xbzrle_cache->bytes = stats.bytes;
+        info->xbzrle_cache->pages = stats.pages;
+        info->xbzrle_cache->cache_miss = stats.cache_miss;
+        info->xbzrle_cache->cache_miss_rate = stats.cache_miss_rate;
+        info->xbzrle_cache->encoding_rate = stats.encoding_rate;
+        info->xbzrle_cache->overflow = stats.overflow;
     }
 
     if (migrate_use_compression()) {
@@ -1410,6 +1473,12 @@ static bool migrate_caps_check(bool *cap_list,
     }
 #endif
 
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Multifd zero page detection requires multifd");
+        return false;
+    }
+
     if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT]) {
         if (!cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
             error_setg(errp, "Postcopy preempt requires postcopy-ram");
@@ -1428,6 +1497,25 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_DIRTY_LIMIT]) {
+        if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+            error_setg(errp, "Dirty limit requires KVM with accelerator "
+                       "property 'dirty-ring-size' set");
+            return false;
+        }
+        if (cap_list[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+            error_setg(errp, "Dirty limit is not compatible with "
+                       "auto-converge");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH] &&
+        !cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+        error_setg(errp, "Postcopy prefetch requires postcopy-ram");
+        return false;
+    }
+
     if (cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
         if (cap_list[MIGRATION_CAPABILITY_COMPRESS]) {
             error_setg(errp, "Multifd is not compatible with compress");
@@ -1435,6 +1523,67 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    /*
+     * Zero pages found by the channels bypass the compression method and
+     * would leave stale copies in the xbzrle page cache.
+     */
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE] &&
+        migrate_multifd_compression() == MULTIFD_COMPRESSION_XBZRLE) {
+        error_setg(errp, "Multifd zero page is not compatible with multifd "
+                   "xbzrle compression");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        /*
+         * Every page is written at a fixed offset in the file, so
+         * anything that changes the size of a page on the wire, or
+         * that needs the destination to talk back, does not fit.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND] ||
+            migrate_multifd_compression()) {
+            error_setg(errp, "Mapped-ram is not compatible with postcopy, "
+                       "zero-copy or any kind of page compression");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_PAGE_DEDUP]) {
+        /*
+         * A reference must reach the destination after the page it
+         * points to, and the source must know what the destination
+         * holds for that page, so the pages have to go through the
+         * main stream as they are.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_MULTIFD] ||
+            cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_MAPPED_RAM] ||
+            cap_list[MIGRATION_CAPABILITY_X_COLO]) {
+            error_setg(errp, "Page dedup is not compatible with multifd, "
+                       "xbzrle, compress, mapped-ram or COLO");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_RAM_FD_PASSING]) {
+        /*
+         * Both sides map the same memory: postcopy and COLO would discard
+         * or overwrite the pages of the source, and a background snapshot
+         * goes to a file.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            cap_list[MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT] ||
+            cap_list[MIGRATION_CAPABILITY_X_COLO]) {
+            error_setg(errp, "RAM fd passing is not compatible with "
+                       "postcopy, background snapshots or COLO");
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -1596,6 +1745,13 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_multifd_lz4_level &&
+        (params->multifd_lz4_level > 12)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "multifd_lz4_level",
+                   "a value between 0 and 12");
+        return false;
+    }
+
     if (params->has_xbzrle_cache_size &&
         (params->xbzrle_cache_size < qemu_target_page_size() ||
          !is_power_of_2(params->xbzrle_cache_size))) {
@@ -1650,6 +1806,27 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (migrate_mapped_ram() &&
+        params->has_multifd_compression && params->multifd_compression) {
+        error_setg(errp, "Mapped-ram is not compatible with multifd "
+                   "compression");
+        return false;
+    }
+
+    if (migrate_multifd_zero_page() && params->has_multifd_compression &&
+        params->multifd_compression == MULTIFD_COMPRESSION_XBZRLE) {
+        error_setg(errp, "Multifd xbzrle compression is not compatible with "
+                   "multifd zero page");
+        return false;
+    }
+
+#ifndef O_DIRECT
+    if (params->has_direct_io && params->direct_io) {
+        error_setg(errp, "No O_DIRECT support on this host");
+        return false;
+    }
+#endif
+
 #ifdef CONFIG_LINUX
     if (migrate_use_zero_copy_send() &&
         ((params->has_multifd_compression && params->multifd_compression) ||
@@ -1759,6 +1936,14 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
         dest->has_block_bitmap_mapping = true;
         dest->block_bitmap_mapping = params->block_bitmap_mapping;
     }
+
+    if (params->has_direct_io) {
+        dest->direct_io = params->direct_io;
+    }
+
+    if (params->has_multifd_lz4_level) {
+        dest->multifd_lz4_level = params->multifd_lz4_level;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1881,6 +2066,14 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
             QAPI_CLONE(BitmapMigrationNodeAliasList,
                        params->block_bitmap_mapping);
     }
+
+    if (params->has_direct_io) {
+        s->parameters.direct_io = params->direct_io;
+    }
+
+    if (params->has_multifd_lz4_level) {
+        s->parameters.multifd_lz4_level = params->multifd_lz4_level;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -2250,6 +2443,7 @@ void migrate_init(MigrationState *s)
     s->pages_per_second = 0.0;
     s->downtime = 0;
     s->expected_downtime = 0;
+    s->predicted_downtime = 0;
     s->setup_time = 0;
     s->start_postcopy = false;
     s->postcopy_after_devices = false;
@@ -2265,6 +2459,9 @@ void migrate_init(MigrationState *s)
     s->vm_was_running = false;
     s->iteration_initial_bytes = 0;
     s->threshold_size = 0;
+    s->bandwidth = 0;
+    s->dirty_limit_quota = 0;
+    s->dirty_limit_time = 0;
 }
 
 int migrate_add_blocker_internal(Error *reason, Error **errp)
@@ -2523,6 +2720,8 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         exec_start_outgoing_migration(s, p, &local_err);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_outgoing_migration(s, p, &local_err);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_outgoing_migration(s, p, &local_err);
     } else {
         if (!(has_resume && resume)) {
             yank_unregister_instance(MIGRATION_YANK_INSTANCE);
@@ -2701,6 +2900,49 @@ bool migrate_use_multifd(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_multifd_zero_page(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE];
+}
+
+bool migrate_multifd_xbzrle(void)
+{
+    return migrate_use_multifd() &&
+        migrate_multifd_compression() == MULTIFD_COMPRESSION_XBZRLE;
+}
+
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
+/*
+ * Whether the multifd channels carry their own packet stream.  With
+ * mapped-ram they write the pages straight to their place in the file
+ * instead, and nothing but the pages goes through them.
+ */
+bool migrate_multifd_packets(void)
+{
+    return migrate_use_multifd() && !migrate_mapped_ram();
+}
+
+bool migrate_direct_io(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.direct_io;
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s;
@@ -2748,6 +2990,15 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+int migrate_multifd_lz4_level(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.multifd_lz4_level;
+}
+
 #ifdef CONFIG_LINUX
 bool migrate_use_zero_copy_send(void)
 {
@@ -2840,6 +3091,60 @@ bool migrate_postcopy_preempt(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT];
 }
 
+bool migrate_postcopy_prefetch(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH];
+}
+
+bool migrate_parallel_device_state(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_PARALLEL_DEVICE_STATE];
+}
+
+bool migrate_dirty_limit(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
+}
+
+bool migrate_page_dedup(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_PAGE_DEDUP];
+}
+
+bool migrate_incremental_snapshot(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_INCREMENTAL_SNAPSHOT];
+}
+
+bool migrate_ram_fd_passing(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_RAM_FD_PASSING];
+}
+
 /* migration thread support */
 /*
  * Something bad happened to the RP stream, mark an error
@@ -2861,6 +3166,7 @@ static struct rp_cmd_args {
     [MIG_RP_MSG_REQ_PAGES_ID]   = { .len = -1, .name = "REQ_PAGES_ID" },
     [MIG_RP_MSG_RECV_BITMAP]    = { .len = -1, .name = "RECV_BITMAP" },
     [MIG_RP_MSG_RESUME_ACK]     = { .len =  4, .name = "RESUME_ACK" },
+    [MIG_RP_MSG_REQ_PREFETCH]   = { .len = -1, .name = "REQ_PREFETCH" },
     [MIG_RP_MSG_MAX]            = { .len = -1, .name = "MAX" },
 };
 
@@ -2868,9 +3174,11 @@ static struct rp_cmd_args {
  * Process a request for pages received on the return path,
  * We're allowed to send more than requested (e.g. to round to our page size)
  * and we don't need to send pages that have already been sent.
+ * Prefetch requests are queued behind the pages faulted by the destination.
  */
 static void migrate_handle_rp_req_pages(MigrationState *ms, const char* rbname,
-                                       ram_addr_t start, size_t len)
+                                       ram_addr_t start, size_t len,
+                                       bool prefetch)
 {
     long our_host_ps = qemu_real_host_page_size();
 
@@ -2888,7 +3196,11 @@ static void migrate_handle_rp_req_pages(MigrationState *ms, const char* rbname,
         return;
     }
 
-    if (ram_save_queue_pages(rbname, start, len)) {
+    if (prefetch) {
+        if (ram_save_queue_prefetch(rbname, start, len)) {
+            mark_source_rp_bad(ms);
+        }
+    } else if (ram_save_queue_pages(rbname, start, len)) {
         mark_source_rp_bad(ms);
     }
 }
@@ -3054,10 +3366,11 @@ retry:
         case MIG_RP_MSG_REQ_PAGES:
             start = ldq_be_p(buf);
             len = ldl_be_p(buf + 8);
-            migrate_handle_rp_req_pages(ms, NULL, start, len);
+            migrate_handle_rp_req_pages(ms, NULL, start, len, false);
             break;
 
         case MIG_RP_MSG_REQ_PAGES_ID:
+        case MIG_RP_MSG_REQ_PREFETCH:
             expected_len = 12 + 1; /* header + termination */
 
             if (header_len >= expected_len) {
@@ -3074,7 +3387,8 @@ retry:
                 mark_source_rp_bad(ms);
                 goto out;
             }
-            migrate_handle_rp_req_pages(ms, (char *)&buf[13], start, len);
+            migrate_handle_rp_req_pages(ms, (char *)&buf[13], start, len,
+                                    header_type == MIG_RP_MSG_REQ_PREFETCH);
             break;
 
         case MIG_RP_MSG_RECV_BITMAP:
@@ -3815,6 +4129,49 @@ static void update_iteration_initial_status(MigrationState *s)
     s->iteration_initial_pages = ram_get_total_transferred_pages();
 }
 
+/*
+ * With dirty-limit, while the predicted downtime misses downtime-limit,
+ * cap the dirty rate of every vCPU to its share of the current rate,
+ * scaled down by the miss.  The vCPUs that dirty memory slower than
+ * their share are not throttled, so only the worst offenders slow down.
+ * The quota only ever decreases, once per dirty rate measurement.
+ */
+static void migration_dirty_limit_adjust(MigrationState *s,
+                                         int64_t current_time)
+{
+    uint64_t limit = s->parameters.downtime_limit;
+    uint64_t rate, quota;
+    Error *local_err = NULL;
+
+    if (!migrate_dirty_limit() || s->predicted_downtime <= limit ||
+        current_time < s->dirty_limit_time + DIRTYLIMIT_CALC_TIME_MS) {
+        return;
+    }
+
+    rate = ram_dirty_rate();
+    if (!rate) {
+        /* Nothing to throttle, the bandwidth is the problem */
+        return;
+    }
+    quota = (double)rate * limit / s->predicted_downtime /
+            current_machine->smp.cpus / MiB;
+    quota = MAX(quota, 1);
+    if (s->dirty_limit_quota && quota >= s->dirty_limit_quota) {
+        return;
+    }
+
+    trace_migration_dirty_limit(s->predicted_downtime, rate, quota);
+    qemu_mutex_lock_iothread();
+    qmp_set_vcpu_dirty_limit(false, -1, quota, &local_err);
+    qemu_mutex_unlock_iothread();
+    if (local_err) {
+        error_report_err(local_err);
+        return;
+    }
+    s->dirty_limit_quota = quota;
+    s->dirty_limit_time = current_time;
+}
+
 static void migration_update_counters(MigrationState *s,
                                       int64_t current_time)
 {
@@ -3831,6 +4188,7 @@ static void migration_update_counters(MigrationState *s,
     time_spent = current_time - s->iteration_start_time;
     bandwidth = (double)transferred / time_spent;
     s->threshold_size = bandwidth * s->parameters.downtime_limit;
+    s->bandwidth = bandwidth;
 
     s->mbps = (((double) transferred * 8.0) /
                ((double) time_spent / 1000.0)) / 1000.0 / 1000.0;
@@ -3854,6 +4212,8 @@ static void migration_update_counters(MigrationState *s,
 
     trace_migrate_transferred(transferred, time_spent,
                               bandwidth, s->threshold_size);
+
+    migration_dirty_limit_adjust(s, current_time);
 }
 
 /* Migration thread iteration status */
@@ -3869,7 +4229,7 @@ typedef enum {
  */
 static MigIterateState migration_iteration_run(MigrationState *s)
 {
-    uint64_t must_precopy, can_postcopy;
+    uint64_t must_precopy, can_postcopy, downtime_size;
     bool in_postcopy = s->state == MIGRATION_STATUS_POSTCOPY_ACTIVE;
 
     qemu_savevm_state_pending_estimate(&must_precopy, &can_postcopy);
@@ -3883,7 +4243,16 @@ static MigIterateState migration_iteration_run(MigrationState *s)
         trace_migrate_pending_exact(pending_size, must_precopy, can_postcopy);
     }
 
-    if (!pending_size || pending_size < s->threshold_size) {
+    /*
+     * The memory dirtied since the last bitmap sync is found by the final
+     * one, and has to be sent during downtime as well.
+     */
+    downtime_size = pending_size + ram_dirty_bytes_since_sync();
+    s->predicted_downtime = ram_predict_downtime(s->bandwidth, downtime_size,
+                                                 s->threshold_size);
+    trace_migrate_predicted_downtime(downtime_size, s->predicted_downtime);
+
+    if (!pending_size || downtime_size < s->threshold_size) {
         trace_migration_thread_low_pending(pending_size);
         migration_completion(s);
         return MIG_ITERATE_BREAK;
@@ -3909,6 +4278,11 @@ static void migration_iteration_finish(MigrationState *s)
     cpu_throttle_stop();
 
     qemu_mutex_lock_iothread();
+    /* Likewise for the vCPUs limited by dirty-limit */
+    if (s->dirty_limit_quota) {
+        qmp_cancel_vcpu_dirty_limit(false, -1, NULL);
+        s->dirty_limit_quota = 0;
+    }
     switch (s->state) {
     case MIGRATION_STATUS_COMPLETED:
         migration_calculate_complete(s);
@@ -4504,6 +4878,9 @@ static Property migration_properties[] = {
     DEFINE_PROP_UINT8("multifd-zstd-level", MigrationState,
                       parameters.multifd_zstd_level,
                       DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL),
+    DEFINE_PROP_UINT8("multifd-lz4-level", MigrationState,
+                      parameters.multifd_lz4_level,
+                      DEFAULT_MIGRATE_MULTIFD_LZ4_LEVEL),
     DEFINE_PROP_SIZE("xbzrle-cache-size", MigrationState,
                       parameters.xbzrle_cache_size,
                       DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE),
@@ -4528,6 +4905,7 @@ static Property migration_properties[] = {
     DEFINE_PROP_STRING("tls-creds", MigrationState, parameters.tls_creds),
     DEFINE_PROP_STRING("tls-hostname", MigrationState, parameters.tls_hostname),
     DEFINE_PROP_STRING("tls-authz", MigrationState, parameters.tls_authz),
+    DEFINE_PROP_BOOL("direct-io", MigrationState, parameters.direct_io, false),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -4550,6 +4928,19 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-zero-copy-send",
             MIGRATION_CAPABILITY_ZERO_COPY_SEND),
 #endif
+    DEFINE_PROP_MIG_CAP("x-multifd-zero-page",
+            MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-postcopy-prefetch",
+            MIGRATION_CAPABILITY_POSTCOPY_PREFETCH),
+    DEFINE_PROP_MIG_CAP("x-parallel-device-state",
+            MIGRATION_CAPABILITY_PARALLEL_DEVICE_STATE),
+    DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
+    DEFINE_PROP_MIG_CAP("x-page-dedup", MIGRATION_CAPABILITY_PAGE_DEDUP),
+    DEFINE_PROP_MIG_CAP("x-incremental-snapshot",
+                        MIGRATION_CAPABILITY_INCREMENTAL_SNAPSHOT),
+    DEFINE_PROP_MIG_CAP("x-ram-fd-passing",
+                        MIGRATION_CAPABILITY_RAM_FD_PASSING),
 
     DEFINE_PROP_END_OF_LIST(),
 };
@@ -4610,6 +5001,7 @@ static void migration_instance_init(Object *obj)
     params->has_multifd_compression = true;
     params->has_multifd_zlib_level = true;
     params->has_multifd_zstd_level = true;
+    params->has_multifd_lz4_level = true;
     params->has_xbzrle_cache_size = true;
     params->has_max_postcopy_bandwidth = true;
     params->has_max_cpu_throttle = true;
@@ -4617,6 +5009,7 @@ static void migration_instance_init(Object *obj)
     params->has_announce_max = true;
     params->has_announce_rounds = true;
     params->has_announce_step = true;
+    params->has_direct_io = true;
 
     qemu_sem_init(&ms->postcopy_pause_sem, 0);
     qemu_sem_init(&ms->postcopy_pause_rp_sem, 0);
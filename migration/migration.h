@@ -273,6 +273,12 @@ struct MigrationState {
      * measured bandwidth
      */
     int64_t threshold_size;
+    /* bandwidth measured over the last iteration, in bytes per ms */
+    double bandwidth;
+    /* dirty rate quota set on the vCPUs for dirty-limit (MB/s), or 0 */
+    uint64_t dirty_limit_quota;
+    /* time of the last change of dirty_limit_quota (ms) */
+    int64_t dirty_limit_time;
 
     /* params from 'migrate-set-parameters' */
     MigrationParameters parameters;
@@ -310,6 +316,8 @@ struct MigrationState {
     int64_t downtime_start;
     int64_t downtime;
     int64_t expected_downtime;
+    /* Downtime that iterating is predicted to reach (ms) */
+    int64_t predicted_downtime;
     bool enabled_capabilities[MIGRATION_CAPABILITY__MAX];
     int64_t setup_time;
     /*
@@ -458,11 +466,17 @@ bool migrate_validate_uuid(void);
 
 bool migrate_auto_converge(void);
 bool migrate_use_multifd(void);
+bool migrate_multifd_zero_page(void);
+bool migrate_multifd_xbzrle(void);
+bool migrate_mapped_ram(void);
+bool migrate_multifd_packets(void);
+bool migrate_direct_io(void);
 bool migrate_pause_before_switchover(void);
 int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
+int migrate_multifd_lz4_level(void);
 
 #ifdef CONFIG_LINUX
 bool migrate_use_zero_copy_send(void);
@@ -490,6 +504,12 @@ bool migrate_use_events(void);
 bool migrate_postcopy_blocktime(void);
 bool migrate_background_snapshot(void);
 bool migrate_postcopy_preempt(void);
+bool migrate_postcopy_prefetch(void);
+bool migrate_parallel_device_state(void);
+bool migrate_dirty_limit(void);
+bool migrate_page_dedup(void);
+bool migrate_incremental_snapshot(void);
+bool migrate_ram_fd_passing(void);
 
 /* Sending on the return path - generic and then for each message type */
 void migrate_send_rp_shut(MigrationIncomingState *mis,
@@ -500,6 +520,9 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
                               ram_addr_t start, uint64_t haddr);
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
                                       RAMBlock *rb, ram_addr_t start);
+int migrate_send_rp_message_req_prefetch(MigrationIncomingState *mis,
+                                         RAMBlock *rb, ram_addr_t start,
+                                         ram_addr_t len);
 void migrate_send_rp_recv_bitmap(MigrationIncomingState *mis,
                                  char *block_name);
 void migrate_send_rp_resume_ack(MigrationIncomingState *mis, uint32_t value);
@@ -0,0 +1,276 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include <lz4hc.h>
+#include "qemu/bswap.h"
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+
+/*
+ * Each page is compressed as an independent lz4 block, preceded by its
+ * compressed size as a big endian 32-bit value.  Blocks don't reference
+ * the previous pages, which the guest may have changed in the meantime.
+ */
+#define LZ4_PAGE_HDR_SIZE sizeof(uint32_t)
+
+struct lz4_data {
+    /* compression state, allocated once for the whole migration */
+    void *state;
+    /* lz4-hc level, or 0 for the fast compressor */
+    int level;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+};
+
+/* Room needed for the compressed pages of one packet */
+static uint32_t lz4_zbuff_len(uint32_t page_count, uint32_t page_size)
+{
+    return page_count * (LZ4_PAGE_HDR_SIZE + LZ4_COMPRESSBOUND(page_size));
+}
+
+/* Multifd lz4 compression */
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Allocate the compression state and the compressed buffer for the
+ * channel, so that nothing is allocated while sending pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->level = migrate_multifd_lz4_level();
+    z->state = g_try_malloc(z->level ? LZ4_sizeofStateHC()
+                                     : LZ4_sizeofState());
+    z->zbuff_len = lz4_zbuff_len(p->page_count, p->page_size);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->state || !z->zbuff) {
+        g_free(z->state);
+        g_free(z->zbuff);
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for lz4", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Return the memory of the channel.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->state);
+    z->state = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare date to be able to send
+ *
+ * Create a compressed buffer with all the pages that we are going to
+ * send.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+    uint32_t out_pos = 0;
+    uint32_t i;
+
+    /*
+     * Unlike zlib, the pages are compressed in place.  A page changing
+     * under the compressor yields a block that decodes to garbage of the
+     * right size, never a read out of bounds, and the page is dirty again
+     * so that the next iteration sends it anew.
+     */
+    for (i = 0; i < p->normal_num; i++) {
+        const char *src = (const char *)p->pages->block->host + p->normal[i];
+        char *dst = (char *)z->zbuff + out_pos + LZ4_PAGE_HDR_SIZE;
+        int avail = z->zbuff_len - out_pos - LZ4_PAGE_HDR_SIZE;
+        int ret;
+
+        if (z->level) {
+            ret = LZ4_compress_HC_extStateHC(z->state, src, dst, p->page_size,
+                                             avail, z->level);
+        } else {
+            ret = LZ4_compress_fast_extState(z->state, src, dst, p->page_size,
+                                             avail, 1);
+        }
+        if (ret <= 0) {
+            error_setg(errp, "multifd %u: lz4 compression failed", p->id);
+            return -1;
+        }
+        stl_be_p(z->zbuff + out_pos, ret);
+        out_pos += LZ4_PAGE_HDR_SIZE + ret;
+    }
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = out_pos;
+    p->iovs_num++;
+    p->next_packet_size = out_pos;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->zbuff_len = lz4_zbuff_len(p->page_count, p->page_size);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Return the memory of the channel.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct lz4_data *z = p->data;
+    uint32_t in_pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %u: packet size received %u "
+                   "maximum size expected %u", p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t len;
+
+        if (in_size - in_pos < LZ4_PAGE_HDR_SIZE) {
+            error_setg(errp, "multifd %u: missing data for page %d",
+                       p->id, i);
+            return -1;
+        }
+        len = ldl_be_p(z->zbuff + in_pos);
+        in_pos += LZ4_PAGE_HDR_SIZE;
+        if (len > in_size - in_pos) {
+            error_setg(errp, "multifd %u: compressed page %d of %u bytes "
+                       "overflows the packet", p->id, i, len);
+            return -1;
+        }
+
+        ret = LZ4_decompress_safe((const char *)z->zbuff + in_pos,
+                                  (char *)p->host + p->normal[i],
+                                  len, p->page_size);
+        if (ret != p->page_size) {
+            error_setg(errp, "multifd %u: lz4 decompression of page %d "
+                       "returned %d, expected %u", p->id, i, ret,
+                       p->page_size);
+            return -1;
+        }
+        in_pos += len;
+    }
+    if (in_pos != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size used %u",
+                   p->id, in_size, in_pos);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -0,0 +1,487 @@
+/*
+ * Multifd XBZRLE compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/cutils.h"
+#include "qemu/host-utils.h"
+#include "qemu/rcu.h"
+#include "qemu/stats64.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "ram.h"
+#include "migration.h"
+#include "page_cache.h"
+#include "xbzrle.h"
+#include "trace.h"
+#include "multifd.h"
+
+/*
+ * Each page of a packet starts with one of these, followed by the page
+ * itself for XBZRLE_PAGE_FULL, or by the big endian 16-bit size of the
+ * encoded delta and the delta for XBZRLE_PAGE_DELTA.
+ */
+#define XBZRLE_PAGE_FULL  0
+#define XBZRLE_PAGE_DELTA 1
+#define XBZRLE_PAGE_ZERO  2
+
+#define XBZRLE_PAGE_HDR_SIZE (1 + sizeof(uint16_t))
+
+/*
+ * The page cache is split in one shard per channel, each with its own
+ * lock.  Any channel may send any page, so a channel locks the shard
+ * of each page it encodes; pages are spread over the shards by a hash
+ * of their address, so that the channels seldom wait for each other.
+ *
+ * The destination applies a delta to whatever its copy of the page is,
+ * which is only right if that is what the cache holds on the source.
+ * A page is sent at most once between two multifd syncs, after which
+ * all channels have delivered it, so a delta never overtakes the page
+ * it was computed against.
+ */
+typedef struct {
+    QemuMutex lock;
+    PageCache *cache;
+} XBZRLEShard;
+
+static struct {
+    XBZRLEShard *shards;
+    unsigned int nr_shards;
+    /* number of channels set up, the last one to go frees the shards */
+    unsigned int users;
+    /* totals over all channels, see multifd_xbzrle_get_counters() */
+    Stat64 pages;
+    Stat64 cache_miss;
+    Stat64 overflow;
+    Stat64 bytes;
+} xbzrle_shared;
+
+struct xbzrle_data {
+    /* copy of the page being encoded, that the guest can't change */
+    uint8_t *page;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+    /* counters of this channel */
+    uint64_t pages;
+    uint64_t cache_miss;
+    uint64_t overflow;
+    uint64_t bytes;
+};
+
+static uint32_t xbzrle_zbuff_len(uint32_t page_count, uint32_t page_size)
+{
+    return page_count * (XBZRLE_PAGE_HDR_SIZE + page_size);
+}
+
+static XBZRLEShard *xbzrle_shard(ram_addr_t addr)
+{
+    uint64_t hash = (addr >> qemu_target_page_bits()) * 0x9e3779b97f4a7c15ULL;
+
+    return &xbzrle_shared.shards[(hash >> 32) % xbzrle_shared.nr_shards];
+}
+
+static int xbzrle_shards_init(Error **errp)
+{
+    unsigned int nr_shards = migrate_multifd_channels();
+    uint64_t shard_size;
+    unsigned int i;
+
+    /* PageCache wants a power of two number of pages */
+    shard_size = pow2floor(migrate_xbzrle_cache_size() / nr_shards);
+    shard_size = MAX(shard_size, qemu_target_page_size());
+
+    xbzrle_shared.shards = g_new0(XBZRLEShard, nr_shards);
+    xbzrle_shared.nr_shards = nr_shards;
+    for (i = 0; i < nr_shards; i++) {
+        XBZRLEShard *shard = &xbzrle_shared.shards[i];
+
+        shard->cache = cache_init(shard_size, qemu_target_page_size(), errp);
+        if (!shard->cache) {
+            while (i--) {
+                cache_fini(xbzrle_shared.shards[i].cache);
+                qemu_mutex_destroy(&xbzrle_shared.shards[i].lock);
+            }
+            g_free(xbzrle_shared.shards);
+            xbzrle_shared.shards = NULL;
+            return -1;
+        }
+        qemu_mutex_init(&shard->lock);
+    }
+
+    stat64_init(&xbzrle_shared.pages, 0);
+    stat64_init(&xbzrle_shared.cache_miss, 0);
+    stat64_init(&xbzrle_shared.overflow, 0);
+    stat64_init(&xbzrle_shared.bytes, 0);
+    trace_multifd_xbzrle_shards_init(nr_shards, shard_size);
+    return 0;
+}
+
+static void xbzrle_shards_cleanup(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < xbzrle_shared.nr_shards; i++) {
+        cache_fini(xbzrle_shared.shards[i].cache);
+        qemu_mutex_destroy(&xbzrle_shared.shards[i].lock);
+    }
+    g_free(xbzrle_shared.shards);
+    xbzrle_shared.shards = NULL;
+    xbzrle_shared.nr_shards = 0;
+}
+
+/**
+ * multifd_xbzrle_get_counters: totals of the sending channels
+ *
+ * Fill the page, byte, cache miss and overflow counters of @stats.  They
+ * keep their values from the last migration once the channels are gone.
+ *
+ * @stats: counters to fill
+ */
+void multifd_xbzrle_get_counters(XBZRLECacheStats *stats)
+{
+    stats->pages = stat64_get(&xbzrle_shared.pages);
+    stats->cache_miss = stat64_get(&xbzrle_shared.cache_miss);
+    stats->overflow = stat64_get(&xbzrle_shared.overflow);
+    stats->bytes = stat64_get(&xbzrle_shared.bytes);
+}
+
+/* Multifd XBZRLE compression */
+
+/**
+ * xbzrle_send_setup: setup send side
+ *
+ * Allocate the buffers of the channel, and with the first channel, the
+ * shards of the page cache.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z;
+
+    if (!xbzrle_shared.users && xbzrle_shards_init(errp) < 0) {
+        return -1;
+    }
+
+    z = g_new0(struct xbzrle_data, 1);
+    z->page = g_try_malloc(p->page_size);
+    z->zbuff_len = xbzrle_zbuff_len(p->page_count, p->page_size);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->page || !z->zbuff) {
+        g_free(z->page);
+        g_free(z->zbuff);
+        g_free(z);
+        if (!xbzrle_shared.users) {
+            xbzrle_shards_cleanup();
+        }
+        error_setg(errp, "multifd %u: out of memory for xbzrle", p->id);
+        return -1;
+    }
+    xbzrle_shared.users++;
+    p->data = z;
+    return 0;
+}
+
+/**
+ * xbzrle_send_cleanup: cleanup send side
+ *
+ * Return the memory of the channel, and with the last channel, the page
+ * cache.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->data;
+
+    /* Setup may have failed before reaching this channel */
+    if (!z) {
+        return;
+    }
+
+    trace_multifd_xbzrle_send_cleanup(p->id, z->pages, z->cache_miss,
+                                      z->overflow, z->bytes);
+    g_free(z->page);
+    z->page = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+
+    if (!--xbzrle_shared.users) {
+        xbzrle_shards_cleanup();
+    }
+}
+
+/*
+ * Encode the copy of the page at @addr in z->page into @dst, and update
+ * the cache so that it matches what the destination will have.
+ *
+ * Returns the number of bytes written to @dst
+ */
+static uint32_t xbzrle_encode_page(struct xbzrle_data *z, uint32_t page_size,
+                                   ram_addr_t addr, uint64_t age,
+                                   uint8_t *dst)
+{
+    XBZRLEShard *shard = xbzrle_shard(addr);
+    bool zero = buffer_is_zero(z->page, page_size);
+    uint8_t *cached;
+    int len;
+
+    qemu_mutex_lock(&shard->lock);
+
+    if (!cache_is_cached(shard->cache, addr, age)) {
+        z->cache_miss++;
+        /*
+         * Nothing is cached for the page, so sending it whole keeps the
+         * cache right even if it is not inserted.  As with XBZRLE on the
+         * main stream, don't fill the cache with the first round.
+         */
+        if (age > 1) {
+            cache_insert(shard->cache, addr, z->page, age);
+        }
+        qemu_mutex_unlock(&shard->lock);
+        goto send_whole;
+    }
+
+    z->pages++;
+    cached = get_cached_data(shard->cache, addr);
+    len = zero ? -1 : xbzrle_encode_buffer_func(cached, z->page, page_size,
+                                                dst + XBZRLE_PAGE_HDR_SIZE,
+                                                page_size);
+    memcpy(cached, z->page, page_size);
+    qemu_mutex_unlock(&shard->lock);
+
+    if (len >= 0) {
+        dst[0] = XBZRLE_PAGE_DELTA;
+        stw_be_p(dst + 1, len);
+        z->bytes += XBZRLE_PAGE_HDR_SIZE + len;
+        return XBZRLE_PAGE_HDR_SIZE + len;
+    }
+    if (!zero) {
+        z->overflow++;
+    }
+
+send_whole:
+    if (zero) {
+        dst[0] = XBZRLE_PAGE_ZERO;
+        z->bytes += 1;
+        return 1;
+    }
+    dst[0] = XBZRLE_PAGE_FULL;
+    memcpy(dst + 1, z->page, page_size);
+    z->bytes += 1 + page_size;
+    return 1 + page_size;
+}
+
+/**
+ * xbzrle_send_prepare: prepare date to be able to send
+ *
+ * Encode each page against its copy in the page cache, or send it
+ * whole if it is not cached or the delta would not be smaller.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->data;
+    RAMBlock *block = p->pages->block;
+    uint64_t pages = z->pages, cache_miss = z->cache_miss;
+    uint64_t overflow = z->overflow, bytes = z->bytes;
+    /*
+     * The generation only decides which pages stay cached; reading it
+     * while the migration thread updates it is harmless.
+     */
+    uint64_t age = ram_counters.dirty_sync_count;
+    uint32_t out_pos = 0;
+    uint32_t i;
+
+    for (i = 0; i < p->normal_num; i++) {
+        /* Work on a copy, so that the cache holds exactly what is sent */
+        memcpy(z->page, block->host + p->normal[i], p->page_size);
+        out_pos += xbzrle_encode_page(z, p->page_size,
+                                      block->offset + p->normal[i], age,
+                                      z->zbuff + out_pos);
+    }
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = out_pos;
+    p->iovs_num++;
+    p->next_packet_size = out_pos;
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+
+    stat64_add(&xbzrle_shared.pages, z->pages - pages);
+    stat64_add(&xbzrle_shared.cache_miss, z->cache_miss - cache_miss);
+    stat64_add(&xbzrle_shared.overflow, z->overflow - overflow);
+    stat64_add(&xbzrle_shared.bytes, z->bytes - bytes);
+    return 0;
+}
+
+/**
+ * xbzrle_recv_setup: setup receive side
+ *
+ * Create the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = g_new0(struct xbzrle_data, 1);
+
+    z->zbuff_len = xbzrle_zbuff_len(p->page_count, p->page_size);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * xbzrle_recv_cleanup: cleanup receive side
+ *
+ * Return the memory of the channel.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * xbzrle_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and apply each delta to the page that the
+ * destination already has.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct xbzrle_data *z = p->data;
+    uint32_t in_pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %u: packet size received %u "
+                   "maximum size expected %u", p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+        uint32_t len;
+
+        if (in_pos == in_size) {
+            error_setg(errp, "multifd %u: missing data for page %d",
+                       p->id, i);
+            return -1;
+        }
+
+        switch (z->zbuff[in_pos++]) {
+        case XBZRLE_PAGE_FULL:
+            len = p->page_size;
+            if (len > in_size - in_pos) {
+                error_setg(errp, "multifd %u: page %d overflows the packet",
+                           p->id, i);
+                return -1;
+            }
+            memcpy(page, z->zbuff + in_pos, len);
+            break;
+        case XBZRLE_PAGE_DELTA:
+            if (in_size - in_pos < sizeof(uint16_t)) {
+                error_setg(errp, "multifd %u: missing data for page %d",
+                           p->id, i);
+                return -1;
+            }
+            len = lduw_be_p(z->zbuff + in_pos);
+            in_pos += sizeof(uint16_t);
+            if (len > in_size - in_pos) {
+                error_setg(errp, "multifd %u: delta of page %d of %u bytes "
+                           "overflows the packet", p->id, i, len);
+                return -1;
+            }
+            if (len &&
+                xbzrle_decode_buffer(z->zbuff + in_pos, len, page,
+                                     p->page_size) < 0) {
+                error_setg(errp, "multifd %u: failed to decode page %d",
+                           p->id, i);
+                return -1;
+            }
+            break;
+        case XBZRLE_PAGE_ZERO:
+            len = 0;
+            if (!buffer_is_zero(page, p->page_size)) {
+                memset(page, 0, p->page_size);
+            }
+            break;
+        default:
+            error_setg(errp, "multifd %u: unknown encoding 0x%x of page %d",
+                       p->id, z->zbuff[in_pos - 1], i);
+            return -1;
+        }
+        in_pos += len;
+    }
+    if (in_pos != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size used %u",
+                   p->id, in_size, in_pos);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = xbzrle_send_setup,
+    .send_cleanup = xbzrle_send_cleanup,
+    .send_prepare = xbzrle_send_prepare,
+    .recv_setup = xbzrle_recv_setup,
+    .recv_cleanup = xbzrle_recv_cleanup,
+    .recv_pages = xbzrle_recv_pages
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
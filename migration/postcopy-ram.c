@@ -18,6 +18,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/madvise.h"
+#include "qemu/units.h"
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
@@ -734,6 +735,125 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
     return migrate_send_rp_req_pages(mis, rb, start, haddr);
 }
 
+/*
+ * Bound on the pages prefetched ahead of a stream of faults, and on the
+ * distance between two faults of a stream, in host pages.
+ */
+#define POSTCOPY_PREFETCH_MAX_BYTES   (4 * MiB)
+#define POSTCOPY_PREFETCH_MAX_STRIDE  64
+
+/* Fault pattern of a RAMBlock, as seen by the fault thread */
+typedef struct PostcopyFaultStream {
+    /* Offset of the last fault */
+    ram_addr_t last;
+    /* Distance between the last two faults, 0 when they are unrelated */
+    int64_t stride;
+    /* Number of strides requested past @last */
+    unsigned ahead;
+    /* Number of strides to request past the next fault */
+    unsigned window;
+} PostcopyFaultStream;
+
+/* Ask for the pages at @first, @first + @stride, ... that are missing */
+static void postcopy_prefetch_pages(MigrationIncomingState *mis, RAMBlock *rb,
+                                    int64_t first, int64_t stride,
+                                    unsigned count)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t run_start = 0, run_len = 0;
+    int64_t addr = first;
+    unsigned i;
+
+    for (i = 0; i < count; i++, addr += stride) {
+        if (addr < 0 || addr >= rb->used_length) {
+            break;
+        }
+        if (ramblock_recv_bitmap_test_byte_offset(rb, addr) ||
+            ramblock_page_is_discarded(rb, addr)) {
+            continue;
+        }
+        /* Merge neighbouring pages, in either direction, into one request */
+        if (run_len && addr == run_start + run_len) {
+            run_len += pagesize;
+            continue;
+        }
+        if (run_len && addr + pagesize == run_start) {
+            run_start = addr;
+            run_len += pagesize;
+            continue;
+        }
+        if (run_len) {
+            trace_postcopy_prefetch(qemu_ram_get_idstr(rb), run_start,
+                                    run_len, stride);
+            migrate_send_rp_message_req_prefetch(mis, rb, run_start, run_len);
+        }
+        run_start = addr;
+        run_len = pagesize;
+    }
+    if (run_len) {
+        trace_postcopy_prefetch(qemu_ram_get_idstr(rb), run_start, run_len,
+                                stride);
+        migrate_send_rp_message_req_prefetch(mis, rb, run_start, run_len);
+    }
+}
+
+/*
+ * Called by the fault thread after requesting the page at @offset of @rb.
+ *
+ * A fault one stride away from the previous one, or anywhere up to the
+ * first page not prefetched yet along the stride (the pages in between
+ * arrived in time and did not fault), continues the stream and doubles the
+ * prefetch window.  Any other fault restarts the detection.  Prefetching
+ * is best effort: failures to send are left to the page requests to
+ * notice.
+ */
+static void postcopy_prefetch(MigrationIncomingState *mis,
+                              GHashTable *streams, RAMBlock *rb,
+                              ram_addr_t offset)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    unsigned max_window = POSTCOPY_PREFETCH_MAX_BYTES / pagesize;
+    PostcopyFaultStream *s;
+    int64_t delta, steps;
+
+    if (!max_window) {
+        /* Huge pages too large to be fetched speculatively */
+        return;
+    }
+
+    s = g_hash_table_lookup(streams, rb);
+    if (!s) {
+        s = g_new0(PostcopyFaultStream, 1);
+        s->last = offset;
+        g_hash_table_insert(streams, rb, s);
+        return;
+    }
+
+    delta = (int64_t)offset - (int64_t)s->last;
+    steps = s->stride ? delta / s->stride : 0;
+    if (!s->stride || delta % s->stride || steps < 1 || steps > s->ahead + 1) {
+        /* Not in the stream; the next fault tells if this starts a new one */
+        if (delta && ABS(delta) <= POSTCOPY_PREFETCH_MAX_STRIDE * pagesize) {
+            s->stride = delta;
+        } else {
+            s->stride = 0;
+        }
+        s->last = offset;
+        s->ahead = 0;
+        s->window = 0;
+        return;
+    }
+
+    s->last = offset;
+    s->ahead = steps > s->ahead ? 0 : s->ahead - steps;
+    s->window = s->window ? MIN(s->window * 2, max_window) : 1;
+    if (s->ahead < s->window) {
+        postcopy_prefetch_pages(mis, rb, offset + (s->ahead + 1) * s->stride,
+                                s->stride, s->window - s->ahead);
+        s->ahead = s->window;
+    }
+}
+
 /*
  * Callback from shared fault handlers to ask for a page,
  * the page must be specified by a RAMBlock and an offset in that rb
@@ -927,6 +1047,12 @@ static void *postcopy_ram_fault_thread(void *opaque)
 
     struct pollfd *pfd;
     size_t pfd_len = 2 + mis->postcopy_remote_fds->len;
+    /* PostcopyFaultStream of each RAMBlock, when prefetching */
+    GHashTable *streams = NULL;
+
+    if (migrate_postcopy_prefetch()) {
+        streams = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    }
 
     pfd = g_new0(struct pollfd, pfd_len);
 
@@ -1043,6 +1169,9 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+            if (streams) {
+                postcopy_prefetch(mis, streams, rb, rb_offset);
+            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1103,6 +1232,9 @@ retry:
     }
     rcu_unregister_thread();
     trace_postcopy_ram_fault_thread_exit();
+    if (streams) {
+        g_hash_table_destroy(streams);
+    }
     g_free(pfd);
     return NULL;
 }
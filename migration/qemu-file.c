@@ -34,6 +34,11 @@
 #define IO_BUF_SIZE 32768
 #define MAX_IOV_SIZE MIN_CONST(IOV_MAX, 64)
 
+typedef struct FdEntry {
+    QTAILQ_ENTRY(FdEntry) entry;
+    int fd;
+} FdEntry;
+
 struct QEMUFile {
     const QEMUFileHooks *hooks;
     QIOChannel *ioc;
@@ -65,6 +70,14 @@ struct QEMUFile {
     Error *last_error_obj;
     /* has the file has been shutdown */
     bool shutdown;
+
+    /* the channel can carry file descriptors along with the data */
+    bool can_pass_fd;
+    /* keep the file descriptors that come with the data read */
+    bool recv_fds;
+    /* file descriptors received and not claimed by qemu_file_get_fd() */
+    QTAILQ_HEAD(, FdEntry) fds;
+    size_t nb_fds;
 };
 
 /*
@@ -136,6 +149,8 @@ static QEMUFile *qemu_file_new_impl(QIOChannel *ioc, bool is_writable)
     object_ref(ioc);
     f->ioc = ioc;
     f->is_writable = is_writable;
+    f->can_pass_fd = qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_FD_PASS);
+    QTAILQ_INIT(&f->fds);
 
     return f;
 }
@@ -164,6 +179,19 @@ void qemu_file_set_hooks(QEMUFile *f, const QEMUFileHooks *hooks)
     f->hooks = hooks;
 }
 
+/* Close the file descriptors received and not claimed */
+static void qemu_file_close_fds(QEMUFile *f)
+{
+    while (!QTAILQ_EMPTY(&f->fds)) {
+        FdEntry *fde = QTAILQ_FIRST(&f->fds);
+
+        QTAILQ_REMOVE(&f->fds, fde, entry);
+        close(fde->fd);
+        g_free(fde);
+    }
+    f->nb_fds = 0;
+}
+
 /*
  * Get last error for stream f with optional Error*
  *
@@ -397,6 +425,9 @@ static ssize_t qemu_fill_buffer(QEMUFile *f)
     int len;
     int pending;
     Error *local_error = NULL;
+    g_autofree int *fds = NULL;
+    size_t nfds = 0;
+    size_t i;
 
     assert(!qemu_file_is_writable(f));
 
@@ -412,10 +443,15 @@ static ssize_t qemu_fill_buffer(QEMUFile *f)
     }
 
     do {
-        len = qio_channel_read(f->ioc,
-                               (char *)f->buf + pending,
-                               IO_BUF_SIZE - pending,
-                               &local_error);
+        struct iovec iov = {
+            .iov_base = f->buf + pending,
+            .iov_len = IO_BUF_SIZE - pending,
+        };
+
+        len = qio_channel_readv_full(f->ioc, &iov, 1,
+                                     f->recv_fds ? &fds : NULL,
+                                     f->recv_fds ? &nfds : NULL,
+                                     0, &local_error);
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             if (qemu_in_coroutine()) {
                 qio_channel_yield(f->ioc, G_IO_IN);
@@ -427,6 +463,29 @@ static ssize_t qemu_fill_buffer(QEMUFile *f)
         }
     } while (len == QIO_CHANNEL_ERR_BLOCK);
 
+    /*
+     * The data read ahead may carry descriptors meant for later calls to
+     * qemu_file_get_fd(); keep them in order.  Each one comes alone with
+     * its dummy byte, which stays in the buffer until it is claimed, so
+     * there can't be more pending than bytes left to read.
+     */
+    if (nfds > 1 || f->nb_fds + nfds > pending + MAX(len, 0)) {
+        for (i = 0; i < nfds; i++) {
+            close(fds[i]);
+        }
+        error_setg(&local_error, "Channel %s passed unexpected file "
+                   "descriptors", f->ioc->name);
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -EINVAL;
+    }
+    for (i = 0; i < nfds; i++) {
+        FdEntry *fde = g_new0(FdEntry, 1);
+
+        fde->fd = fds[i];
+        QTAILQ_INSERT_TAIL(&f->fds, fde, entry);
+        f->nb_fds++;
+    }
+
     if (len > 0) {
         f->buf_size += len;
         f->total_transferred += len;
@@ -464,6 +523,8 @@ int qemu_fclose(QEMUFile *f)
     }
     g_clear_pointer(&f->ioc, object_unref);
 
+    qemu_file_close_fds(f);
+
     /* If any error was spotted before closing, we should report it
      * instead of the close() return value.
      */
@@ -941,6 +1002,124 @@ QIOChannel *qemu_file_get_ioc(QEMUFile *file)
     return file->ioc;
 }
 
+/*
+ * qemu_file_can_pass_fd:
+ *
+ * Whether qemu_file_put_fd() and qemu_file_get_fd() work on @f, which
+ * requires a UNIX domain socket.
+ */
+bool qemu_file_can_pass_fd(QEMUFile *f)
+{
+    return f->can_pass_fd;
+}
+
+/*
+ * qemu_file_set_fd_passing:
+ *
+ * Start or stop keeping the file descriptors that come with the data
+ * read from @f, for qemu_file_get_fd().  Otherwise, the kernel closes
+ * them as they arrive.
+ *
+ * Returns: 0 on success, or -EINVAL if some descriptors received were
+ * not claimed when stopping, in which case the error of @f is set too.
+ */
+int qemu_file_set_fd_passing(QEMUFile *f, bool enable)
+{
+    Error *local_error = NULL;
+
+    assert(!qemu_file_is_writable(f));
+    assert(!enable || f->can_pass_fd);
+
+    f->recv_fds = enable;
+    if (!enable && f->nb_fds) {
+        qemu_file_close_fds(f);
+        error_setg(&local_error, "Channel %s passed unexpected file "
+                   "descriptors", f->ioc->name);
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/*
+ * qemu_file_put_fd:
+ *
+ * Send @fd to the other side, in order with the data written so far.
+ * The descriptor travels with a dummy byte, which qemu_file_get_fd()
+ * consumes on the other side.
+ *
+ * Returns: 0 on success, or a negative value on error, in which case
+ * the error of @f is set too.
+ */
+int qemu_file_put_fd(QEMUFile *f, int fd)
+{
+    struct iovec iov = { .iov_base = (void *)"", .iov_len = 1 };
+    Error *local_error = NULL;
+    int ret;
+
+    assert(qemu_file_is_writable(f));
+
+    if (!f->can_pass_fd) {
+        error_setg(&local_error, "Channel %s cannot pass file descriptors",
+                   f->ioc->name);
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -EINVAL;
+    }
+
+    qemu_fflush(f);
+    ret = qemu_file_get_error(f);
+    if (ret) {
+        return ret;
+    }
+    if (qio_channel_writev_full_all(f->ioc, &iov, 1, &fd, 1, 0,
+                                    &local_error) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_error);
+        return -EIO;
+    }
+    f->total_transferred += iov.iov_len;
+    trace_qemu_file_put_fd(f->ioc->name, fd);
+    return 0;
+}
+
+/*
+ * qemu_file_get_fd:
+ *
+ * Receive the next file descriptor sent with qemu_file_put_fd(), which
+ * is then owned by the caller.
+ *
+ * Returns: the file descriptor, or a negative value on error, in which
+ * case the error of @f is set too.
+ */
+int qemu_file_get_fd(QEMUFile *f)
+{
+    Error *local_error = NULL;
+    FdEntry *fde;
+    int fd;
+
+    assert(!qemu_file_is_writable(f));
+
+    /* Reading the dummy byte brings in its descriptor, if not already */
+    qemu_get_byte(f);
+    if (qemu_file_get_error(f)) {
+        return -EIO;
+    }
+
+    fde = QTAILQ_FIRST(&f->fds);
+    if (!fde) {
+        error_setg(&local_error, "Channel %s did not pass a file descriptor",
+                   f->ioc->name);
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -EINVAL;
+    }
+    QTAILQ_REMOVE(&f->fds, fde, entry);
+    f->nb_fds--;
+    fd = fde->fd;
+    g_free(fde);
+
+    trace_qemu_file_get_fd(f->ioc->name, fd);
+    return fd;
+}
+
 /*
  * Read size bytes from QEMUFile f and write them to fd.
  */
@@ -974,3 +1153,87 @@ int qemu_file_get_to_fd(QEMUFile *f, int fd, size_t size)
 
     return 0;
 }
+
+/*
+ * Return the position in the file backing @f that the next byte will be
+ * written to or read from, taking buffered data into account.
+ */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    Error *local_err = NULL;
+    off_t pos;
+
+    qemu_fflush(f);
+    pos = qio_channel_io_seek(f->ioc, 0, SEEK_CUR, &local_err);
+    if (pos < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+        return -1;
+    }
+    if (!qemu_file_is_writable(f)) {
+        pos -= f->buf_size - f->buf_index;
+    }
+    return pos;
+}
+
+void qemu_set_offset(QEMUFile *f, off_t off, int whence)
+{
+    Error *local_err = NULL;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        if (whence == SEEK_CUR) {
+            off -= f->buf_size - f->buf_index;
+        }
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    if (qio_channel_io_seek(f->ioc, off, whence, &local_err) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+    }
+}
+
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        off_t pos)
+{
+    Error *local_err = NULL;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return;
+    }
+
+    ret = qio_channel_pwrite(f->ioc, (char *)buf, buflen, pos, &local_err);
+    if (ret >= 0 && ret != buflen) {
+        error_setg(&local_err, "Partial write of %zd bytes, expected %zu",
+                   ret, buflen);
+    }
+    if (local_err) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+        return;
+    }
+    f->total_transferred += buflen;
+}
+
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen,
+                          off_t pos)
+{
+    Error *local_err = NULL;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return 0;
+    }
+
+    ret = qio_channel_pread(f->ioc, (char *)buf, buflen, pos, &local_err);
+    if (ret >= 0 && ret != buflen) {
+        error_setg(&local_err, "Partial read of %zd bytes, expected %zu",
+                   ret, buflen);
+    }
+    if (local_err) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+        return 0;
+    }
+    return buflen;
+}
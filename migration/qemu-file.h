@@ -168,5 +168,21 @@ size_t ram_control_save_page(QEMUFile *f, ram_addr_t block_offset,
                              ram_addr_t offset, size_t size,
                              uint64_t *bytes_sent);
 QIOChannel *qemu_file_get_ioc(QEMUFile *file);
+bool qemu_file_can_pass_fd(QEMUFile *f);
+int qemu_file_set_fd_passing(QEMUFile *f, bool enable);
+int qemu_file_put_fd(QEMUFile *f, int fd);
+int qemu_file_get_fd(QEMUFile *f);
+
+/*
+ * Random access to the file backing a QEMUFile, which must be a
+ * seekable channel.  The *_at() variants neither use nor move the
+ * current position of @f.
+ */
+off_t qemu_get_offset(QEMUFile *f);
+void qemu_set_offset(QEMUFile *f, off_t off, int whence);
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        off_t pos);
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen,
+                          off_t pos);
 
 #endif
@@ -32,6 +32,8 @@
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
+#include "qemu/xxhash.h"
 #include "io/channel-null.h"
 #include "xbzrle.h"
 #include "ram.h"
@@ -56,6 +58,7 @@
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "file.h"
 #include "sysemu/runstate.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
@@ -85,8 +88,44 @@
 #define RAM_SAVE_FLAG_XBZRLE   0x40
 /* 0x80 is reserved in qemu-file.h for RAM_SAVE_FLAG_HOOK */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
+#define RAM_SAVE_FLAG_DEDUP    0x200
 /* We can't use any flag that is bigger than 0x200 */
 
+/*
+ * page-dedup: a direct-mapped index from the hash of a page sent in full
+ * to the first page sent with those contents.  An entry is only used
+ * while RAMBlock.dedup_hash says that the page it points to still holds
+ * those contents on the destination.
+ */
+typedef struct {
+    uint64_t hash;
+    RAMBlock *block;
+    ram_addr_t offset;
+} DedupEntry;
+
+/* Guest pages per index slot */
+#define DEDUP_INDEX_PAGES_PER_SLOT 4
+#define DEDUP_INDEX_MIN_SLOTS 1024
+
+/*
+ * mapped-ram migration file layout: each RAMBlock in the stream is
+ * followed by a MappedRamHeader, then by the bitmap of the pages present
+ * in the file and, at an aligned offset, the pages themselves.
+ */
+#define MAPPED_RAM_HDR_VERSION 1
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT (1 * MiB)
+
+/* Pages handed to each mapped-ram loader thread at a time */
+#define MAPPED_RAM_LOAD_CHUNK_PAGES 1024
+
+typedef struct {
+    uint32_t version;
+    /* The target page size used to index the bitmap and pages */
+    uint64_t page_size;
+    uint64_t bitmap_offset;
+    uint64_t pages_offset;
+} QEMU_PACKED MappedRamHeader;
+
 int (*xbzrle_encode_buffer_func)(uint8_t *, uint8_t *, int,
      uint8_t *, int) = xbzrle_encode_buffer;
 #if defined(CONFIG_AVX512BW_OPT)
@@ -219,10 +258,21 @@ static bool postcopy_preempt_active(void)
     return migrate_postcopy_preempt() && migration_in_postcopy();
 }
 
+/*
+ * With ram-fd-passing, the destination maps the memory of the blocks
+ * backed by shared memory instead of receiving their pages.
+ */
+static bool ramblock_is_fd_passed(RAMBlock *block)
+{
+    return migrate_ram_fd_passing() && qemu_ram_is_shared(block) &&
+           qemu_ram_get_fd(block) >= 0;
+}
+
 bool ramblock_is_ignored(RAMBlock *block)
 {
     return !qemu_ram_is_migratable(block) ||
-           (migrate_ignore_shared() && qemu_ram_is_shared(block));
+           (migrate_ignore_shared() && qemu_ram_is_shared(block)) ||
+           ramblock_is_fd_passed(block);
 }
 
 #undef RAMBLOCK_FOREACH
@@ -375,6 +425,8 @@ struct RAMState {
     /* these variables are used for bitmap sync */
     /* last time we did a full bitmap_sync */
     int64_t time_last_bitmap_sync;
+    /* end of the last bitmap sync, unlike the above updated on every sync */
+    int64_t time_last_sync;
     /* bytes transferred at start_time */
     uint64_t bytes_xfer_prev;
     /* number of dirty pages since start_time */
@@ -415,6 +467,16 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
+    /*
+     * Pages the destination expects to fault on soon, served after
+     * src_page_requests; also protected by src_page_req_mutex
+     */
+    QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_prefetch_requests;
+    /* page-dedup index, NULL if disabled, and its number of slots - 1 */
+    DedupEntry *dedup_index;
+    uint64_t dedup_index_mask;
+    /* Copy of the page being sent, hashed and sent as one */
+    uint8_t *dedup_buf;
 };
 typedef struct RAMState RAMState;
 
@@ -428,6 +490,15 @@ static bool postcopy_has_request(RAMState *rs)
     return !QSIMPLEQ_EMPTY_ATOMIC(&rs->src_page_requests);
 }
 
+/*
+ * Whether postcopy has queued prefetch requests?  Unlike page requests,
+ * these don't bypass the rate limit.
+ */
+static bool postcopy_has_prefetch(RAMState *rs)
+{
+    return !QSIMPLEQ_EMPTY_ATOMIC(&rs->src_prefetch_requests);
+}
+
 void precopy_infrastructure_init(void)
 {
     notifier_with_return_list_init(&precopy_notifier_list);
@@ -1105,6 +1176,7 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 
     rs->migration_dirty_pages += new_dirty_pages;
     rs->num_dirty_pages_period += new_dirty_pages;
+    rb->dirty_pages_period += new_dirty_pages;
 }
 
 /**
@@ -1132,6 +1204,7 @@ uint64_t ram_get_total_transferred_pages(void)
 {
     return  stat64_get(&ram_atomic_counters.normal) +
         stat64_get(&ram_atomic_counters.duplicate) +
+        stat64_get(&ram_atomic_counters.dedup) +
         compression_counters.pages + xbzrle_counters.pages;
 }
 
@@ -1148,7 +1221,10 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
         return;
     }
 
-    if (migrate_use_xbzrle()) {
+    if (migrate_multifd_xbzrle()) {
+        multifd_xbzrle_get_counters(&xbzrle_counters);
+    }
+    if (migrate_use_xbzrle() || migrate_multifd_xbzrle()) {
         double encoded_size, unencoded_size;
 
         xbzrle_counters.cache_miss_rate = (double)(xbzrle_counters.cache_miss -
@@ -1187,6 +1263,120 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
     }
 }
 
+/*
+ * Average the dirty rate of each RAMBlock with its previous value, so
+ * that a single burst doesn't throw the downtime predictions off.
+ */
+static void migration_update_block_rates(RAMState *rs, int64_t end_time)
+{
+    int64_t period = end_time - rs->time_last_bitmap_sync;
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        uint64_t rate = block->dirty_pages_period * TARGET_PAGE_SIZE * 1000 /
+                        period;
+
+        block->dirty_rate = block->dirty_rate ? (block->dirty_rate + rate) / 2
+                                              : rate;
+        block->dirty_pages_period = 0;
+    }
+}
+
+/* Bytes the guest is expected to dirty in @ms milliseconds */
+static uint64_t ram_bytes_dirtied_in(double ms)
+{
+    uint64_t bytes = 0;
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        /* Rewriting a page doesn't make it any dirtier */
+        bytes += MIN((uint64_t)(block->dirty_rate * ms / 1000),
+                     block->used_length);
+    }
+    return bytes;
+}
+
+/**
+ * ram_dirty_bytes_since_sync: estimate the RAM dirtied since the last
+ * bitmap sync
+ *
+ * It isn't accounted in the pending size yet, but the final sync will
+ * find it and it will have to be sent during downtime.  Nothing is
+ * dirtied while the source is stopped, and in postcopy, where there are
+ * no more syncs, the destination runs the guest instead.
+ */
+uint64_t ram_dirty_bytes_since_sync(void)
+{
+    RAMState *rs = ram_state;
+
+    if (!rs || !rs->time_last_sync) {
+        return 0;
+    }
+    if (migration_in_postcopy() || !runstate_is_running()) {
+        return 0;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    return ram_bytes_dirtied_in(qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
+                                rs->time_last_sync);
+}
+
+/**
+ * ram_dirty_rate: get the rate at which the guest dirties its RAM, in
+ * bytes per second
+ */
+uint64_t ram_dirty_rate(void)
+{
+    uint64_t rate = 0;
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        rate += block->dirty_rate;
+    }
+    return rate;
+}
+
+/* The prediction stops there, even if iterating could still help */
+#define RAM_PREDICT_MAX_ROUNDS 16
+
+/**
+ * ram_predict_downtime: predict the downtime iterating can bring the
+ * migration down to
+ *
+ * While the pending data is sent, the guest dirties memory again, at the
+ * rate of each RAMBlock but never more than its size.  Iterations shrink
+ * the pending data to what is dirtied in the time it takes to send it,
+ * until this stops shrinking it or it fits in @threshold.
+ *
+ * Returns the time to send that amount, in milliseconds
+ *
+ * @bandwidth: measured bandwidth, in bytes per millisecond
+ * @pending: data left to send now
+ * @threshold: data that can be sent within the downtime limit
+ */
+uint64_t ram_predict_downtime(double bandwidth, uint64_t pending,
+                              uint64_t threshold)
+{
+    int i;
+
+    if (bandwidth <= 0) {
+        return 0;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < RAM_PREDICT_MAX_ROUNDS && pending > threshold; i++) {
+        uint64_t next = ram_bytes_dirtied_in(pending / bandwidth);
+
+        if (next >= pending) {
+            break;
+        }
+        pending = next;
+    }
+    return pending / bandwidth;
+}
+
 static void migration_trigger_throttle(RAMState *rs)
 {
     MigrationState *s = migrate_get_current();
@@ -1243,12 +1433,14 @@ static void migration_bitmap_sync(RAMState *rs)
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    rs->time_last_sync = end_time;
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
         migration_trigger_throttle(rs);
 
         migration_update_rates(rs, end_time);
+        migration_update_block_rates(rs, end_time);
 
         rs->target_page_count_prev = rs->target_page_count;
 
@@ -1328,7 +1520,19 @@ static int save_zero_page_to_file(PageSearchStatus *pss, QEMUFile *file,
 static int save_zero_page(PageSearchStatus *pss, QEMUFile *f, RAMBlock *block,
                           ram_addr_t offset)
 {
-    int len = save_zero_page_to_file(pss, f, block, offset);
+    int len;
+
+    if (migrate_mapped_ram()) {
+        if (!buffer_is_zero(block->host + offset, TARGET_PAGE_SIZE)) {
+            return -1;
+        }
+        /* The destination RAM is zero already; don't load a stale copy */
+        clear_bit_atomic(offset >> TARGET_PAGE_BITS, block->file_bmap);
+        stat64_add(&ram_atomic_counters.duplicate, 1);
+        return 1;
+    }
+
+    len = save_zero_page_to_file(pss, f, block, offset);
 
     if (len) {
         stat64_add(&ram_atomic_counters.duplicate, 1);
@@ -1392,6 +1596,15 @@ static int save_normal_page(PageSearchStatus *pss, RAMBlock *block,
 {
     QEMUFile *file = pss->pss_channel;
 
+    if (migrate_mapped_ram()) {
+        qemu_put_buffer_at(file, buf, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset);
+        set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
+        ram_transferred_add(TARGET_PAGE_SIZE);
+        stat64_add(&ram_atomic_counters.normal, 1);
+        return 1;
+    }
+
     ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
                                          offset | RAM_SAVE_FLAG_PAGE));
     if (async) {
@@ -1406,6 +1619,93 @@ static int save_normal_page(PageSearchStatus *pss, RAMBlock *block,
     return 1;
 }
 
+/* xxhash64 of a target page, never 0 so that 0 can mean "unknown" */
+static uint64_t dedup_page_hash(const uint8_t *p)
+{
+    uint64_t v1 = QEMU_XXHASH_SEED + XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = QEMU_XXHASH_SEED + XXH_PRIME64_2;
+    uint64_t v3 = QEMU_XXHASH_SEED + 0;
+    uint64_t v4 = QEMU_XXHASH_SEED - XXH_PRIME64_1;
+    uint64_t h64;
+    size_t i;
+
+    for (i = 0; i < TARGET_PAGE_SIZE; i += 32) {
+        v1 = XXH64_round(v1, ldq_he_p(p + i));
+        v2 = XXH64_round(v2, ldq_he_p(p + i + 8));
+        v3 = XXH64_round(v3, ldq_he_p(p + i + 16));
+        v4 = XXH64_round(v4, ldq_he_p(p + i + 24));
+    }
+    h64 = XXH64_mergerounds(v1, v2, v3, v4) + TARGET_PAGE_SIZE;
+
+    return XXH64_avalanche(h64) ?: 1;
+}
+
+static bool dedup_entry_valid(DedupEntry *e)
+{
+    return e->block &&
+           e->block->dedup_hash[e->offset >> TARGET_PAGE_BITS] == e->hash;
+}
+
+/**
+ * save_dedup_page: send a page, or a reference to an identical page
+ *
+ * The page is copied first, so that the hash recorded for it is the one
+ * of the contents the destination gets even if the guest writes to it
+ * meanwhile.  A reference is only sent when the indexed page holds the
+ * same contents on the destination, per its recorded hash, and on the
+ * source, byte for byte.
+ *
+ * Returns the number of pages written.
+ *
+ * @rs: current RAM state
+ * @pss: current PSS channel
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int save_dedup_page(RAMState *rs, PageSearchStatus *pss,
+                           RAMBlock *block, ram_addr_t offset)
+{
+    QEMUFile *file = pss->pss_channel;
+    uint8_t *buf = rs->dedup_buf;
+    uint64_t hash;
+    DedupEntry *e;
+    size_t len;
+
+    memcpy(buf, block->host + offset, TARGET_PAGE_SIZE);
+    hash = dedup_page_hash(buf);
+    e = &rs->dedup_index[hash & rs->dedup_index_mask];
+
+    if (!dedup_entry_valid(e)) {
+        e->hash = hash;
+        e->block = block;
+        e->offset = offset;
+    } else if (e->hash == hash &&
+               !memcmp(buf, e->block->host + e->offset, TARGET_PAGE_SIZE)) {
+        trace_ram_save_dedup_page(block->idstr, offset, e->block->idstr,
+                                  e->offset);
+        len = save_page_header(pss, file, block,
+                               offset | RAM_SAVE_FLAG_DEDUP);
+        if (e->block == block) {
+            qemu_put_be64(file, e->offset | RAM_SAVE_FLAG_CONTINUE);
+            len += 8;
+        } else {
+            qemu_put_be64(file, e->offset);
+            qemu_put_byte(file, strlen(e->block->idstr));
+            qemu_put_buffer(file, (uint8_t *)e->block->idstr,
+                            strlen(e->block->idstr));
+            len += 9 + strlen(e->block->idstr);
+        }
+        ram_transferred_add(len);
+        stat64_add(&ram_atomic_counters.dedup, 1);
+        block->dedup_hash[offset >> TARGET_PAGE_BITS] = hash;
+        return 1;
+    }
+
+    save_normal_page(pss, block, offset, buf, false);
+    block->dedup_hash[offset >> TARGET_PAGE_BITS] = hash;
+    return 1;
+}
+
 /**
  * ram_save_page: send the given page to the stream
  *
@@ -1430,6 +1730,10 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
     p = block->host + offset;
     trace_ram_save_page(block->idstr, (uint64_t)offset, p);
 
+    if (rs->dedup_index && !migration_in_postcopy()) {
+        return save_dedup_page(rs, pss, block, offset);
+    }
+
     XBZRLE_cache_lock();
     if (rs->xbzrle_enabled && !migration_in_postcopy()) {
         pages = save_xbzrle_page(rs, pss, &p, current_addr,
@@ -1458,7 +1762,10 @@ static int ram_save_multifd_page(QEMUFile *file, RAMBlock *block,
     if (multifd_queue_page(file, block, offset) < 0) {
         return -1;
     }
-    stat64_add(&ram_atomic_counters.normal, 1);
+    /* With zero page detection the channels classify the pages */
+    if (!migrate_multifd_zero_page()) {
+        stat64_add(&ram_atomic_counters.normal, 1);
+    }
 
     return 1;
 }
@@ -1662,8 +1969,9 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
 {
     struct RAMSrcPageRequest *entry;
     RAMBlock *block = NULL;
+    bool urgent;
 
-    if (!postcopy_has_request(rs)) {
+    if (!postcopy_has_request(rs) && !postcopy_has_prefetch(rs)) {
         return NULL;
     }
 
@@ -1671,11 +1979,14 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
 
     /*
      * This should _never_ change even after we take the lock, because no one
-     * should be taking anything off the request list other than us.
+     * should be taking anything off the request lists other than us.  A
+     * page request may have been queued meanwhile, and goes first.
      */
-    assert(postcopy_has_request(rs));
+    urgent = postcopy_has_request(rs);
+    assert(urgent || postcopy_has_prefetch(rs));
 
-    entry = QSIMPLEQ_FIRST(&rs->src_page_requests);
+    entry = urgent ? QSIMPLEQ_FIRST(&rs->src_page_requests)
+                   : QSIMPLEQ_FIRST(&rs->src_prefetch_requests);
     block = entry->rb;
     *offset = entry->offset;
 
@@ -1684,9 +1995,13 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
         entry->offset += TARGET_PAGE_SIZE;
     } else {
         memory_region_unref(block->mr);
-        QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
+        if (urgent) {
+            QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
+            migration_consume_urgent_request();
+        } else {
+            QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        }
         g_free(entry);
-        migration_consume_urgent_request();
     }
 
     return block;
@@ -2161,6 +2476,61 @@ static void migration_page_queue_free(RAMState *rs)
         QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
         g_free(mspr);
     }
+    QSIMPLEQ_FOREACH_SAFE(mspr, &rs->src_prefetch_requests, next_req,
+                          next_mspr) {
+        memory_region_unref(mspr->rb->mr);
+        QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        g_free(mspr);
+    }
+}
+
+/**
+ * ram_save_queue_prefetch: queue pages the destination expects to need
+ *
+ * The pages are sent once no page request is pending, before the
+ * background search resumes.  They always go through the migration
+ * thread, so that with postcopy preempt the preempt channel is only
+ * used for the pages that the guest is waiting for.
+ *
+ * Returns zero on success or negative on error
+ *
+ * @rbname: Name of the RAMBLock of the request
+ * @start: starting address from the start of the RAMBlock
+ * @len: length (in bytes) to send
+ */
+int ram_save_queue_prefetch(const char *rbname, ram_addr_t start,
+                            ram_addr_t len)
+{
+    struct RAMSrcPageRequest *new_entry;
+    RAMState *rs = ram_state;
+    RAMBlock *ramblock;
+
+    RCU_READ_LOCK_GUARD();
+
+    ramblock = qemu_ram_block_by_name(rbname);
+    if (!ramblock) {
+        error_report("ram_save_queue_prefetch no block '%s'", rbname);
+        return -1;
+    }
+    trace_ram_save_queue_prefetch(ramblock->idstr, start, len);
+    if (!len || !offset_in_ramblock(ramblock, start + len - 1)) {
+        error_report("%s request overrun start=" RAM_ADDR_FMT " len="
+                     RAM_ADDR_FMT " blocklen=" RAM_ADDR_FMT,
+                     __func__, start, len, ramblock->used_length);
+        return -1;
+    }
+
+    new_entry = g_new0(struct RAMSrcPageRequest, 1);
+    new_entry->rb = ramblock;
+    new_entry->offset = start;
+    new_entry->len = len;
+
+    memory_region_ref(ramblock->mr);
+    qemu_mutex_lock(&rs->src_page_req_mutex);
+    QSIMPLEQ_INSERT_TAIL(&rs->src_prefetch_requests, new_entry, next_req);
+    qemu_mutex_unlock(&rs->src_page_req_mutex);
+
+    return 0;
 }
 
 /**
@@ -2343,8 +2713,20 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    /*
+     * Do not use multifd in postcopy as one whole host page should be
+     * placed.  Meanwhile postcopy requires atomic update of pages, so even
+     * if host page size == guest page size the dest guest during run may
+     * still see partially copied pages which is data corruption.
+     */
+    bool use_multifd = migrate_use_multifd() && !migration_in_postcopy();
     int res;
 
+    if (rs->dedup_index && !migration_in_postcopy()) {
+        /* Whatever is sent below replaces what the destination has */
+        block->dedup_hash[pss->page] = 0;
+    }
+
     if (control_save_page(pss, block, offset, &res)) {
         return res;
     }
@@ -2353,6 +2735,15 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
         return 1;
     }
 
+    /*
+     * Leave zero page detection to the multifd channels, and with
+     * xbzrle, keep the page cache of the channels in sync with zero pages.
+     */
+    if (use_multifd &&
+        (migrate_multifd_zero_page() || migrate_multifd_xbzrle())) {
+        return ram_save_multifd_page(pss->pss_channel, block, offset);
+    }
+
     res = save_zero_page(pss, pss->pss_channel, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -2366,13 +2757,7 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
         return res;
     }
 
-    /*
-     * Do not use multifd in postcopy as one whole host page should be
-     * placed.  Meanwhile postcopy requires atomic update of pages, so even
-     * if host page size == guest page size the dest guest during run may
-     * still see partially copied pages which is data corruption.
-     */
-    if (migrate_use_multifd() && !migration_in_postcopy()) {
+    if (use_multifd) {
         return ram_save_multifd_page(pss->pss_channel, block, offset);
     }
 
@@ -2677,10 +3062,71 @@ static void xbzrle_load_cleanup(void)
     XBZRLE.decoded_buf = NULL;
 }
 
+/*
+ * Between the snapshots of an incremental chain, the dirty log is kept
+ * running with GLOBAL_DIRTY_SNAPSHOT, so that the DIRTY_MEMORY_MIGRATION
+ * bitmap holds every page written since the last one.  Anything else
+ * that syncs the migration bitmap consumes it and ends the chain.
+ */
+static struct {
+    /* The next save is part of an incremental chain */
+    bool incremental;
+    /* ... and only sends the pages written since the previous snapshot */
+    bool delta;
+    /* GLOBAL_DIRTY_SNAPSHOT has been set since the previous snapshot */
+    bool tracking;
+} ram_snapshot;
+
+/* End the incremental chain.  Must be called with the BQL held. */
+void ram_snapshot_discard(void)
+{
+    if (ram_snapshot.tracking) {
+        ram_snapshot.tracking = false;
+        memory_global_dirty_log_stop(GLOBAL_DIRTY_SNAPSHOT);
+    }
+}
+
+/**
+ * ram_snapshot_prepare: set up the RAM part of the next snapshot
+ *
+ * @incremental: keep tracking the dirty pages once the snapshot is saved
+ * @delta: only save the pages written since the previous snapshot, which
+ *         requires ram_snapshot_tracking()
+ */
+void ram_snapshot_prepare(bool incremental, bool delta)
+{
+    assert(!delta || ram_snapshot.tracking);
+    ram_snapshot.incremental = incremental;
+    ram_snapshot.delta = delta;
+}
+
+/**
+ * ram_snapshot_finish: called once a snapshot is saved, or failed to
+ *
+ * @success: whether the snapshot was saved; if not, the pages sent for it
+ *           are not tracked anymore and the chain is over
+ */
+void ram_snapshot_finish(bool success)
+{
+    if (!success) {
+        ram_snapshot_discard();
+    }
+    ram_snapshot.incremental = false;
+    ram_snapshot.delta = false;
+}
+
+/* Whether the pages written since the previous snapshot are all known */
+bool ram_snapshot_tracking(void)
+{
+    return ram_snapshot.tracking;
+}
+
 static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        g_free((*rsp)->dedup_index);
+        g_free((*rsp)->dedup_buf);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -2715,6 +3161,16 @@ static void ram_save_cleanup(void *opaque)
          * no writing race against the migration bitmap
          */
         if (global_dirty_tracking & GLOBAL_DIRTY_MIGRATION) {
+            /*
+             * Hand the dirty log over to the incremental chain without
+             * stopping it, which would lose the pages written in between
+             * and, with KVM_DIRTY_LOG_INITIALLY_SET, report all of them
+             * the next time.
+             */
+            if (ram_snapshot.incremental) {
+                memory_global_dirty_log_start(GLOBAL_DIRTY_SNAPSHOT);
+                ram_snapshot.tracking = true;
+            }
             /*
              * do not stop dirty log without starting it, since
              * memory_global_dirty_log_stop will assert that
@@ -2729,6 +3185,10 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
+        g_free(block->dedup_hash);
+        block->dedup_hash = NULL;
     }
 
     xbzrle_cleanup();
@@ -3038,6 +3498,31 @@ err_out:
     return -ENOMEM;
 }
 
+static int dedup_init(RAMState *rs)
+{
+    uint64_t slots;
+
+    if (!migrate_page_dedup()) {
+        return 0;
+    }
+
+    slots = (rs->ram_bytes_total >> TARGET_PAGE_BITS) /
+            DEDUP_INDEX_PAGES_PER_SLOT;
+    slots = pow2ceil(MAX(slots, DEDUP_INDEX_MIN_SLOTS));
+    rs->dedup_index = g_try_new0(DedupEntry, slots);
+    rs->dedup_buf = g_try_malloc(TARGET_PAGE_SIZE);
+    if (!rs->dedup_index || !rs->dedup_buf) {
+        error_report("%s: Error allocating the dedup index", __func__);
+        g_free(rs->dedup_index);
+        rs->dedup_index = NULL;
+        g_free(rs->dedup_buf);
+        rs->dedup_buf = NULL;
+        return -ENOMEM;
+    }
+    rs->dedup_index_mask = slots - 1;
+    return 0;
+}
+
 static int ram_state_init(RAMState **rsp)
 {
     *rsp = g_try_new0(RAMState, 1);
@@ -3050,6 +3535,7 @@ static int ram_state_init(RAMState **rsp)
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
+    QSIMPLEQ_INIT(&(*rsp)->src_prefetch_requests);
     (*rsp)->ram_bytes_total = ram_bytes_total();
 
     /*
@@ -3057,7 +3543,10 @@ static int ram_state_init(RAMState **rsp)
      * gaps due to alignment or unplugs.
      * This must match with the initial values of dirty bitmap.
      */
-    (*rsp)->migration_dirty_pages = (*rsp)->ram_bytes_total >> TARGET_PAGE_BITS;
+    if (!ram_snapshot.delta) {
+        (*rsp)->migration_dirty_pages =
+            (*rsp)->ram_bytes_total >> TARGET_PAGE_BITS;
+    }
     ram_state_reset(*rsp);
 
     return 0;
@@ -3093,11 +3582,23 @@ static void ram_list_init_bitmaps(void)
              * new migration after a failed migration, ram_list.
              * dirty_memory[DIRTY_MEMORY_MIGRATION] don't include the whole
              * guest memory.
+             * The delta of an incremental snapshot is the exception, as
+             * the dirty log ran since the previous one.
              */
             block->bmap = bitmap_new(pages);
-            bitmap_set(block->bmap, 0, pages);
+            if (!ram_snapshot.delta) {
+                bitmap_set(block->bmap, 0, pages);
+            }
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            if (migrate_mapped_ram()) {
+                block->file_bmap = bitmap_new(pages);
+            }
+            if (migrate_page_dedup()) {
+                block->dedup_hash = g_new0(uint64_t, pages);
+            }
+            block->dirty_pages_period = 0;
+            block->dirty_rate = 0;
         }
     }
 }
@@ -3128,6 +3629,10 @@ static void ram_init_bitmaps(RAMState *rs)
             memory_global_dirty_log_start(GLOBAL_DIRTY_MIGRATION);
             migration_bitmap_sync_precopy(rs);
         }
+        /* Only the next delta may consume the pages of the chain */
+        if (!ram_snapshot.delta) {
+            ram_snapshot_discard();
+        }
     }
     qemu_mutex_unlock_ramlist();
     qemu_mutex_unlock_iothread();
@@ -3150,6 +3655,12 @@ static int ram_init_all(RAMState **rsp)
         return -1;
     }
 
+    if (dedup_init(*rsp)) {
+        xbzrle_cleanup();
+        ram_state_cleanup(rsp);
+        return -1;
+    }
+
     ram_init_bitmaps(*rsp);
 
     return 0;
@@ -3236,6 +3747,41 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
     }
 }
 
+/*
+ * Reserve the space for @block in a mapped-ram file: a header describing
+ * the layout goes in the stream, followed by room for the bitmap and the
+ * pages.  The stream resumes after the pages.
+ */
+static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
+{
+    MappedRamHeader header = {};
+    long num_pages = block->used_length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+
+    block->bitmap_offset = qemu_get_offset(file) + sizeof(header);
+    block->pages_offset = ROUND_UP(block->bitmap_offset + bitmap_size,
+                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    header.version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
+    header.page_size = cpu_to_be64(TARGET_PAGE_SIZE);
+    header.bitmap_offset = cpu_to_be64(block->bitmap_offset);
+    header.pages_offset = cpu_to_be64(block->pages_offset);
+    qemu_put_buffer(file, (uint8_t *)&header, sizeof(header));
+
+    qemu_set_offset(file, block->pages_offset + block->used_length, SEEK_SET);
+}
+
+static void mapped_ram_write_bitmap(QEMUFile *file, RAMBlock *block)
+{
+    long num_pages = block->used_length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+    g_autofree unsigned long *le_bitmap = bitmap_new(num_pages);
+
+    bitmap_to_le(le_bitmap, block->file_bmap, num_pages);
+    qemu_put_buffer_at(file, (uint8_t *)le_bitmap, bitmap_size,
+                       block->bitmap_offset);
+}
+
 /*
  * Each of ram_save_setup, ram_save_iterate and ram_save_complete has
  * long-running RCU critical section.  When rcu-reclaims in the code
@@ -3257,6 +3803,11 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     RAMBlock *block;
     int ret;
 
+    if (migrate_ram_fd_passing() && !qemu_file_can_pass_fd(f)) {
+        error_report("RAM fd passing requires a UNIX domain socket");
+        return -EINVAL;
+    }
+
     if (compress_threads_save_setup()) {
         return -1;
     }
@@ -3285,6 +3836,19 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_ram_fd_passing()) {
+                qemu_put_byte(f, ramblock_is_fd_passed(block));
+                if (ramblock_is_fd_passed(block)) {
+                    trace_ram_save_block_fd(block->idstr, block->fd);
+                    ret = qemu_file_put_fd(f, block->fd);
+                    if (ret < 0) {
+                        return ret;
+                    }
+                }
+            }
+            if (migrate_mapped_ram()) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -3481,6 +4045,21 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         return ret;
     }
 
+    /* All pages have reached the file, record which ones are there */
+    if (migrate_mapped_ram()) {
+        RAMBlock *block;
+
+        WITH_RCU_READ_LOCK_GUARD() {
+            RAMBLOCK_FOREACH_MIGRATABLE(block) {
+                mapped_ram_write_bitmap(f, block);
+            }
+        }
+        ret = qemu_file_get_error(f);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
     qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
     qemu_fflush(f);
 
@@ -4254,6 +4833,262 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+typedef struct {
+    RAMBlock *block;
+    unsigned long *bitmap;
+    unsigned long num_pages;
+    /* First page of the next chunk to load, updated atomically */
+    unsigned long next_page;
+    /* First error met by a loader, or 0 */
+    int ret;
+} MappedRamLoadState;
+
+typedef struct {
+    MappedRamLoadState *state;
+    QIOChannel *ioc;
+    QemuThread thread;
+} MappedRamLoader;
+
+static int mapped_ram_read_pages(QIOChannel *ioc, RAMBlock *block,
+                                 unsigned long start, unsigned long npages,
+                                 Error **errp)
+{
+    char *buf = (char *)block->host + (start << TARGET_PAGE_BITS);
+    off_t pos = block->pages_offset + (start << TARGET_PAGE_BITS);
+    size_t len = npages << TARGET_PAGE_BITS;
+
+    while (len) {
+        ssize_t ret = qio_channel_pread(ioc, buf, len, pos, errp);
+
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            error_setg(errp, "Unexpected end of migration file");
+            return -1;
+        }
+        buf += ret;
+        pos += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/*
+ * Load chunks of MAPPED_RAM_LOAD_CHUNK_PAGES pages until there are none
+ * left, reading each run of pages present in the file at once.
+ */
+static void *mapped_ram_load_thread(void *opaque)
+{
+    MappedRamLoader *loader = opaque;
+    MappedRamLoadState *state = loader->state;
+    Error *local_err = NULL;
+
+    while (!qatomic_read(&state->ret)) {
+        unsigned long start = qatomic_fetch_add(&state->next_page,
+                                                MAPPED_RAM_LOAD_CHUNK_PAGES);
+        unsigned long end, run, run_end;
+
+        if (start >= state->num_pages) {
+            break;
+        }
+        end = MIN(start + MAPPED_RAM_LOAD_CHUNK_PAGES, state->num_pages);
+
+        for (run = find_next_bit(state->bitmap, end, start); run < end;
+             run = find_next_bit(state->bitmap, end, run_end)) {
+            run_end = find_next_zero_bit(state->bitmap, end, run);
+            if (mapped_ram_read_pages(loader->ioc, state->block, run,
+                                      run_end - run, &local_err) < 0) {
+                error_report_err(local_err);
+                qatomic_cmpxchg(&state->ret, 0, -EIO);
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Map the memory that the source passed for @block in place of its own,
+ * if @passed.  Both sides must agree on which blocks are passed, as the
+ * source does not send their pages.
+ */
+static int ram_load_block_fd(QEMUFile *f, RAMBlock *block, bool passed)
+{
+    Error *local_err = NULL;
+    int fd;
+
+    if (!passed) {
+        if (ramblock_is_fd_passed(block)) {
+            error_report("RAM block %s is only backed by shared memory "
+                         "on the destination", block->idstr);
+            return -EINVAL;
+        }
+        return 0;
+    }
+
+    fd = qemu_file_get_fd(f);
+    if (fd < 0) {
+        error_report("Failed to receive the memory of RAM block %s",
+                     block->idstr);
+        return fd;
+    }
+    trace_ram_load_block_fd(block->idstr, fd);
+    if (qemu_ram_remap_fd(block, fd, &local_err) < 0) {
+        error_report_err(local_err);
+        close(fd);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/*
+ * Load the pages of @block from a mapped-ram file.  The header follows the
+ * block in the stream; the pages are read from their fixed offsets by one
+ * loader per multifd channel, or by the migration thread without multifd.
+ */
+static int mapped_ram_read_ramblock(QEMUFile *f, RAMBlock *block,
+                                    ram_addr_t length)
+{
+    MappedRamHeader header;
+    MappedRamLoadState state = {
+        .block = block,
+        .num_pages = length >> TARGET_PAGE_BITS,
+    };
+    g_autofree unsigned long *le_bitmap = NULL;
+    g_autofree unsigned long *bitmap = NULL;
+    g_autofree MappedRamLoader *loaders = NULL;
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    size_t bitmap_size;
+    int nr_loaders = 1;
+    int i;
+
+    if (qemu_get_buffer(f, (uint8_t *)&header, sizeof(header)) !=
+        sizeof(header)) {
+        error_report("Couldn't read mapped-ram header of block %s",
+                     block->idstr);
+        return -EINVAL;
+    }
+    header.version = be32_to_cpu(header.version);
+    header.page_size = be64_to_cpu(header.page_size);
+    header.bitmap_offset = be64_to_cpu(header.bitmap_offset);
+    header.pages_offset = be64_to_cpu(header.pages_offset);
+
+    if (header.version != MAPPED_RAM_HDR_VERSION) {
+        error_report("Mapped-ram header version %u of block %s is not "
+                     "supported", header.version, block->idstr);
+        return -EINVAL;
+    }
+    if (header.page_size != TARGET_PAGE_SIZE) {
+        error_report("Mismatched mapped-ram page size %s "
+                     "(local) %d != %" PRIu64, block->idstr,
+                     TARGET_PAGE_SIZE, header.page_size);
+        return -EINVAL;
+    }
+
+    bitmap_size = BITS_TO_LONGS(state.num_pages) * sizeof(unsigned long);
+    le_bitmap = bitmap_new(state.num_pages);
+    if (qemu_get_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           header.bitmap_offset) != bitmap_size) {
+        return qemu_file_get_error(f);
+    }
+    bitmap = bitmap_new(state.num_pages);
+    bitmap_from_le(bitmap, le_bitmap, state.num_pages);
+    state.bitmap = bitmap;
+    block->pages_offset = header.pages_offset;
+
+    if (migrate_use_multifd()) {
+        nr_loaders = migrate_multifd_channels();
+    }
+    loaders = g_new0(MappedRamLoader, nr_loaders);
+    for (i = 0; i < nr_loaders; i++) {
+        Error *local_err = NULL;
+
+        loaders[i].state = &state;
+        if (migrate_direct_io()) {
+            loaders[i].ioc = file_recv_channel_create(&local_err);
+            if (!loaders[i].ioc) {
+                error_report_err(local_err);
+                state.ret = -EIO;
+                break;
+            }
+        } else {
+            loaders[i].ioc = QIO_CHANNEL(object_ref(OBJECT(ioc)));
+        }
+    }
+
+    if (!state.ret) {
+        if (nr_loaders == 1) {
+            mapped_ram_load_thread(&loaders[0]);
+        } else {
+            for (i = 0; i < nr_loaders; i++) {
+                qemu_thread_create(&loaders[i].thread, "mapped-ram-load",
+                                   mapped_ram_load_thread, &loaders[i],
+                                   QEMU_THREAD_JOINABLE);
+            }
+            for (i = 0; i < nr_loaders; i++) {
+                qemu_thread_join(&loaders[i].thread);
+            }
+        }
+    }
+
+    for (i = 0; i < nr_loaders; i++) {
+        object_unref(OBJECT(loaders[i].ioc));
+    }
+    if (state.ret) {
+        return state.ret;
+    }
+
+    /* The stream resumes after the pages */
+    qemu_set_offset(f, header.pages_offset + length, SEEK_SET);
+    return qemu_file_get_error(f);
+}
+
+/**
+ * load_dedup_page: copy a page from the one it is a reference to
+ *
+ * Returns 0 for success or -EINVAL if the reference is not to a page
+ * that was received before
+ *
+ * @f: QEMUFile where to read the reference from
+ * @block: block that contains the page
+ * @host: host address of the page
+ */
+static int load_dedup_page(QEMUFile *f, RAMBlock *block, void *host)
+{
+    ram_addr_t ref_offset = qemu_get_be64(f);
+    RAMBlock *ref_block = block;
+    void *ref_host;
+
+    if (!(ref_offset & RAM_SAVE_FLAG_CONTINUE)) {
+        char id[256];
+        uint8_t len;
+
+        len = qemu_get_byte(f);
+        qemu_get_buffer(f, (uint8_t *)id, len);
+        id[len] = 0;
+
+        ref_block = qemu_ram_block_by_name(id);
+        if (!ref_block || ramblock_is_ignored(ref_block)) {
+            error_report("Dedup reference to unknown block %s", id);
+            return -EINVAL;
+        }
+    }
+    ref_offset &= TARGET_PAGE_MASK;
+
+    ref_host = host_from_ram_block_offset(ref_block, ref_offset);
+    if (!ref_host ||
+        !ramblock_recv_bitmap_test_byte_offset(ref_block, ref_offset)) {
+        error_report("Dedup reference to a page not received: %s "
+                     RAM_ADDR_FMT, ref_block->idstr, ref_offset);
+        return -EINVAL;
+    }
+    if (ref_host != host) {
+        memcpy(host, ref_host, TARGET_PAGE_SIZE);
+    }
+    return 0;
+}
+
 /**
  * ram_load_precopy: load pages in precopy case
  *
@@ -4273,6 +5108,9 @@ static int ram_load_precopy(QEMUFile *f)
     if (!migrate_use_compression()) {
         invalid_flags |= RAM_SAVE_FLAG_COMPRESS_PAGE;
     }
+    if (!migrate_page_dedup()) {
+        invalid_flags |= RAM_SAVE_FLAG_DEDUP;
+    }
 
     while (!ret && !(flags & RAM_SAVE_FLAG_EOS)) {
         ram_addr_t addr, total_ram_bytes;
@@ -4298,13 +5136,17 @@ static int ram_load_precopy(QEMUFile *f)
             if (flags & invalid_flags & RAM_SAVE_FLAG_COMPRESS_PAGE) {
                 error_report("Received an unexpected compressed page");
             }
+            if (flags & invalid_flags & RAM_SAVE_FLAG_DEDUP) {
+                error_report("Received an unexpected dedup page");
+            }
 
             ret = -EINVAL;
             break;
         }
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
-                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
+                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE |
+                     RAM_SAVE_FLAG_DEDUP)) {
             RAMBlock *block = ram_block_from_stream(mis, f, flags,
                                                     RAM_CHANNEL_PRECOPY);
 
@@ -4395,6 +5237,12 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_ram_fd_passing()) {
+                        ret = ram_load_block_fd(f, block, qemu_get_byte(f));
+                    }
+                    if (!ret && migrate_mapped_ram()) {
+                        ret = mapped_ram_read_ramblock(f, block, length);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -4405,6 +5253,11 @@ static int ram_load_precopy(QEMUFile *f)
 
                 total_ram_bytes -= length;
             }
+            if (!ret && migrate_ram_fd_passing() &&
+                qemu_file_can_pass_fd(f)) {
+                /* All blocks are mapped, no more descriptors may come */
+                ret = qemu_file_set_fd_passing(f, false);
+            }
             break;
 
         case RAM_SAVE_FLAG_ZERO:
@@ -4434,6 +5287,10 @@ static int ram_load_precopy(QEMUFile *f)
                 break;
             }
             break;
+        case RAM_SAVE_FLAG_DEDUP:
+            ret = load_dedup_page(f, mis->last_recv_block[RAM_CHANNEL_PRECOPY],
+                                  host);
+            break;
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
             multifd_recv_sync_main();
@@ -50,12 +50,15 @@ typedef struct {
     Stat64 duplicate;
     Stat64 normal;
     Stat64 postcopy_bytes;
+    Stat64 dedup;
 } MigrationAtomicStats;
 
 extern MigrationAtomicStats ram_atomic_counters;
 extern MigrationStats ram_counters;
 extern XBZRLECacheStats xbzrle_counters;
 extern CompressionStats compression_counters;
+extern int (*xbzrle_encode_buffer_func)(uint8_t *, uint8_t *, int,
+                                        uint8_t *, int);
 
 bool ramblock_is_ignored(RAMBlock *block);
 /* Should be holding either ram_list.mutex, or the RCU lock. */
@@ -71,9 +74,15 @@ int xbzrle_cache_resize(uint64_t new_size, Error **errp);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
 void mig_throttle_counter_reset(void);
+uint64_t ram_dirty_bytes_since_sync(void);
+uint64_t ram_dirty_rate(void);
+uint64_t ram_predict_downtime(double bandwidth, uint64_t pending,
+                              uint64_t threshold);
 
 uint64_t ram_pagesize_summary(void);
 int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len);
+int ram_save_queue_prefetch(const char *rbname, ram_addr_t start,
+                            ram_addr_t len);
 void acct_update_position(QEMUFile *f, size_t size, bool zero);
 void ram_postcopy_migrated_memory_release(MigrationState *ms);
 /* For outgoing discard bitmap */
@@ -105,6 +114,12 @@ void colo_flush_ram_cache(void);
 void colo_release_ram_cache(void);
 void colo_incoming_start_dirty_log(void);
 
+/* Incremental snapshots */
+void ram_snapshot_prepare(bool incremental, bool delta);
+void ram_snapshot_finish(bool success);
+bool ram_snapshot_tracking(void);
+void ram_snapshot_discard(void);
+
 /* Background snapshot */
 bool ram_write_tracking_available(void);
 bool ram_write_tracking_compatible(void);
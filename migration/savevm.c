@@ -89,6 +89,7 @@ enum qemu_vm_cmd {
     MIG_CMD_ENABLE_COLO,       /* Enable COLO */
     MIG_CMD_POSTCOPY_RESUME,   /* resume postcopy on dest */
     MIG_CMD_RECV_BITMAP,       /* Request for recved bitmap on dst */
+    MIG_CMD_PARALLEL_SECTIONS, /* Sections that can be loaded in parallel */
     MIG_CMD_MAX
 };
 
@@ -108,6 +109,7 @@ static struct mig_cmd_args {
     [MIG_CMD_POSTCOPY_RESUME]  = { .len =  0, .name = "POSTCOPY_RESUME" },
     [MIG_CMD_PACKAGED]         = { .len =  4, .name = "PACKAGED" },
     [MIG_CMD_RECV_BITMAP]      = { .len = -1, .name = "RECV_BITMAP" },
+    [MIG_CMD_PARALLEL_SECTIONS] = { .len = 4, .name = "PARALLEL_SECTIONS" },
     [MIG_CMD_MAX]              = { .len = -1, .name = "MAX" },
 };
 
@@ -227,6 +229,12 @@ typedef struct SaveState {
     uint32_t caps_count;
     MigrationCapability *capabilities;
     QemuUUID uuid;
+    /* The snapshot whose RAM an incremental snapshot only has changes to */
+    uint32_t parent_len;
+    char *parent_name;
+    uint32_t parent_date_sec;
+    uint32_t parent_date_nsec;
+    uint64_t parent_vm_clock_nsec;
 } SaveState;
 
 static SaveState savevm_state = {
@@ -294,6 +302,13 @@ static int configuration_post_save(void *opaque)
     return 0;
 }
 
+static void configuration_clear_parent(SaveState *state)
+{
+    g_free(state->parent_name);
+    state->parent_name = NULL;
+    state->parent_len = 0;
+}
+
 static int configuration_pre_load(void *opaque)
 {
     SaveState *state = opaque;
@@ -303,6 +318,8 @@ static int configuration_pre_load(void *opaque)
      * minimum possible value for this CPU.
      */
     state->target_page_bits = qemu_target_page_bits_min();
+
+    configuration_clear_parent(state);
     return 0;
 }
 
@@ -501,6 +518,35 @@ static const VMStateDescription vmstate_uuid = {
     }
 };
 
+static bool vmstate_snapshot_parent_needed(void *opaque)
+{
+    SaveState *state = opaque;
+
+    return state->parent_len > 0;
+}
+
+/*
+ * The snapshot-parent subsection is present in incremental snapshots
+ * that only have the RAM pages written since the previous one, which
+ * must be loaded first.  Its date tells it from another snapshot that
+ * was given the same name since.
+ */
+static const VMStateDescription vmstate_snapshot_parent = {
+    .name = "configuration/snapshot-parent",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = vmstate_snapshot_parent_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(parent_len, SaveState),
+        VMSTATE_VBUFFER_ALLOC_UINT32(parent_name, SaveState, 0, NULL,
+                                     parent_len),
+        VMSTATE_UINT32(parent_date_sec, SaveState),
+        VMSTATE_UINT32(parent_date_nsec, SaveState),
+        VMSTATE_UINT64(parent_vm_clock_nsec, SaveState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_configuration = {
     .name = "configuration",
     .version_id = 1,
@@ -517,6 +563,7 @@ static const VMStateDescription vmstate_configuration = {
         &vmstate_target_page_bits,
         &vmstate_capabilites,
         &vmstate_uuid,
+        &vmstate_snapshot_parent,
         NULL
     }
 };
@@ -1010,6 +1057,184 @@ static int vmstate_save(QEMUFile *f, SaveStateEntry *se, JSONWriter *vmdesc)
     }
     return 0;
 }
+
+/*
+ * Independent sections are saved and loaded by up to this many threads,
+ * the calling one included.
+ */
+#define PARALLEL_SECTIONS_MAX_THREADS 8
+
+/*
+ * The destination buffers all the sections of a command before loading
+ * them.  They are not iterable, so even the vCPUs of the largest guests
+ * take a few MiB; bound them well above that.
+ */
+#define MAX_VM_CMD_PARALLEL_SECTIONS_SIZE (1ULL << 30)
+
+typedef struct ParallelSection {
+    SaveStateEntry *se;
+    /* The section, as it goes on the wire */
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+} ParallelSection;
+
+typedef struct ParallelSections {
+    ParallelSection *sections;
+    unsigned count;
+    /* Next section to process, claimed by the threads */
+    unsigned next;
+    MigrationIncomingState *mis;
+    int (*fn)(struct ParallelSections *ps, ParallelSection *s);
+} ParallelSections;
+
+static void parallel_sections_work(ParallelSections *ps)
+{
+    unsigned i;
+
+    while ((i = qatomic_fetch_inc(&ps->next)) < ps->count) {
+        ps->sections[i].ret = ps->fn(ps, &ps->sections[i]);
+    }
+}
+
+static void *parallel_sections_thread(void *opaque)
+{
+    rcu_register_thread();
+    parallel_sections_work(opaque);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/*
+ * Run @ps->fn on every section, in @threads threads including the caller,
+ * which holds the BQL for all of them.
+ */
+static void parallel_sections_run(ParallelSections *ps, unsigned threads)
+{
+    QemuThread *thread;
+    unsigned i;
+
+    threads = MIN(threads, ps->count);
+    thread = g_new0(QemuThread, threads);
+    for (i = 1; i < threads; i++) {
+        qemu_thread_create(&thread[i], "mig/sections",
+                           parallel_sections_thread, ps,
+                           QEMU_THREAD_JOINABLE);
+    }
+    parallel_sections_work(ps);
+    for (i = 1; i < threads; i++) {
+        qemu_thread_join(&thread[i]);
+    }
+    g_free(thread);
+}
+
+static void parallel_sections_free(ParallelSections *ps)
+{
+    unsigned i;
+
+    for (i = 0; i < ps->count; i++) {
+        if (ps->sections[i].f) {
+            qemu_fclose(ps->sections[i].f);
+        }
+        if (ps->sections[i].bioc) {
+            object_unref(OBJECT(ps->sections[i].bioc));
+        }
+    }
+    g_free(ps->sections);
+}
+
+static int parallel_section_save(ParallelSections *ps, ParallelSection *s)
+{
+    int ret;
+
+    s->bioc = qio_channel_buffer_new(4096);
+    qio_channel_set_name(QIO_CHANNEL(s->bioc), "migration-section-buffer");
+    s->f = qemu_file_new_output(QIO_CHANNEL(s->bioc));
+
+    /* The JSON description can't be written by several threads */
+    ret = vmstate_save(s->f, s->se, NULL);
+    qemu_fflush(s->f);
+
+    return ret ? ret : qemu_file_get_error(s->f);
+}
+
+static bool se_is_independent(SaveStateEntry *se)
+{
+    return se->vmsd && se->vmsd->independent && !se->vmsd->early_setup;
+}
+
+/**
+ * qemu_savevm_parallel_sections: save the independent sections of a
+ * priority in parallel
+ *
+ * They are all sent in a MIG_CMD_PARALLEL_SECTIONS command, at the place
+ * of the first one, and the destination loads all of them before the
+ * sections that come after.
+ *
+ * Returns 0 on success, or a negative error code
+ *
+ * @f: the stream
+ * @first: the first independent section of its priority
+ */
+static int qemu_savevm_parallel_sections(QEMUFile *f, SaveStateEntry *first)
+{
+    MigrationPriority priority = save_state_priority(first);
+    ParallelSections ps = { .fn = parallel_section_save };
+    SaveStateEntry *se;
+    uint64_t total = 0;
+    uint32_t sent = 0;
+    unsigned i;
+    int ret = 0;
+
+    /* The handlers of a priority are next to each other */
+    for (se = first; se && save_state_priority(se) == priority;
+         se = QTAILQ_NEXT(se, entry)) {
+        ps.count += se_is_independent(se);
+    }
+    ps.sections = g_new0(ParallelSection, ps.count);
+    i = 0;
+    for (se = first; se && save_state_priority(se) == priority;
+         se = QTAILQ_NEXT(se, entry)) {
+        if (se_is_independent(se)) {
+            ps.sections[i++].se = se;
+        }
+    }
+
+    parallel_sections_run(&ps, PARALLEL_SECTIONS_MAX_THREADS);
+
+    for (i = 0; i < ps.count; i++) {
+        if (ps.sections[i].ret) {
+            ret = ps.sections[i].ret;
+            goto out;
+        }
+        /* Sections that are not needed come out empty */
+        sent += ps.sections[i].bioc->usage != 0;
+        total += ps.sections[i].bioc->usage;
+    }
+    if (total > MAX_VM_CMD_PARALLEL_SECTIONS_SIZE) {
+        error_report("%s: Unreasonably large parallel sections: %" PRIu64,
+                     __func__, total);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    trace_qemu_savevm_parallel_sections(priority, sent);
+    sent = cpu_to_be32(sent);
+    qemu_savevm_command_send(f, MIG_CMD_PARALLEL_SECTIONS, 4,
+                             (uint8_t *)&sent);
+    for (i = 0; i < ps.count; i++) {
+        QIOChannelBuffer *bioc = ps.sections[i].bioc;
+
+        if (bioc->usage) {
+            qemu_put_be32(f, bioc->usage);
+            qemu_put_buffer(f, (uint8_t *)bioc->data, bioc->usage);
+        }
+    }
+
+out:
+    parallel_sections_free(&ps);
+    return ret;
+}
 /**
  * qemu_savevm_command_send: Send a 'QEMU_VM_COMMAND' type element with the
  *                           command and associated data.
@@ -1450,6 +1675,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
 {
     MigrationState *ms = migrate_get_current();
     JSONWriter *vmdesc = ms->vmdesc;
+    bool parallel_sent[MIG_PRI_MAX + 1] = { };
     int vmdesc_len;
     SaveStateEntry *se;
     int ret;
@@ -1460,6 +1686,20 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
             continue;
         }
 
+        if (migrate_parallel_device_state() && se_is_independent(se)) {
+            MigrationPriority priority = save_state_priority(se);
+
+            if (!parallel_sent[priority]) {
+                ret = qemu_savevm_parallel_sections(f, se);
+                if (ret) {
+                    qemu_file_set_error(f, ret);
+                    return ret;
+                }
+                parallel_sent[priority] = true;
+            }
+            continue;
+        }
+
         ret = vmstate_save(f, se, vmdesc);
         if (ret) {
             qemu_file_set_error(f, ret);
@@ -2253,6 +2493,116 @@ static int loadvm_handle_cmd_packaged(MigrationIncomingState *mis)
     return ret;
 }
 
+static int
+qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis);
+
+static int parallel_section_load(ParallelSections *ps, ParallelSection *s)
+{
+    uint8_t section_type = qemu_get_byte(s->f);
+    int ret;
+
+    if (section_type != QEMU_VM_SECTION_FULL) {
+        error_report("Unexpected section type %d in parallel sections",
+                     section_type);
+        return -EINVAL;
+    }
+    ret = qemu_loadvm_section_start_full(s->f, ps->mis);
+
+    return ret ? ret : qemu_file_get_error(s->f);
+}
+
+/*
+ * Whether the section in @s is independent here too: if the source
+ * disagrees, the sections are loaded one after the other.
+ */
+static bool parallel_section_is_independent(ParallelSection *s)
+{
+    /* type (1), section id (4), idstr length (1) and idstr, instance id */
+    const uint8_t *data = (const uint8_t *)s->bioc->data;
+    size_t len = s->bioc->usage;
+    char idstr[256];
+    size_t idlen;
+
+    if (len < 6 || len < 6 + data[5] + 4) {
+        return false;
+    }
+    idlen = data[5];
+    memcpy(idstr, data + 6, idlen);
+    idstr[idlen] = 0;
+    s->se = find_se(idstr, ldl_be_p(data + 6 + idlen));
+
+    return s->se && se_is_independent(s->se);
+}
+
+/*
+ * Load the sections of a MIG_CMD_PARALLEL_SECTIONS command, each of them
+ * preceded by its length, in parallel
+ */
+static int loadvm_handle_cmd_parallel_sections(QEMUFile *f,
+                                               MigrationIncomingState *mis)
+{
+    ParallelSections ps = { .fn = parallel_section_load, .mis = mis };
+    unsigned threads = PARALLEL_SECTIONS_MAX_THREADS;
+    uint32_t count = qemu_get_be32(f);
+    uint64_t total = 0;
+    unsigned i;
+    int ret = 0;
+
+    trace_loadvm_handle_cmd_parallel_sections(count);
+    /* Every section comes from a handler of the same priority */
+    if (count > savevm_state.global_section_id) {
+        error_report("CMD_PARALLEL_SECTIONS: unexpected count %u", count);
+        return -EINVAL;
+    }
+
+    ps.sections = g_new0(ParallelSection, count);
+    for (i = 0; i < count; i++) {
+        ParallelSection *s = &ps.sections[i];
+        uint32_t length = qemu_get_be32(f);
+
+        ret = qemu_file_get_error(f);
+        if (ret) {
+            goto out;
+        }
+        total += length;
+        if (total > MAX_VM_CMD_PARALLEL_SECTIONS_SIZE) {
+            error_report("CMD_PARALLEL_SECTIONS: Unreasonably large "
+                         "sections: %" PRIu64, total);
+            ret = -EINVAL;
+            goto out;
+        }
+        ps.count++;
+        s->bioc = qio_channel_buffer_new(length);
+        qio_channel_set_name(QIO_CHANNEL(s->bioc), "migration-section-buffer");
+        ret = qemu_get_buffer(f, (uint8_t *)s->bioc->data, length);
+        if (ret != length) {
+            error_report("CMD_PARALLEL_SECTIONS: Buffer receive fail "
+                         "ret=%d length=%u", ret, length);
+            ret = ret < 0 ? ret : -EAGAIN;
+            goto out;
+        }
+        s->bioc->usage = length;
+        s->f = qemu_file_new_input(QIO_CHANNEL(s->bioc));
+        if (!parallel_section_is_independent(s)) {
+            threads = 1;
+        }
+    }
+
+    parallel_sections_run(&ps, threads);
+
+    ret = 0;
+    for (i = 0; i < ps.count; i++) {
+        if (ps.sections[i].ret < 0) {
+            ret = ps.sections[i].ret;
+            break;
+        }
+    }
+
+out:
+    parallel_sections_free(&ps);
+    return ret;
+}
+
 /*
  * Handle request that source requests for recved_bitmap on
  * destination. Payload format:
@@ -2392,6 +2742,9 @@ static int loadvm_process_command(QEMUFile *f)
 
     case MIG_CMD_ENABLE_COLO:
         return loadvm_process_enable_colo(mis);
+
+    case MIG_CMD_PARALLEL_SECTIONS:
+        return loadvm_handle_cmd_parallel_sections(f, mis);
     }
 
     return 0;
@@ -2858,6 +3211,34 @@ int qemu_load_device_state(QEMUFile *f)
     return 0;
 }
 
+/* Incremental snapshots deeper than that are not loaded */
+#define SNAPSHOT_CHAIN_MAX_DEPTH 1024
+
+/*
+ * The last snapshot saved with incremental-snapshot, which the next one
+ * is a delta of as long as the RAM dirty log ran in between
+ */
+static struct {
+    QEMUSnapshotInfo sn;
+    char *node_name;
+} snapshot_parent;
+
+static bool snapshot_parent_usable(BlockDriverState *bs)
+{
+    QEMUSnapshotInfo sn;
+
+    if (!snapshot_parent.node_name || !ram_snapshot_tracking() ||
+        !migrate_get_current()->send_configuration ||
+        strcmp(bdrv_get_node_name(bs), snapshot_parent.node_name)) {
+        return false;
+    }
+
+    return bdrv_snapshot_find(bs, &sn, snapshot_parent.sn.name) == 0 &&
+           sn.date_sec == snapshot_parent.sn.date_sec &&
+           sn.date_nsec == snapshot_parent.sn.date_nsec &&
+           sn.vm_clock_nsec == snapshot_parent.sn.vm_clock_nsec;
+}
+
 bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
                   bool has_devices, strList *devices, Error **errp)
 {
@@ -2869,6 +3250,8 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
     uint64_t vm_state_size;
     g_autoptr(GDateTime) now = g_date_time_new_now_local();
     AioContext *aio_context;
+    bool incremental = migrate_incremental_snapshot();
+    bool delta = false;
 
     GLOBAL_STATE_CODE();
 
@@ -2945,6 +3328,20 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
         pstrcpy(sn->name, sizeof(sn->name), autoname);
     }
 
+    if (incremental) {
+        delta = snapshot_parent_usable(bs);
+    }
+    if (delta) {
+        savevm_state.parent_len = strlen(snapshot_parent.sn.name);
+        savevm_state.parent_name = snapshot_parent.sn.name;
+        savevm_state.parent_date_sec = snapshot_parent.sn.date_sec;
+        savevm_state.parent_date_nsec = snapshot_parent.sn.date_nsec;
+        savevm_state.parent_vm_clock_nsec = snapshot_parent.sn.vm_clock_nsec;
+    }
+    trace_save_snapshot_incremental(sn->name, incremental,
+                                    delta ? snapshot_parent.sn.name : "");
+    ram_snapshot_prepare(incremental, delta);
+
     /* save the VM state */
     f = qemu_fopen_bdrv(bs, 1);
     if (!f) {
@@ -2952,6 +3349,8 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
         goto the_end;
     }
     ret = qemu_savevm_state(f, errp);
+    savevm_state.parent_len = 0;
+    savevm_state.parent_name = NULL;
     vm_state_size = qemu_file_total_transferred(f);
     ret2 = qemu_fclose(f);
     if (ret < 0) {
@@ -2979,7 +3378,15 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
 
     ret = 0;
 
+    if (incremental) {
+        snapshot_parent.sn = *sn;
+        g_free(snapshot_parent.node_name);
+        snapshot_parent.node_name = g_strdup(bdrv_get_node_name(bs));
+    }
+
  the_end:
+    ram_snapshot_finish(ret == 0);
+
     if (aio_context) {
         aio_context_release(aio_context);
     }
@@ -3074,15 +3481,125 @@ void qmp_xen_load_devices_state(const char *filename, Error **errp)
     migration_incoming_state_destroy();
 }
 
+/*
+ * Read the header of the VM state of a snapshot, and return in @parent
+ * the name of the snapshot it is a delta of, if any
+ */
+static int snapshot_read_parent(QEMUFile *f, BlockDriverState *bs,
+                                char **parent, Error **errp)
+{
+    AioContext *aio_context = bdrv_get_aio_context(bs);
+    g_autofree char *name = NULL;
+    QEMUSnapshotInfo sn;
+    int ret;
+
+    *parent = NULL;
+    aio_context_acquire(aio_context);
+    ret = qemu_loadvm_state_header(f);
+    aio_context_release(aio_context);
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading VM state", ret);
+        return ret;
+    }
+    if (!savevm_state.parent_len) {
+        return 0;
+    }
+
+    name = g_strndup(savevm_state.parent_name, savevm_state.parent_len);
+    configuration_clear_parent(&savevm_state);
+    aio_context_acquire(aio_context);
+    ret = bdrv_snapshot_find(bs, &sn, name);
+    aio_context_release(aio_context);
+    if (ret < 0 ||
+        sn.date_sec != savevm_state.parent_date_sec ||
+        sn.date_nsec != savevm_state.parent_date_nsec ||
+        sn.vm_clock_nsec != savevm_state.parent_vm_clock_nsec) {
+        error_setg(errp, "Snapshot is incremental on top of '%s', "
+                   "which does not exist anymore", name);
+        return -ENOENT;
+    }
+    *parent = g_steal_pointer(&name);
+    return 0;
+}
+
+/*
+ * Load the VM state of snapshot @name, after the ones of the snapshots it
+ * is incremental on top of, and leave the devices at @name
+ */
+static int load_snapshot_state(const char *name, BlockDriverState *bs,
+                               bool has_devices, strList *devices,
+                               int depth, Error **errp)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    AioContext *aio_context = bdrv_get_aio_context(bs);
+    g_autofree char *parent = NULL;
+    QEMUFile *f;
+    int ret;
+
+    ret = bdrv_all_goto_snapshot(name, has_devices, devices, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    f = qemu_fopen_bdrv(bs, 0);
+    if (!f) {
+        error_setg(errp, "Could not open VM state file");
+        return -EINVAL;
+    }
+    ret = snapshot_read_parent(f, bs, &parent, errp);
+    qemu_fclose(f);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (parent) {
+        trace_load_snapshot_parent(name, parent, depth);
+        if (depth >= SNAPSHOT_CHAIN_MAX_DEPTH) {
+            error_setg(errp, "Too many incremental snapshots below '%s'",
+                       name);
+            return -EINVAL;
+        }
+        ret = load_snapshot_state(parent, bs, has_devices, devices,
+                                  depth + 1, errp);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = bdrv_all_goto_snapshot(name, has_devices, devices, errp);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    /* restore the VM state */
+    f = qemu_fopen_bdrv(bs, 0);
+    if (!f) {
+        error_setg(errp, "Could not open VM state file");
+        return -EINVAL;
+    }
+    mis->from_src_file = f;
+
+    if (!yank_register_instance(MIGRATION_YANK_INSTANCE, errp)) {
+        return -EINVAL;
+    }
+    aio_context_acquire(aio_context);
+    ret = qemu_loadvm_state(f);
+    migration_incoming_state_destroy();
+    aio_context_release(aio_context);
+    configuration_clear_parent(&savevm_state);
+
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading VM state", ret);
+    }
+    return ret;
+}
+
 bool load_snapshot(const char *name, const char *vmstate,
                    bool has_devices, strList *devices, Error **errp)
 {
     BlockDriverState *bs_vm_state;
     QEMUSnapshotInfo sn;
-    QEMUFile *f;
     int ret;
     AioContext *aio_context;
-    MigrationIncomingState *mis = migration_incoming_get_current();
 
     if (!bdrv_all_can_snapshot(has_devices, devices, errp)) {
         return false;
@@ -3124,42 +3641,20 @@ bool load_snapshot(const char *name, const char *vmstate,
     /* Flush all IO requests so they don't interfere with the new state.  */
     bdrv_drain_all_begin();
 
-    ret = bdrv_all_goto_snapshot(name, has_devices, devices, errp);
-    if (ret < 0) {
-        goto err_drain;
-    }
-
-    /* restore the VM state */
-    f = qemu_fopen_bdrv(bs_vm_state, 0);
-    if (!f) {
-        error_setg(errp, "Could not open VM state file");
-        goto err_drain;
-    }
-
+    /*
+     * RAM now differs from the last snapshot in ways the dirty log does
+     * not know about.  The reset must come before the VM states of an
+     * incremental chain are layered, as it may write ROMs into RAM.
+     */
+    ram_snapshot_discard();
     qemu_system_reset(SHUTDOWN_CAUSE_SNAPSHOT_LOAD);
-    mis->from_src_file = f;
 
-    if (!yank_register_instance(MIGRATION_YANK_INSTANCE, errp)) {
-        ret = -EINVAL;
-        goto err_drain;
-    }
-    aio_context_acquire(aio_context);
-    ret = qemu_loadvm_state(f);
-    migration_incoming_state_destroy();
-    aio_context_release(aio_context);
+    ret = load_snapshot_state(name, bs_vm_state, has_devices, devices, 0,
+                              errp);
 
     bdrv_drain_all_end();
 
-    if (ret < 0) {
-        error_setg(errp, "Error %d while loading VM state", ret);
-        return false;
-    }
-
-    return true;
-
-err_drain:
-    bdrv_drain_all_end();
-    return false;
+    return ret >= 0;
 }
 
 bool delete_snapshot(const char *name, bool has_devices,
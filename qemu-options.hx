@@ -30,6 +30,7 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                vmport=on|off|auto controls emulation of vmport (default: auto)\n"
     "                dump-guest-core=on|off include guest memory in a core dump (default=on)\n"
     "                mem-merge=on|off controls memory merge support (default: on)\n"
+    "                numa-affinity=on|off pins vCPU threads to the host nodes of their NUMA node's memdev (default: off)\n"
     "                aes-key-wrap=on|off controls support for AES key wrapping (default=on)\n"
     "                dea-key-wrap=on|off controls support for DEA key wrapping (default=on)\n"
     "                suppress-vmdesc=on|off disables self-describing migration (default=off)\n"
@@ -77,6 +78,13 @@ SRST
         supported by the host, de-duplicates identical memory pages
         among VMs instances (enabled by default).
 
+    ``numa-affinity=on|off``
+        Pin each vCPU thread to the host CPUs of the ``host-nodes`` of
+        the memory backend assigned to the vCPU's NUMA node with
+        ``-numa node,memdev=``. vCPUs of nodes whose backend has no
+        ``host-nodes`` are left alone. Hotplugged vCPUs are pinned when
+        they are created. Requires host NUMA support; the default is off.
+
     ``aes-key-wrap=on|off``
         Enables or disables AES key wrapping support on s390-ccw hosts.
         This feature controls whether AES wrapping keys will be created
@@ -184,6 +192,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                spec-tb=n (TCG speculative successor translation depth, default 0)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
@@ -219,6 +228,16 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``spec-tb=n``
+        When a vCPU misses in the TCG translation block cache, also
+        translate up to n blocks that follow the missing one in guest
+        memory, so that straight-line code reached for the first time
+        does not return to the translator once per block. Successors
+        are only translated from pages that already have a valid TLB
+        entry, so that speculation does not walk the guest page tables,
+        and translation stops at the first block that crosses a page.
+        The default is 0 (disabled); the maximum is 8.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -4891,7 +4910,7 @@ SRST
     they are specified. Note that the 'id' property must be set. These
     objects are placed in the '/objects' path.
 
-    ``-object memory-backend-file,id=id,size=size,mem-path=dir,share=on|off,discard-data=on|off,merge=on|off,dump=on|off,prealloc=on|off,host-nodes=host-nodes,policy=default|preferred|bind|interleave,align=align,readonly=on|off``
+    ``-object memory-backend-file,id=id,size=size,mem-path=dir,share=on|off,discard-data=on|off,merge=on|off,dump=on|off,prealloc=on|off,host-nodes=host-nodes,policy=default|preferred|bind|interleave,align=align,readonly=on|off,rom=on|off|auto``
         Creates a memory file backend object, which can be used to back
         the guest RAM with huge pages.
 
@@ -4977,6 +4996,16 @@ SRST
         The ``readonly`` option specifies whether the backing file is opened
         read-only or read-write (default).
 
+        The ``rom`` option specifies whether the guest sees the memory as
+        Read Only Memory (ROM).  The default, ``auto``, follows
+        ``readonly``.  With ``readonly=on,rom=off,share=off``, the guest
+        can write to memory backed by a read-only file: its writes are
+        copied on write into memory private to QEMU.  Many guests can
+        therefore start from a single image of a snapshot's RAM, on
+        tmpfs or hugetlbfs, and share its pages until they write to them.
+        Pages are faulted in from the file on first access, so
+        ``prealloc=on`` would defeat the sharing.
+
     ``-object memory-backend-ram,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave``
         Creates a memory backend object, which can be used to back the
         guest RAM. Memory backend objects offer more control than the
@@ -43,6 +43,7 @@
 #include "sysemu/runstate.h"
 #include "sysemu/cpu-timers.h"
 #include "sysemu/whpx.h"
+#include "sysemu/numa.h"
 #include "hw/boards.h"
 #include "hw/hw.h"
 #include "trace.h"
@@ -650,6 +651,8 @@ void qemu_init_vcpu(CPUState *cpu)
     while (!cpu->created) {
         qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
     }
+
+    numa_cpu_set_affinity(ms, cpu);
 }
 
 void cpu_stop_current(void)
@@ -15,6 +15,7 @@
 #include "qemu/main-loop.h"
 #include "sysemu/cpu-timers.h"
 #include "qemu/range.h"
+#include "qemu/units.h"
 
 /* #define DEBUG_IOMMU */
 
@@ -57,6 +58,19 @@ void qemu_sglist_destroy(QEMUSGList *qsg)
     memset(qsg, 0, sizeof(*qsg));
 }
 
+/*
+ * Segments that cannot be mapped directly, for example because the
+ * address space's bounce buffer is in use, are copied through a buffer
+ * private to the request, up to this many bytes per request.
+ */
+#define DMA_BOUNCE_MAX_SIZE (1 * MiB)
+
+typedef struct {
+    int iov_index;
+    dma_addr_t addr;
+    void *buf;
+} DMABounce;
+
 typedef struct {
     BlockAIOCB common;
     AioContext *ctx;
@@ -68,6 +82,8 @@ typedef struct {
     int sg_cur_index;
     dma_addr_t sg_cur_byte;
     QEMUIOVector iov;
+    GArray *bounce;
+    dma_addr_t bounce_size;
     QEMUBH *bh;
     DMAIOFunc *io_func;
     void *io_func_opaque;
@@ -85,16 +101,71 @@ static void reschedule_dma(void *opaque)
     dma_blk_cb(dbs, 0);
 }
 
-static void dma_blk_unmap(DMAAIOCB *dbs)
+static void *dma_blk_bounce(DMAAIOCB *dbs, dma_addr_t addr, dma_addr_t *len)
+{
+    DMABounce b = { .iov_index = dbs->iov.niov, .addr = addr };
+    dma_addr_t bounce_len = MIN(*len, DMA_BOUNCE_MAX_SIZE - dbs->bounce_size);
+
+    if (bounce_len == 0) {
+        return NULL;
+    }
+    b.buf = g_try_malloc(bounce_len);
+    if (!b.buf) {
+        return NULL;
+    }
+    if (dbs->dir == DMA_DIRECTION_TO_DEVICE) {
+        dma_memory_read(dbs->sg->as, addr, b.buf, bounce_len,
+                        MEMTXATTRS_UNSPECIFIED);
+    }
+    trace_dma_blk_bounce(dbs, addr, bounce_len);
+
+    g_array_append_val(dbs->bounce, b);
+    dbs->bounce_size += bounce_len;
+    *len = bounce_len;
+    return b.buf;
+}
+
+/* Copy the data read into the private bounce buffers to the guest.  */
+static void dma_blk_bounce_writeback(DMAAIOCB *dbs)
 {
     int i;
 
+    if (dbs->dir != DMA_DIRECTION_FROM_DEVICE) {
+        return;
+    }
+    for (i = 0; i < dbs->bounce->len; i++) {
+        DMABounce *b = &g_array_index(dbs->bounce, DMABounce, i);
+
+        /* The tail of the vector may have been discarded for alignment */
+        if (b->iov_index < dbs->iov.niov) {
+            dma_memory_write(dbs->sg->as, b->addr, b->buf,
+                             dbs->iov.iov[b->iov_index].iov_len,
+                             MEMTXATTRS_UNSPECIFIED);
+        }
+    }
+}
+
+static void dma_blk_unmap(DMAAIOCB *dbs)
+{
+    int i, j = 0;
+
     for (i = 0; i < dbs->iov.niov; ++i) {
+        if (j < dbs->bounce->len &&
+            g_array_index(dbs->bounce, DMABounce, j).iov_index == i) {
+            j++;
+            continue;
+        }
         dma_memory_unmap(dbs->sg->as, dbs->iov.iov[i].iov_base,
                          dbs->iov.iov[i].iov_len, dbs->dir,
                          dbs->iov.iov[i].iov_len);
     }
     qemu_iovec_reset(&dbs->iov);
+
+    for (j = 0; j < dbs->bounce->len; j++) {
+        g_free(g_array_index(dbs->bounce, DMABounce, j).buf);
+    }
+    g_array_set_size(dbs->bounce, 0);
+    dbs->bounce_size = 0;
 }
 
 static void dma_complete(DMAAIOCB *dbs, int ret)
@@ -107,6 +178,7 @@ static void dma_complete(DMAAIOCB *dbs, int ret)
         dbs->common.cb(dbs->common.opaque, ret);
     }
     qemu_iovec_destroy(&dbs->iov);
+    g_array_free(dbs->bounce, true);
     qemu_aio_unref(dbs);
 }
 
@@ -122,6 +194,9 @@ static void dma_blk_cb(void *opaque, int ret)
     aio_context_acquire(ctx);
     dbs->acb = NULL;
     dbs->offset += dbs->iov.size;
+    if (ret >= 0) {
+        dma_blk_bounce_writeback(dbs);
+    }
 
     if (dbs->sg_cur_index == dbs->sg->nsg || ret < 0) {
         dma_complete(dbs, ret);
@@ -130,6 +205,8 @@ static void dma_blk_cb(void *opaque, int ret)
     dma_blk_unmap(dbs);
 
     while (dbs->sg_cur_index < dbs->sg->nsg) {
+        bool overlap = false;
+
         cur_addr = dbs->sg->sg[dbs->sg_cur_index].base + dbs->sg_cur_byte;
         cur_len = dbs->sg->sg[dbs->sg_cur_index].len - dbs->sg_cur_byte;
         mem = dma_memory_map(dbs->sg->as, cur_addr, &cur_len, dbs->dir,
@@ -150,10 +227,19 @@ static void dma_blk_cb(void *opaque, int ret)
                     dma_memory_unmap(dbs->sg->as, mem, cur_len,
                                      dbs->dir, cur_len);
                     mem = NULL;
+                    overlap = true;
                     break;
                 }
             }
         }
+        /*
+         * Rather than splitting the request at a segment that cannot be
+         * mapped, copy it through a private buffer.
+         */
+        if (!mem && !overlap) {
+            cur_len = dbs->sg->sg[dbs->sg_cur_index].len - dbs->sg_cur_byte;
+            mem = dma_blk_bounce(dbs, cur_addr, &cur_len);
+        }
         if (!mem)
             break;
         qemu_iovec_add(&dbs->iov, mem, cur_len);
@@ -167,7 +253,7 @@ static void dma_blk_cb(void *opaque, int ret)
     if (dbs->iov.size == 0) {
         trace_dma_map_wait(dbs);
         dbs->bh = aio_bh_new(ctx, reschedule_dma, dbs);
-        cpu_register_map_client(dbs->bh);
+        address_space_register_map_client(dbs->sg->as, dbs->bh);
         goto out;
     }
 
@@ -197,7 +283,7 @@ static void dma_aio_cancel(BlockAIOCB *acb)
     }
 
     if (dbs->bh) {
-        cpu_unregister_map_client(dbs->bh);
+        address_space_unregister_map_client(dbs->sg->as, dbs->bh);
         qemu_bh_delete(dbs->bh);
         dbs->bh = NULL;
     }
@@ -241,6 +327,8 @@ BlockAIOCB *dma_blk_io(AioContext *ctx,
     dbs->io_func_opaque = io_func_opaque;
     dbs->bh = NULL;
     qemu_iovec_init(&dbs->iov, sg->nsg);
+    dbs->bounce = g_array_new(false, false, sizeof(DMABounce));
+    dbs->bounce_size = 0;
     dma_blk_cb(dbs, 0);
     return &dbs->common;
 }
@@ -50,6 +50,13 @@ static QTAILQ_HEAD(, AddressSpace) address_spaces
 
 static GHashTable *flat_views;
 
+/*
+ * Regions changed since the FlatViews were last rendered.  On commit,
+ * a FlatView is reused if none of these can be reached from its root.
+ */
+static GHashTable *memory_region_changed;
+static bool memory_region_changed_all;
+
 typedef struct AddrRange AddrRange;
 
 /*
@@ -574,6 +581,23 @@ static AddressSpace *memory_region_to_address_space(MemoryRegion *mr)
     return NULL;
 }
 
+/* Return the index of the first range in @view that ends after @addr. */
+static unsigned flatview_find_index(FlatView *view, Int128 addr)
+{
+    unsigned lo = 0, hi = view->nr;
+
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+
+        if (int128_ge(addr, addrrange_end(view->ranges[mid].addr))) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 /* Render a memory region into the global view.  Ranges in @view obscure
  * ranges in @mr.
  */
@@ -637,7 +661,8 @@ static void render_memory_region(FlatView *view,
     fr.nonvolatile = nonvolatile;
 
     /* Render the region itself into any gaps left by the current view. */
-    for (i = 0; i < view->nr && int128_nz(remain); ++i) {
+    for (i = flatview_find_index(view, base);
+         i < view->nr && int128_nz(remain); ++i) {
         if (int128_ge(base, addrrange_end(view->ranges[i].addr))) {
             continue;
         }
@@ -725,8 +750,29 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
-/* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+static bool flatview_equal(FlatView *a, FlatView *b)
+{
+    unsigned i;
+
+    if (a->nr != b->nr) {
+        return false;
+    }
+    for (i = 0; i < a->nr; i++) {
+        if (!flatrange_equal(&a->ranges[i], &b->ranges[i]) ||
+            a->ranges[i].dirty_log_mask != b->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Render a memory topology into a list of disjoint absolute ranges.
+ * If the result is the same as @old_view, return @old_view instead so
+ * that its dispatch tree is kept.
+ */
+static FlatView *generate_memory_topology(MemoryRegion *mr,
+                                          FlatView *old_view)
 {
     int i;
     FlatView *view;
@@ -740,6 +786,14 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    if (old_view && flatview_equal(view, old_view)) {
+        /* Not published yet, so there is no need to wait for RCU. */
+        flatview_destroy(view);
+        flatview_ref(old_view);
+        g_hash_table_replace(flat_views, mr, old_view);
+        return old_view;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -993,7 +1047,7 @@ static void flatviews_init(void)
     flat_views = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
                                        (GDestroyNotify) flatview_unref);
     if (!empty_view) {
-        empty_view = generate_memory_topology(NULL);
+        empty_view = generate_memory_topology(NULL, NULL);
         /* We keep it alive forever in the global variable.  */
         flatview_ref(empty_view);
     } else {
@@ -1002,26 +1056,92 @@ static void flatviews_init(void)
     }
 }
 
+static void memory_region_mark_changed(MemoryRegion *mr)
+{
+    if (!memory_region_changed) {
+        memory_region_changed = g_hash_table_new(NULL, NULL);
+    }
+    g_hash_table_add(memory_region_changed, mr);
+}
+
+/*
+ * Return true if a region marked by memory_region_mark_changed() can be
+ * reached from @mr through subregions or aliases.  @memo caches the
+ * answer for regions already visited, which aliases make common.
+ */
+static bool memory_region_tree_changed(MemoryRegion *mr, GHashTable *memo)
+{
+    MemoryRegion *subregion;
+    gpointer cached;
+    bool changed;
+
+    if (g_hash_table_contains(memory_region_changed, mr)) {
+        return true;
+    }
+    if (g_hash_table_lookup_extended(memo, mr, NULL, &cached)) {
+        return GPOINTER_TO_INT(cached);
+    }
+
+    changed = mr->alias && memory_region_tree_changed(mr->alias, memo);
+    QTAILQ_FOREACH(subregion, &mr->subregions, subregions_link) {
+        if (changed) {
+            break;
+        }
+        changed = memory_region_tree_changed(subregion, memo);
+    }
+    g_hash_table_insert(memo, mr, GINT_TO_POINTER(changed));
+    return changed;
+}
+
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
+    GHashTable *memo = NULL;
+    bool reuse;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /*
+     * While dirty tracking is on, the dirty log mask of a range also
+     * depends on RAMBlock state that is not tracked here.
+     */
+    reuse = old_views && memory_region_changed &&
+            !memory_region_changed_all && !global_dirty_tracking;
+    if (reuse) {
+        memo = g_hash_table_new(NULL, NULL);
+    }
+
+    /* Render unique FVs, keeping those whose regions did not change */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *old_view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
-        generate_memory_topology(physmr);
+        old_view = old_views ? g_hash_table_lookup(old_views, physmr) : NULL;
+        if (reuse && old_view && !memory_region_tree_changed(physmr, memo)) {
+            flatview_ref(old_view);
+            g_hash_table_replace(flat_views, physmr, old_view);
+            continue;
+        }
+
+        generate_memory_topology(physmr, old_view);
+    }
+
+    if (memo) {
+        g_hash_table_destroy(memo);
     }
+    if (old_views) {
+        g_hash_table_unref(old_views);
+    }
+    if (memory_region_changed) {
+        g_hash_table_remove_all(memory_region_changed);
+    }
+    memory_region_changed_all = false;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1033,6 +1153,16 @@ static void address_space_set_flatview(AddressSpace *as)
     assert(new_view);
 
     if (old_view == new_view) {
+        FlatRange *fr;
+
+        /*
+         * The view was reused because nothing in it changed, but
+         * listeners that rebuild their state on every commit still
+         * expect to be told about each range.
+         */
+        FOR_EACH_FLAT_RANGE(fr, new_view) {
+            MEMORY_LISTENER_UPDATE_REGION(fr, as, Forward, region_nop);
+        }
         return;
     }
 
@@ -1075,7 +1205,7 @@ static void address_space_update_topology(AddressSpace *as)
 
     flatviews_init();
     if (!g_hash_table_lookup(flat_views, physmr)) {
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr, NULL);
     }
     address_space_set_flatview(as);
 }
@@ -1450,6 +1580,7 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
                                            mr->alias_offset + addr,
                                            pval, op, attrs);
     }
+    stat64_inc(&mr->nb_reads);
     if (!memory_region_access_valid(mr, addr, size, false, attrs)) {
         *pval = unassigned_mem_read(mr, addr, size);
         return MEMTX_DECODE_ERROR;
@@ -1499,6 +1630,7 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                             mr->alias_offset + addr,
                                             data, op, attrs);
     }
+    stat64_inc(&mr->nb_writes);
     if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
         unassigned_mem_write(mr, addr, data, size);
         return MEMTX_DECODE_ERROR;
@@ -2220,6 +2352,7 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
+    memory_region_mark_changed(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2350,6 +2483,7 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
+        memory_region_mark_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2360,6 +2494,7 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
+        memory_region_mark_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2370,6 +2505,7 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
+        memory_region_mark_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2615,6 +2751,7 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
+    memory_region_mark_changed(mr);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
@@ -2665,6 +2802,7 @@ void memory_region_del_subregion(MemoryRegion *mr,
     }
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
+    memory_region_mark_changed(mr);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
@@ -2676,6 +2814,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
+    memory_region_mark_changed(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2692,6 +2831,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
+    memory_region_mark_changed(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2728,6 +2868,7 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
+    memory_region_mark_changed(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2899,6 +3040,7 @@ void memory_global_dirty_log_start(unsigned int flags)
     if (!old_flags) {
         MEMORY_LISTENER_CALL_GLOBAL(log_global_start, Forward);
         memory_region_transaction_begin();
+        memory_region_changed_all = true;
         memory_region_update_pending = true;
         memory_region_transaction_commit();
     }
@@ -2914,6 +3056,7 @@ static void memory_global_dirty_log_do_stop(unsigned int flags)
 
     if (!global_dirty_tracking) {
         memory_region_transaction_begin();
+        memory_region_changed_all = true;
         memory_region_update_pending = true;
         memory_region_transaction_commit();
         MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
@@ -3086,6 +3229,10 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     as->ioeventfds = NULL;
     QTAILQ_INIT(&as->listeners);
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
+    as->max_bounce_buffer_size = DEFAULT_MAX_BOUNCE_BUFFER_SIZE;
+    as->bounce_buffer_size = 0;
+    qemu_mutex_init(&as->map_client_list_lock);
+    QLIST_INIT(&as->map_client_list);
     as->name = g_strdup(name ? name : "anonymous");
     address_space_update_topology(as);
     address_space_update_ioeventfds(as);
@@ -3093,6 +3240,10 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
 
 static void do_address_space_destroy(AddressSpace *as)
 {
+    assert(qatomic_read(&as->bounce_buffer_size) == 0);
+    assert(QLIST_EMPTY(&as->map_client_list));
+    qemu_mutex_destroy(&as->map_client_list_lock);
+
     assert(QTAILQ_EMPTY(&as->listeners));
 
     flatview_unref(as->current_map);
@@ -3186,10 +3337,20 @@ static void mtree_print_mr_owner(const MemoryRegion *mr)
     }
 }
 
+static void mtree_print_mr_counts(const MemoryRegion *mr)
+{
+    /* Only regions whose accesses go through their ops */
+    if (mr->terminates && (!mr->ram || mr->ram_device)) {
+        qemu_printf(" accesses:{r %" PRIu64 " w %" PRIu64 "%s}",
+                    stat64_get(&mr->nb_reads), stat64_get(&mr->nb_writes),
+                    mr->ops->lockless ? " lockless" : "");
+    }
+}
+
 static void mtree_print_mr(const MemoryRegion *mr, unsigned int level,
                            hwaddr base,
                            MemoryRegionListHead *alias_print_queue,
-                           bool owner, bool display_disabled)
+                           bool owner, bool display_disabled, bool counts)
 {
     MemoryRegionList *new_ml, *ml, *next_ml;
     MemoryRegionListHead submr_print_queue;
@@ -3266,6 +3427,9 @@ static void mtree_print_mr(const MemoryRegion *mr, unsigned int level,
             if (owner) {
                 mtree_print_mr_owner(mr);
             }
+            if (counts) {
+                mtree_print_mr_counts(mr);
+            }
             qemu_printf("\n");
         }
     }
@@ -3291,7 +3455,7 @@ static void mtree_print_mr(const MemoryRegion *mr, unsigned int level,
 
     QTAILQ_FOREACH(ml, &submr_print_queue, mrqueue) {
         mtree_print_mr(ml->mr, level + 1, cur_start,
-                       alias_print_queue, owner, display_disabled);
+                       alias_print_queue, owner, display_disabled, counts);
     }
 
     QTAILQ_FOREACH_SAFE(ml, &submr_print_queue, mrqueue, next_ml) {
@@ -3444,6 +3608,7 @@ struct AddressSpaceInfo {
     MemoryRegionListHead *ml_head;
     bool owner;
     bool disabled;
+    bool counts;
 };
 
 /* Returns negative value if a < b; zero if a = b; positive value if a > b. */
@@ -3469,7 +3634,8 @@ static void mtree_print_as(gpointer key, gpointer value, gpointer user_data)
     struct AddressSpaceInfo *asi = user_data;
 
     g_slist_foreach(as_same_root_mr_list, mtree_print_as_name, NULL);
-    mtree_print_mr(mr, 1, 0, asi->ml_head, asi->owner, asi->disabled);
+    mtree_print_mr(mr, 1, 0, asi->ml_head, asi->owner, asi->disabled,
+                   asi->counts);
     qemu_printf("\n");
 }
 
@@ -3483,7 +3649,8 @@ static gboolean mtree_info_as_free(gpointer key, gpointer value,
     return true;
 }
 
-static void mtree_info_as(bool dispatch_tree, bool owner, bool disabled)
+static void mtree_info_as(bool dispatch_tree, bool owner, bool disabled,
+                          bool counts)
 {
     MemoryRegionListHead ml_head;
     MemoryRegionList *ml, *ml2;
@@ -3494,6 +3661,7 @@ static void mtree_info_as(bool dispatch_tree, bool owner, bool disabled)
         .ml_head = &ml_head,
         .owner = owner,
         .disabled = disabled,
+        .counts = counts,
     };
 
     QTAILQ_INIT(&ml_head);
@@ -3514,7 +3682,7 @@ static void mtree_info_as(bool dispatch_tree, bool owner, bool disabled)
     /* print aliased regions */
     QTAILQ_FOREACH(ml, &ml_head, mrqueue) {
         qemu_printf("memory-region: %s\n", memory_region_name(ml->mr));
-        mtree_print_mr(ml->mr, 1, 0, &ml_head, owner, disabled);
+        mtree_print_mr(ml->mr, 1, 0, &ml_head, owner, disabled, counts);
         qemu_printf("\n");
     }
 
@@ -3523,12 +3691,13 @@ static void mtree_info_as(bool dispatch_tree, bool owner, bool disabled)
     }
 }
 
-void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled)
+void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled,
+                bool counts)
 {
     if (flatview) {
         mtree_info_flatview(dispatch_tree, owner);
     } else {
-        mtree_info_as(dispatch_tree, owner, disabled);
+        mtree_info_as(dispatch_tree, owner, disabled, counts);
     }
 }
 
@@ -1874,7 +1874,8 @@ RAMBlock *qemu_ram_alloc_from_fd(ram_addr_t size, MemoryRegion *mr,
 
     /* Just support these ram flags by now. */
     assert((ram_flags & ~(RAM_SHARED | RAM_PMEM | RAM_NORESERVE |
-                          RAM_PROTECTED)) == 0);
+                          RAM_PROTECTED | RAM_READONLY_FD)) == 0);
+    assert(!(ram_flags & RAM_READONLY_FD) || !(ram_flags & RAM_SHARED));
 
     if (xen_enabled()) {
         error_setg(errp, "-mem-path not supported with Xen");
@@ -1895,6 +1896,10 @@ RAMBlock *qemu_ram_alloc_from_fd(ram_addr_t size, MemoryRegion *mr,
                    file_size, size);
         return NULL;
     }
+    if ((ram_flags & RAM_READONLY_FD) && !file_size) {
+        error_setg(errp, "read-only backing store is empty");
+        return NULL;
+    }
 
     file_align = get_file_align(fd);
     if (file_align > 0 && file_align > mr->align) {
@@ -1935,7 +1940,8 @@ RAMBlock *qemu_ram_alloc_from_file(ram_addr_t size, MemoryRegion *mr,
     bool created;
     RAMBlock *block;
 
-    fd = file_ram_open(mem_path, memory_region_name(mr), readonly, &created,
+    fd = file_ram_open(mem_path, memory_region_name(mr),
+                       readonly || (ram_flags & RAM_READONLY_FD), &created,
                        errp);
     if (fd < 0) {
         return NULL;
@@ -2093,6 +2099,62 @@ void qemu_ram_remap(ram_addr_t addr, ram_addr_t length)
         }
     }
 }
+
+int qemu_ram_remap_fd(RAMBlock *block, int fd, Error **errp)
+{
+    struct stat st;
+    void *area;
+    int flags, ret;
+
+    if (!(block->flags & RAM_SHARED) || block->fd < 0) {
+        error_setg(errp, "RAM block %s is not backed by shared memory",
+                   block->idstr);
+        return -EINVAL;
+    }
+    if (fstat(fd, &st) < 0) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Could not stat the memory of %s",
+                         block->idstr);
+        return ret;
+    }
+    if (st.st_size < block->max_length) {
+        error_setg(errp, "Memory of %s is too small: 0x%" PRIx64
+                   " < 0x" RAM_ADDR_FMT, block->idstr, (uint64_t)st.st_size,
+                   block->max_length);
+        return -EINVAL;
+    }
+    if (qemu_fd_getpagesize(fd) != block->page_size) {
+        error_setg(errp, "Mismatched page size for %s: %zu != %zu",
+                   block->idstr, qemu_fd_getpagesize(fd), block->page_size);
+        return -EINVAL;
+    }
+
+    /*
+     * Replace the mapping in place, so that nothing that cached the host
+     * address of the block (memory listeners, KVM memory slots) notices.
+     */
+    flags = MAP_FIXED | MAP_SHARED;
+    flags |= block->flags & RAM_NORESERVE ? MAP_NORESERVE : 0;
+    area = mmap(block->host, block->max_length, PROT_READ | PROT_WRITE,
+                flags, fd, 0);
+    if (area != block->host) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Could not remap %s", block->idstr);
+        return ret;
+    }
+    memory_try_enable_merging(block->host, block->max_length);
+    qemu_ram_setup_dump(block->host, block->max_length);
+
+    close(block->fd);
+    block->fd = fd;
+    return 0;
+}
+#else
+int qemu_ram_remap_fd(RAMBlock *block, int fd, Error **errp)
+{
+    error_setg(errp, "Remapping RAM blocks is not supported on this host");
+    return -ENOTSUP;
+}
 #endif /* !_WIN32 */
 
 /* Return a host pointer to ram allocated with qemu_ram_alloc.
@@ -2577,6 +2639,9 @@ bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool release_lock = false;
 
+    if (mr->ops->lockless && !mr->flush_coalesced_mmio) {
+        return false;
+    }
     if (!qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         release_lock = true;
@@ -2615,6 +2680,38 @@ static bool flatview_access_allowed(MemoryRegion *mr, MemTxAttrs attrs,
     return false;
 }
 
+/*
+ * Consecutive RAM chunks of a transfer often belong to the same
+ * MemoryRegion, for example when aliases split it into several
+ * sections.  Coalesce their dirty tracking and TB invalidation.
+ */
+typedef struct DirtyRange {
+    MemoryRegion *mr;
+    hwaddr addr;
+    hwaddr len;
+} DirtyRange;
+
+static void dirty_range_flush(DirtyRange *d)
+{
+    if (d->len) {
+        invalidate_and_set_dirty(d->mr, d->addr, d->len);
+        d->len = 0;
+    }
+}
+
+static void dirty_range_add(DirtyRange *d, MemoryRegion *mr,
+                            hwaddr addr, hwaddr len)
+{
+    if (d->len && (d->mr != mr || d->addr + d->len != addr)) {
+        dirty_range_flush(d);
+    }
+    if (!d->len) {
+        d->mr = mr;
+        d->addr = addr;
+    }
+    d->len += len;
+}
+
 /* Called within RCU critical section.  */
 static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
                                            MemTxAttrs attrs,
@@ -2627,12 +2724,18 @@ static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
     MemTxResult result = MEMTX_OK;
     bool release_lock = false;
     const uint8_t *buf = ptr;
+    DirtyRange dirty = { .len = 0 };
+    hwaddr start = addr, total = len;
+    unsigned chunks = 0;
 
     for (;;) {
+        chunks++;
         if (!flatview_access_allowed(mr, attrs, addr1, l)) {
             result |= MEMTX_ACCESS_ERROR;
             /* Keep going. */
         } else if (!memory_access_is_direct(mr, true)) {
+            /* The device may look at the RAM written so far.  */
+            dirty_range_flush(&dirty);
             release_lock |= prepare_mmio_access(mr);
             l = memory_access_size(mr, l, addr1);
             /* XXX: could force current_cpu to NULL to avoid
@@ -2644,7 +2747,7 @@ static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
             /* RAM case */
             ram_ptr = qemu_ram_ptr_length(mr->ram_block, addr1, &l, false);
             memmove(ram_ptr, buf, l);
-            invalidate_and_set_dirty(mr, addr1, l);
+            dirty_range_add(&dirty, mr, addr1, l);
         }
 
         if (release_lock) {
@@ -2663,7 +2766,13 @@ static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
         l = len;
         mr = flatview_translate(fv, addr, &addr1, &l, true, attrs);
     }
+    dirty_range_flush(&dirty);
 
+    if (chunks == 1 && memory_access_is_direct(mr, true)) {
+        trace_flatview_access_direct(start, total, true);
+    } else {
+        trace_flatview_access_split(start, total, chunks, true);
+    }
     return result;
 }
 
@@ -2695,9 +2804,12 @@ MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
     MemTxResult result = MEMTX_OK;
     bool release_lock = false;
     uint8_t *buf = ptr;
+    hwaddr start = addr, total = len;
+    unsigned chunks = 0;
 
     fuzz_dma_read_cb(addr, len, mr);
     for (;;) {
+        chunks++;
         if (!flatview_access_allowed(mr, attrs, addr1, l)) {
             result |= MEMTX_ACCESS_ERROR;
             /* Keep going. */
@@ -2731,6 +2843,11 @@ MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
         mr = flatview_translate(fv, addr, &addr1, &l, false, attrs);
     }
 
+    if (chunks == 1 && memory_access_is_direct(mr, false)) {
+        trace_flatview_access_direct(start, total, false);
+    } else {
+        trace_flatview_access_split(start, total, chunks, false);
+    }
     return result;
 }
 
@@ -2797,13 +2914,29 @@ MemTxResult address_space_set(AddressSpace *as, hwaddr addr,
 {
 #define FILLBUF_SIZE 512
     uint8_t fillbuf[FILLBUF_SIZE];
-    int l;
+    hwaddr l, addr1;
+    MemoryRegion *mr;
     MemTxResult error = MEMTX_OK;
+    FlatView *fv;
 
     memset(fillbuf, c, FILLBUF_SIZE);
+
+    RCU_READ_LOCK_GUARD();
+    fv = address_space_to_flatview(as);
     while (len > 0) {
-        l = len < FILLBUF_SIZE ? len : FILLBUF_SIZE;
-        error |= address_space_write(as, addr, attrs, fillbuf, l);
+        l = len;
+        mr = flatview_translate(fv, addr, &addr1, &l, true, attrs);
+        if (memory_access_is_direct(mr, true) &&
+            flatview_access_allowed(mr, attrs, addr1, l)) {
+            /* Fill whole RAM sections at once */
+            uint8_t *ram_ptr = qemu_ram_ptr_length(mr->ram_block, addr1, &l,
+                                                   false);
+            memset(ram_ptr, c, l);
+            invalidate_and_set_dirty(mr, addr1, l);
+        } else {
+            l = MIN(l, FILLBUF_SIZE);
+            error |= flatview_write(fv, addr, attrs, fillbuf, l);
+        }
         len -= l;
         addr += l;
     }
@@ -2890,55 +3023,47 @@ void cpu_flush_icache_range(hwaddr start, hwaddr len)
                                      NULL, len, FLUSH_CACHE);
 }
 
+#define BOUNCE_BUFFER_MAGIC 0xb4017ceb4ffe12ed
+
 typedef struct {
+    uint64_t magic;
     MemoryRegion *mr;
-    void *buffer;
     hwaddr addr;
-    hwaddr len;
-    bool in_use;
+    size_t len;
+    uint8_t buffer[];
 } BounceBuffer;
 
-static BounceBuffer bounce;
-
-typedef struct MapClient {
-    QEMUBH *bh;
-    QLIST_ENTRY(MapClient) link;
-} MapClient;
-
-QemuMutex map_client_list_lock;
-static QLIST_HEAD(, MapClient) map_client_list
-    = QLIST_HEAD_INITIALIZER(map_client_list);
-
-static void cpu_unregister_map_client_do(MapClient *client)
+static void
+address_space_unregister_map_client_do(AddressSpaceMapClient *client)
 {
     QLIST_REMOVE(client, link);
     g_free(client);
 }
 
-static void cpu_notify_map_clients_locked(void)
+static void address_space_notify_map_clients_locked(AddressSpace *as)
 {
-    MapClient *client;
+    AddressSpaceMapClient *client;
 
-    while (!QLIST_EMPTY(&map_client_list)) {
-        client = QLIST_FIRST(&map_client_list);
+    while (!QLIST_EMPTY(&as->map_client_list)) {
+        client = QLIST_FIRST(&as->map_client_list);
         qemu_bh_schedule(client->bh);
-        cpu_unregister_map_client_do(client);
+        address_space_unregister_map_client_do(client);
     }
 }
 
-void cpu_register_map_client(QEMUBH *bh)
+void address_space_register_map_client(AddressSpace *as, QEMUBH *bh)
 {
-    MapClient *client = g_malloc(sizeof(*client));
+    AddressSpaceMapClient *client = g_malloc(sizeof(*client));
 
-    qemu_mutex_lock(&map_client_list_lock);
+    qemu_mutex_lock(&as->map_client_list_lock);
     client->bh = bh;
-    QLIST_INSERT_HEAD(&map_client_list, client, link);
-    /* Write map_client_list before reading in_use.  */
+    QLIST_INSERT_HEAD(&as->map_client_list, client, link);
+    /* Write map_client_list before reading bounce_buffer_size.  */
     smp_mb();
-    if (!qatomic_read(&bounce.in_use)) {
-        cpu_notify_map_clients_locked();
+    if (qatomic_read(&as->bounce_buffer_size) < as->max_bounce_buffer_size) {
+        address_space_notify_map_clients_locked(as);
     }
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_unlock(&as->map_client_list_lock);
 }
 
 void cpu_exec_init_all(void)
@@ -2954,28 +3079,27 @@ void cpu_exec_init_all(void)
     finalize_target_page_bits();
     io_mem_init();
     memory_map_init();
-    qemu_mutex_init(&map_client_list_lock);
 }
 
-void cpu_unregister_map_client(QEMUBH *bh)
+void address_space_unregister_map_client(AddressSpace *as, QEMUBH *bh)
 {
-    MapClient *client;
+    AddressSpaceMapClient *client;
 
-    qemu_mutex_lock(&map_client_list_lock);
-    QLIST_FOREACH(client, &map_client_list, link) {
+    qemu_mutex_lock(&as->map_client_list_lock);
+    QLIST_FOREACH(client, &as->map_client_list, link) {
         if (client->bh == bh) {
-            cpu_unregister_map_client_do(client);
+            address_space_unregister_map_client_do(client);
             break;
         }
     }
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_unlock(&as->map_client_list_lock);
 }
 
-static void cpu_notify_map_clients(void)
+static void address_space_notify_map_clients(AddressSpace *as)
 {
-    qemu_mutex_lock(&map_client_list_lock);
-    cpu_notify_map_clients_locked();
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_lock(&as->map_client_list_lock);
+    address_space_notify_map_clients_locked(as);
+    qemu_mutex_unlock(&as->map_client_list_lock);
 }
 
 static bool flatview_access_valid(FlatView *fv, hwaddr addr, hwaddr len,
@@ -3042,8 +3166,8 @@ flatview_extend_translation(FlatView *fv, hwaddr addr,
  * May map a subset of the requested range, given by and returned in *plen.
  * May return NULL if resources needed to perform the mapping are exhausted.
  * Use only for reads OR writes - not for read-modify-write operations.
- * Use cpu_register_map_client() to know when retrying the map operation is
- * likely to succeed.
+ * Use address_space_register_map_client() to know when retrying the map
+ * operation is likely to succeed.
  */
 void *address_space_map(AddressSpace *as,
                         hwaddr addr,
@@ -3066,25 +3190,41 @@ void *address_space_map(AddressSpace *as,
     mr = flatview_translate(fv, addr, &xlat, &l, is_write, attrs);
 
     if (!memory_access_is_direct(mr, is_write)) {
-        if (qatomic_xchg(&bounce.in_use, true)) {
+        size_t used = qatomic_read(&as->bounce_buffer_size);
+        BounceBuffer *bounce;
+
+        /* Reserve as much of the request as the address space allows. */
+        for (;;) {
+            hwaddr alloc = used < as->max_bounce_buffer_size ?
+                           MIN(as->max_bounce_buffer_size - used, l) : 0;
+            size_t actual = qatomic_cmpxchg(&as->bounce_buffer_size,
+                                            used, used + alloc);
+            if (actual == used) {
+                l = alloc;
+                break;
+            }
+            used = actual;
+        }
+
+        if (l == 0) {
             *plen = 0;
             return NULL;
         }
-        /* Avoid unbounded allocations */
-        l = MIN(l, TARGET_PAGE_SIZE);
-        bounce.buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
-        bounce.addr = addr;
-        bounce.len = l;
 
+        bounce = g_malloc0(l + sizeof(BounceBuffer));
+        bounce->magic = BOUNCE_BUFFER_MAGIC;
         memory_region_ref(mr);
-        bounce.mr = mr;
+        bounce->mr = mr;
+        bounce->addr = addr;
+        bounce->len = l;
+
         if (!is_write) {
             flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED,
-                               bounce.buffer, l);
+                          bounce->buffer, l);
         }
 
         *plen = l;
-        return bounce.buffer;
+        return bounce->buffer;
     }
 
 
@@ -3102,12 +3242,12 @@ void *address_space_map(AddressSpace *as,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          bool is_write, hwaddr access_len)
 {
-    if (buffer != bounce.buffer) {
-        MemoryRegion *mr;
-        ram_addr_t addr1;
+    MemoryRegion *mr;
+    ram_addr_t addr1;
+    BounceBuffer *bounce;
 
-        mr = memory_region_from_host(buffer, &addr1);
-        assert(mr != NULL);
+    mr = memory_region_from_host(buffer, &addr1);
+    if (mr != NULL) {
         if (is_write) {
             invalidate_and_set_dirty(mr, addr1, access_len);
         }
@@ -3117,16 +3257,22 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
         memory_region_unref(mr);
         return;
     }
+
+    bounce = container_of(buffer, BounceBuffer, buffer);
+    assert(bounce->magic == BOUNCE_BUFFER_MAGIC);
+
     if (is_write) {
-        address_space_write(as, bounce.addr, MEMTXATTRS_UNSPECIFIED,
-                            bounce.buffer, access_len);
+        address_space_write(as, bounce->addr, MEMTXATTRS_UNSPECIFIED,
+                            bounce->buffer, access_len);
     }
-    qemu_vfree(bounce.buffer);
-    bounce.buffer = NULL;
-    memory_region_unref(bounce.mr);
-    /* Clear in_use before reading map_client_list.  */
-    qatomic_mb_set(&bounce.in_use, false);
-    cpu_notify_map_clients();
+
+    qatomic_sub(&as->bounce_buffer_size, bounce->len);
+    bounce->magic = ~BOUNCE_BUFFER_MAGIC;
+    memory_region_unref(bounce->mr);
+    g_free(bounce);
+    /* Write bounce_buffer_size before reading map_client_list.  */
+    smp_mb();
+    address_space_notify_map_clients(as);
 }
 
 void *cpu_physical_memory_map(hwaddr addr,
@@ -3419,9 +3565,14 @@ int ram_block_discard_range(RAMBlock *rb, uint64_t start, size_t length)
          *    madvise DONTNEED fails for hugepages
          *    fallocate works on hugepages and shmem
          *    shared anonymous memory requires madvise REMOVE
+         *    private file mappings must not punch holes in the file,
+         *    which other processes may map too (and for RAM_READONLY_FD
+         *    is not writable); madvise DONTNEED drops the private copies
+         *    and the pages read from the file again
          */
-        need_madvise = (rb->page_size == qemu_host_page_size);
-        need_fallocate = rb->fd != -1;
+        need_madvise = (rb->page_size == qemu_host_page_size) ||
+                       (rb->fd != -1 && !qemu_ram_is_shared(rb));
+        need_fallocate = rb->fd != -1 && qemu_ram_is_shared(rb);
         if (need_fallocate) {
             /* For a file, this causes the area of the file to be zero'd
              * if read, and for hugetlbfs also causes it to be unmapped
@@ -50,6 +50,15 @@ static void async_synic_update(CPUState *cs, run_on_cpu_data data)
     qemu_mutex_unlock_iothread();
 }
 
+/*
+ * Like hyperv_x86_synic_update, but from the vCPU thread once all vCPUs
+ * are quiescent, for callers that can't take the BQL themselves.
+ */
+void hyperv_x86_synic_update_async(X86CPU *cpu)
+{
+    async_safe_run_on_cpu(CPU(cpu), async_synic_update, RUN_ON_CPU_NULL);
+}
+
 int kvm_hv_handle_exit(X86CPU *cpu, struct kvm_hyperv_exit *exit)
 {
     CPUX86State *env = &cpu->env;
@@ -13,6 +13,7 @@
 #include "sysemu/tcg.h"
 
 #include "qemu/error-report.h"
+#include "qemu/main-loop.h"
 
 static const VMStateDescription vmstate_segment = {
     .name = "segment",
@@ -845,6 +846,16 @@ static bool hyperv_synic_enable_needed(void *opaque)
 static int hyperv_synic_post_load(void *opaque, int version_id)
 {
     X86CPU *cpu = opaque;
+
+    /*
+     * With parallel-device-state, the cpu section is loaded by threads
+     * that don't hold the BQL; the SynIC pages are memory regions, so
+     * leave the update to the vCPU thread, before the vCPU runs again.
+     */
+    if (!qemu_mutex_iothread_locked()) {
+        hyperv_x86_synic_update_async(cpu);
+        return 0;
+    }
     hyperv_x86_synic_update(cpu);
     return 0;
 }
@@ -1609,6 +1620,11 @@ const VMStateDescription vmstate_x86_cpu = {
     .name = "cpu",
     .version_id = 12,
     .minimum_version_id = 11,
+    /*
+     * Only each vCPU's own state is touched, it is stopped meanwhile;
+     * see hyperv_synic_post_load for the SynIC pages.
+     */
+    .independent = true,
     .pre_save = cpu_pre_save,
     .post_load = cpu_post_load,
     .fields = (VMStateField[]) {
@@ -25,6 +25,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/int128.h"
+#include "qemu/interval-tree.h"
 #include "tcg/tcg-op.h"
 #include "tcg-internal.h"
 
@@ -37,20 +38,46 @@
         glue(glue(case INDEX_op_, x), _i64):    \
         glue(glue(case INDEX_op_, x), _vec)
 
+/* Number of entries, and maximum number of arguments, for CSE. */
+#define CSE_TABLE_BITS  6
+#define CSE_TABLE_SIZE  (1 << CSE_TABLE_BITS)
+#define CSE_MAX_ARGS    6
+
+/* A range of env which is known to hold the value of a temp. */
+typedef struct MemCopyInfo {
+    IntervalTreeNode itree;
+    QSIMPLEQ_ENTRY (MemCopyInfo) next;
+    TCGTemp *ts;
+    TCGType type;
+} MemCopyInfo;
+
 typedef struct TempOptInfo {
     bool is_const;
     TCGTemp *prev_copy;
     TCGTemp *next_copy;
+    QSIMPLEQ_HEAD(, MemCopyInfo) mem_copy;
+    uint32_t gen;     /* incremented each time the temp is reset */
     uint64_t val;
     uint64_t z_mask;  /* mask bit is 0 if and only if value bit is 0 */
     uint64_t s_mask;  /* a left-aligned mask of clrsb(value) bits. */
 } TempOptInfo;
 
+/* A previously computed pure operation, and the state of its temps. */
+typedef struct CSEEntry {
+    TCGOp *op;
+    uint32_t gen[CSE_MAX_ARGS];
+} CSEEntry;
+
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
     TCGTempSet temps_used;
 
+    IntervalTreeRoot mem_copy;
+    QSIMPLEQ_HEAD(, MemCopyInfo) mem_free;
+
+    CSEEntry cse[CSE_TABLE_SIZE];
+
     /* In flight values from optimization. */
     uint64_t a_mask;  /* mask bit is 0 iff value identical to first input */
     uint64_t z_mask;  /* mask bit is 0 iff value bit is 0 */
@@ -122,12 +149,43 @@ static inline bool ts_is_copy(TCGTemp *ts)
     return ts_info(ts)->next_copy != ts;
 }
 
+static TCGTemp *find_better_copy(TCGContext *s, TCGTemp *ts);
+
+static inline MemCopyInfo *mem_copy_first(OptContext *ctx,
+                                          intptr_t s, intptr_t l)
+{
+    IntervalTreeNode *r = interval_tree_iter_first(&ctx->mem_copy, s, l);
+    return r ? container_of(r, MemCopyInfo, itree) : NULL;
+}
+
+static inline MemCopyInfo *mem_copy_next(MemCopyInfo *mem,
+                                         intptr_t s, intptr_t l)
+{
+    IntervalTreeNode *r = interval_tree_iter_next(&mem->itree, s, l);
+    return r ? container_of(r, MemCopyInfo, itree) : NULL;
+}
+
+/* Transfer all memory copies recorded for SRC_TS to DST_TS.  */
+static void move_mem_copies(TCGTemp *dst_ts, TCGTemp *src_ts)
+{
+    TempOptInfo *si = ts_info(src_ts);
+    TempOptInfo *di = ts_info(dst_ts);
+    MemCopyInfo *mc;
+
+    QSIMPLEQ_FOREACH(mc, &si->mem_copy, next) {
+        tcg_debug_assert(mc->ts == src_ts);
+        mc->ts = dst_ts;
+    }
+    QSIMPLEQ_CONCAT(&di->mem_copy, &si->mem_copy);
+}
+
 /* Reset TEMP's state, possibly removing the temp for the list of copies.  */
-static void reset_ts(TCGTemp *ts)
+static void reset_ts(OptContext *ctx, TCGTemp *ts)
 {
     TempOptInfo *ti = ts_info(ts);
+    TCGTemp *nts = ti->next_copy;
     TempOptInfo *pi = ts_info(ti->prev_copy);
-    TempOptInfo *ni = ts_info(ti->next_copy);
+    TempOptInfo *ni = ts_info(nts);
 
     ni->prev_copy = ti->prev_copy;
     pi->next_copy = ti->next_copy;
@@ -136,11 +194,92 @@ static void reset_ts(TCGTemp *ts)
     ti->is_const = false;
     ti->z_mask = -1;
     ti->s_mask = 0;
+    ti->gen++;
+
+    if (!QSIMPLEQ_EMPTY(&ti->mem_copy)) {
+        if (ts == nts) {
+            /* Last temp copy being removed, the mem copies die. */
+            MemCopyInfo *mc;
+            QSIMPLEQ_FOREACH(mc, &ti->mem_copy, next) {
+                interval_tree_remove(&mc->itree, &ctx->mem_copy);
+            }
+            QSIMPLEQ_CONCAT(&ctx->mem_free, &ti->mem_copy);
+        } else {
+            move_mem_copies(find_better_copy(ctx->tcg, nts), ts);
+        }
+    }
+}
+
+static void reset_temp(OptContext *ctx, TCGArg arg)
+{
+    reset_ts(ctx, arg_temp(arg));
+}
+
+/* Record that env[START..LAST] holds the value of TS.  */
+static void record_mem_copy(OptContext *ctx, TCGType type,
+                            TCGTemp *ts, intptr_t start, intptr_t last)
+{
+    MemCopyInfo *mc;
+    TempOptInfo *ti;
+
+    mc = QSIMPLEQ_FIRST(&ctx->mem_free);
+    if (mc) {
+        QSIMPLEQ_REMOVE_HEAD(&ctx->mem_free, next);
+    } else {
+        mc = tcg_malloc(sizeof(*mc));
+    }
+
+    memset(mc, 0, sizeof(*mc));
+    mc->itree.start = start;
+    mc->itree.last = last;
+    mc->type = type;
+    interval_tree_insert(&mc->itree, &ctx->mem_copy);
+
+    ts = find_better_copy(ctx->tcg, ts);
+    ti = ts_info(ts);
+    mc->ts = ts;
+    QSIMPLEQ_INSERT_TAIL(&ti->mem_copy, mc, next);
 }
 
-static void reset_temp(TCGArg arg)
+static void remove_mem_copy(OptContext *ctx, MemCopyInfo *mc)
 {
-    reset_ts(arg_temp(arg));
+    TCGTemp *ts = mc->ts;
+    TempOptInfo *ti = ts_info(ts);
+
+    interval_tree_remove(&mc->itree, &ctx->mem_copy);
+    QSIMPLEQ_REMOVE(&ti->mem_copy, mc, MemCopyInfo, next);
+    QSIMPLEQ_INSERT_TAIL(&ctx->mem_free, mc, next);
+}
+
+/* Forget everything known about env[S..L].  */
+static void remove_mem_copy_in(OptContext *ctx, intptr_t s, intptr_t l)
+{
+    while (true) {
+        MemCopyInfo *mc = mem_copy_first(ctx, s, l);
+        if (!mc) {
+            break;
+        }
+        remove_mem_copy(ctx, mc);
+    }
+}
+
+static void remove_mem_copy_all(OptContext *ctx)
+{
+    remove_mem_copy_in(ctx, 0, -1);
+    tcg_debug_assert(interval_tree_is_empty(&ctx->mem_copy));
+}
+
+/* Return a temp holding the value of TYPE stored at env + S, if known.  */
+static TCGTemp *find_mem_copy_for(OptContext *ctx, TCGType type, intptr_t s)
+{
+    MemCopyInfo *mc;
+
+    for (mc = mem_copy_first(ctx, s, s); mc; mc = mem_copy_next(mc, s, s)) {
+        if (mc->itree.start == s && mc->type == type) {
+            return find_better_copy(ctx->tcg, mc->ts);
+        }
+    }
+    return NULL;
 }
 
 /* Initialize and activate a temporary.  */
@@ -158,10 +297,12 @@ static void init_ts_info(OptContext *ctx, TCGTemp *ts)
     if (ti == NULL) {
         ti = tcg_malloc(sizeof(TempOptInfo));
         ts->state_ptr = ti;
+        ti->gen = 0;
     }
 
     ti->next_copy = ts;
     ti->prev_copy = ts;
+    QSIMPLEQ_INIT(&ti->mem_copy);
     if (ts->kind == TEMP_CONST) {
         ti->is_const = true;
         ti->val = ts->val;
@@ -239,7 +380,7 @@ static bool tcg_opt_gen_mov(OptContext *ctx, TCGOp *op, TCGArg dst, TCGArg src)
         return true;
     }
 
-    reset_ts(dst_ts);
+    reset_ts(ctx, dst_ts);
     di = ts_info(dst_ts);
     si = ts_info(src_ts);
 
@@ -275,6 +416,11 @@ static bool tcg_opt_gen_mov(OptContext *ctx, TCGOp *op, TCGArg dst, TCGArg src)
         si->next_copy = dst_ts;
         di->is_const = si->is_const;
         di->val = si->val;
+
+        if (!QSIMPLEQ_EMPTY(&si->mem_copy)
+            && find_better_copy(ctx->tcg, src_ts) == dst_ts) {
+            move_mem_copies(dst_ts, src_ts);
+        }
     }
     return true;
 }
@@ -695,6 +841,8 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
      */
     if (def->flags & TCG_OPF_BB_END) {
         memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        remove_mem_copy_all(ctx);
+        memset(ctx->cse, 0, sizeof(ctx->cse));
         ctx->prev_mb = NULL;
         return;
     }
@@ -702,7 +850,7 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
     nb_oargs = def->nb_oargs;
     for (i = 0; i < nb_oargs; i++) {
         TCGTemp *ts = arg_temp(op->args[i]);
-        reset_ts(ts);
+        reset_ts(ctx, ts);
         /*
          * Save the corresponding known-zero/sign bits mask for the
          * first output argument (only one supported so far).
@@ -1215,14 +1363,19 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
 
         for (i = 0; i < nb_globals; i++) {
             if (test_bit(i, ctx->temps_used.l)) {
-                reset_ts(&ctx->tcg->temps[i]);
+                reset_ts(ctx, &ctx->tcg->temps[i]);
             }
         }
     }
 
+    /* If the function has side effects, reset mem data. */
+    if (!(flags & TCG_CALL_NO_SIDE_EFFECTS)) {
+        remove_mem_copy_all(ctx);
+    }
+
     /* Reset temp data for outputs. */
     for (i = 0; i < nb_oargs; i++) {
-        reset_temp(op->args[i]);
+        reset_temp(ctx, op->args[i]);
     }
 
     /* Stop optimizing MB across calls. */
@@ -2004,6 +2157,103 @@ static bool fold_tcg_ld(OptContext *ctx, TCGOp *op)
     return false;
 }
 
+static bool fold_tcg_ld_memcopy(OptContext *ctx, TCGOp *op)
+{
+    TCGTemp *dst, *src;
+    intptr_t ofs;
+    TCGType type;
+
+    if (op->args[1] != tcgv_ptr_arg(cpu_env)) {
+        return false;
+    }
+
+    type = ctx->type;
+    ofs = op->args[2];
+    dst = arg_temp(op->args[0]);
+    src = find_mem_copy_for(ctx, type, ofs);
+    if (src && src->base_type == type) {
+#ifdef CONFIG_PROFILER
+        TCGProfile *prof = &ctx->tcg->prof;
+        qatomic_set(&prof->opt_ld_fwd_count, prof->opt_ld_fwd_count + 1);
+#endif
+        return tcg_opt_gen_mov(ctx, op, temp_arg(dst), temp_arg(src));
+    }
+
+    reset_ts(ctx, dst);
+    record_mem_copy(ctx, type, dst, ofs, ofs + tcg_type_size(type) - 1);
+    return true;
+}
+
+static bool fold_tcg_st(OptContext *ctx, TCGOp *op)
+{
+    intptr_t ofs = op->args[2];
+    intptr_t lm1;
+
+    if (op->args[1] != tcgv_ptr_arg(cpu_env)) {
+        remove_mem_copy_all(ctx);
+        return false;
+    }
+
+    switch (op->opc) {
+    CASE_OP_32_64(st8):
+        lm1 = 0;
+        break;
+    CASE_OP_32_64(st16):
+        lm1 = 1;
+        break;
+    case INDEX_op_st32_i64:
+    case INDEX_op_st_i32:
+        lm1 = 3;
+        break;
+    case INDEX_op_st_i64:
+        lm1 = 7;
+        break;
+    case INDEX_op_st_vec:
+        lm1 = tcg_type_size(ctx->type) - 1;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    remove_mem_copy_in(ctx, ofs, ofs + lm1);
+    return false;
+}
+
+static bool fold_tcg_st_memcopy(OptContext *ctx, TCGOp *op)
+{
+    TCGTemp *src, *prev;
+    intptr_t ofs, last;
+    TCGType type;
+
+    if (op->args[1] != tcgv_ptr_arg(cpu_env)) {
+        fold_tcg_st(ctx, op);
+        return false;
+    }
+
+    src = arg_temp(op->args[0]);
+    ofs = op->args[2];
+    type = ctx->type;
+
+    /*
+     * Eliminate stores of a value already known to be in env.
+     * This happens frequently when the target ISA zero-extends,
+     * or when a flag is written back unchanged.
+     */
+    prev = find_mem_copy_for(ctx, type, ofs);
+    if (prev && ts_are_copies(prev, src)) {
+#ifdef CONFIG_PROFILER
+        TCGProfile *prof = &ctx->tcg->prof;
+        qatomic_set(&prof->opt_st_del_count, prof->opt_st_del_count + 1);
+#endif
+        tcg_op_remove(ctx->tcg, op);
+        return true;
+    }
+
+    last = ofs + tcg_type_size(type) - 1;
+    remove_mem_copy_in(ctx, ofs, last);
+    record_mem_copy(ctx, type, src, ofs, last);
+    return false;
+}
+
 static bool fold_xor(OptContext *ctx, TCGOp *op)
 {
     if (fold_const2_commutative(ctx, op) ||
@@ -2020,6 +2270,125 @@ static bool fold_xor(OptContext *ctx, TCGOp *op)
     return fold_masks(ctx, op);
 }
 
+/*
+ * Common subexpression elimination within a basic block.
+ * An operation is pure if its only effect is to compute its single
+ * output from its inputs.  Loads from env are handled above by the
+ * tracking of memory copies.
+ */
+static bool op_is_pure(TCGOp *op, const TCGOpDef *def)
+{
+    if (def->nb_oargs != 1 || def->nb_iargs == 0
+        || def->nb_oargs + def->nb_iargs + def->nb_cargs > CSE_MAX_ARGS
+        || (def->flags & (TCG_OPF_BB_END | TCG_OPF_CALL_CLOBBER |
+                          TCG_OPF_SIDE_EFFECTS))) {
+        return false;
+    }
+
+    switch (op->opc) {
+    CASE_OP_32_64_VEC(mov):
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(ld16u):
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld_i64:
+    case INDEX_op_ld_vec:
+    case INDEX_op_dupm_vec:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static unsigned cse_hash(TCGOp *op, const TCGOpDef *def)
+{
+    int n = def->nb_oargs + def->nb_iargs + def->nb_cargs;
+    uint64_t h = op->opc | (op->param1 << 16) | (op->param2 << 24);
+
+    for (int i = def->nb_oargs; i < n; i++) {
+        h = (h + op->args[i]) * 0x9e3779b97f4a7c15ull;
+    }
+    return h >> (64 - CSE_TABLE_BITS);
+}
+
+/*
+ * Replace OP with a copy of the output of an identical operation
+ * seen earlier in the block, if that output and all of its inputs
+ * still hold the same values.
+ */
+static bool fold_cse(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    CSEEntry *e;
+    TCGOp *prev;
+    int i, nb_temps, nb_args;
+
+    if (!op_is_pure(op, def)) {
+        return false;
+    }
+
+    e = &ctx->cse[cse_hash(op, def)];
+    prev = e->op;
+    if (prev == NULL || prev->opc != op->opc ||
+        prev->param1 != op->param1 || prev->param2 != op->param2) {
+        return false;
+    }
+
+    nb_temps = def->nb_oargs + def->nb_iargs;
+    nb_args = nb_temps + def->nb_cargs;
+    for (i = def->nb_oargs; i < nb_args; i++) {
+        if (prev->args[i] != op->args[i]) {
+            return false;
+        }
+    }
+    for (i = 0; i < nb_temps; i++) {
+        if (ts_info(arg_temp(prev->args[i]))->gen != e->gen[i]) {
+            return false;
+        }
+    }
+
+#ifdef CONFIG_PROFILER
+    {
+        TCGProfile *prof = &ctx->tcg->prof;
+        qatomic_set(&prof->opt_cse_count, prof->opt_cse_count + 1);
+    }
+#endif
+    return tcg_opt_gen_mov(ctx, op, op->args[0], prev->args[0]);
+}
+
+/* Remember OP, whose output has just been computed, for fold_cse.  */
+static void record_cse(OptContext *ctx, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    TCGTemp *out = arg_temp(op->args[0]);
+    CSEEntry *e;
+    int i, nb_temps;
+
+    if (!op_is_pure(op, def)) {
+        return;
+    }
+
+    /*
+     * If the output overwrites an input, the operation cannot be
+     * repeated with the same result.
+     */
+    nb_temps = def->nb_oargs + def->nb_iargs;
+    for (i = def->nb_oargs; i < nb_temps; i++) {
+        if (arg_temp(op->args[i]) == out) {
+            return;
+        }
+    }
+
+    e = &ctx->cse[cse_hash(op, def)];
+    e->op = op;
+    for (i = 0; i < nb_temps; i++) {
+        e->gen[i] = ts_info(arg_temp(op->args[i]))->gen;
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -2036,6 +2405,7 @@ void tcg_optimize(TCGContext *s)
     for (i = 0; i < nb_temps; ++i) {
         s->temps[i].state_ptr = NULL;
     }
+    QSIMPLEQ_INIT(&ctx.mem_free);
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
         TCGOpcode opc = op->opc;
@@ -2148,6 +2518,11 @@ void tcg_optimize(TCGContext *s)
         case INDEX_op_ld32u_i64:
             done = fold_tcg_ld(&ctx, op);
             break;
+        case INDEX_op_ld_i32:
+        case INDEX_op_ld_i64:
+        case INDEX_op_ld_vec:
+            done = fold_tcg_ld_memcopy(&ctx, op);
+            break;
         case INDEX_op_mb:
             done = fold_mb(&ctx, op);
             break;
@@ -2215,6 +2590,16 @@ void tcg_optimize(TCGContext *s)
         CASE_OP_32_64(sextract):
             done = fold_sextract(&ctx, op);
             break;
+        CASE_OP_32_64(st8):
+        CASE_OP_32_64(st16):
+        case INDEX_op_st32_i64:
+            done = fold_tcg_st(&ctx, op);
+            break;
+        case INDEX_op_st_i32:
+        case INDEX_op_st_i64:
+        case INDEX_op_st_vec:
+            done = fold_tcg_st_memcopy(&ctx, op);
+            break;
         CASE_OP_32_64(sub):
             done = fold_sub(&ctx, op);
             break;
@@ -2231,8 +2616,12 @@ void tcg_optimize(TCGContext *s)
             break;
         }
 
+        if (!done) {
+            done = fold_cse(&ctx, op);
+        }
         if (!done) {
             finish_folding(&ctx, op);
+            record_cse(&ctx, op);
         }
     }
 }
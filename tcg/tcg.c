@@ -4862,6 +4862,9 @@ void tcg_profile_snapshot(TCGProfile *prof, bool counters, bool table)
             PROF_ADD(prof, orig, code_time);
             PROF_ADD(prof, orig, la_time);
             PROF_ADD(prof, orig, opt_time);
+            PROF_ADD(prof, orig, opt_cse_count);
+            PROF_ADD(prof, orig, opt_ld_fwd_count);
+            PROF_ADD(prof, orig, opt_st_del_count);
             PROF_ADD(prof, orig, restore_count);
             PROF_ADD(prof, orig, restore_time);
         }
@@ -5197,6 +5200,12 @@ void tcg_dump_info(GString *buf)
                            (double)s->op_count / tb_div_count, s->op_count_max);
     g_string_append_printf(buf, "deleted ops/TB      %0.2f\n",
                            (double)s->del_op_count / tb_div_count);
+    g_string_append_printf(buf, "  CSE ops/TB        %0.2f\n",
+                           (double)s->opt_cse_count / tb_div_count);
+    g_string_append_printf(buf, "  env loads fwd/TB  %0.2f\n",
+                           (double)s->opt_ld_fwd_count / tb_div_count);
+    g_string_append_printf(buf, "  env stores del/TB %0.2f\n",
+                           (double)s->opt_st_del_count / tb_div_count);
     g_string_append_printf(buf, "avg temps/TB        %0.2f max=%d\n",
                            (double)s->temp_count / tb_div_count,
                            s->temp_count_max);
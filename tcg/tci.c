@@ -286,6 +286,39 @@ static bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
     return result;
 }
 
+/* Load from host memory, with the size, sign and byte order of @mop. */
+static uint64_t tci_ld_host(const void *haddr, MemOp mop)
+{
+    switch (mop & (MO_BSWAP | MO_SSIZE)) {
+    case MO_UB:
+        return ldub_p(haddr);
+    case MO_SB:
+        return ldsb_p(haddr);
+    case MO_LEUW:
+        return lduw_le_p(haddr);
+    case MO_LESW:
+        return ldsw_le_p(haddr);
+    case MO_LEUL:
+        return (uint32_t)ldl_le_p(haddr);
+    case MO_LESL:
+        return (int32_t)ldl_le_p(haddr);
+    case MO_LEUQ:
+        return ldq_le_p(haddr);
+    case MO_BEUW:
+        return lduw_be_p(haddr);
+    case MO_BESW:
+        return ldsw_be_p(haddr);
+    case MO_BEUL:
+        return (uint32_t)ldl_be_p(haddr);
+    case MO_BESL:
+        return (int32_t)ldl_be_p(haddr);
+    case MO_BEUQ:
+        return ldq_be_p(haddr);
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static uint64_t tci_qemu_ld(CPUArchState *env, target_ulong taddr,
                             MemOpIdx oi, const void *tb_ptr)
 {
@@ -293,6 +326,20 @@ static uint64_t tci_qemu_ld(CPUArchState *env, target_ulong taddr,
     uintptr_t ra = (uintptr_t)tb_ptr;
 
 #ifdef CONFIG_SOFTMMU
+    /*
+     * TLB hit on a naturally aligned access: this is the fast path that
+     * the native backends emit inline.  Any flag in addr_read (MMIO,
+     * watchpoint, invalid, ...) or a misaligned address makes the
+     * comparison fail, so that the helper handles those.
+     */
+    unsigned a_bits = MAX(get_alignment_bits(mop), mop & MO_SIZE);
+    target_ulong mask = TARGET_PAGE_MASK | ((1 << a_bits) - 1);
+    CPUTLBEntry *entry = tlb_entry(env, get_mmuidx(oi), taddr);
+
+    if (likely(entry->addr_read == (taddr & mask))) {
+        return tci_ld_host((void *)((uintptr_t)taddr + entry->addend), mop);
+    }
+
     switch (mop & (MO_BSWAP | MO_SSIZE)) {
     case MO_UB:
         return helper_ret_ldub_mmu(env, taddr, oi, ra);
@@ -330,46 +377,7 @@ static uint64_t tci_qemu_ld(CPUArchState *env, target_ulong taddr,
     if (taddr & a_mask) {
         helper_unaligned_ld(env, taddr);
     }
-    switch (mop & (MO_BSWAP | MO_SSIZE)) {
-    case MO_UB:
-        ret = ldub_p(haddr);
-        break;
-    case MO_SB:
-        ret = ldsb_p(haddr);
-        break;
-    case MO_LEUW:
-        ret = lduw_le_p(haddr);
-        break;
-    case MO_LESW:
-        ret = ldsw_le_p(haddr);
-        break;
-    case MO_LEUL:
-        ret = (uint32_t)ldl_le_p(haddr);
-        break;
-    case MO_LESL:
-        ret = (int32_t)ldl_le_p(haddr);
-        break;
-    case MO_LEUQ:
-        ret = ldq_le_p(haddr);
-        break;
-    case MO_BEUW:
-        ret = lduw_be_p(haddr);
-        break;
-    case MO_BESW:
-        ret = ldsw_be_p(haddr);
-        break;
-    case MO_BEUL:
-        ret = (uint32_t)ldl_be_p(haddr);
-        break;
-    case MO_BESL:
-        ret = (int32_t)ldl_be_p(haddr);
-        break;
-    case MO_BEUQ:
-        ret = ldq_be_p(haddr);
-        break;
-    default:
-        g_assert_not_reached();
-    }
+    ret = tci_ld_host(haddr, mop);
     clear_helper_retaddr();
     return ret;
 #endif
@@ -456,6 +464,57 @@ static void tci_qemu_st(CPUArchState *env, target_ulong taddr, uint64_t val,
 # define CASE_64(x)
 #endif
 
+#if TCG_TARGET_REG_BITS == 64
+# define DISPATCH_32_64(x) \
+        [glue(glue(INDEX_op_, x), _i32)] = &&glue(do_, x), \
+        [glue(glue(INDEX_op_, x), _i64)] = &&glue(do_, x)
+#else
+# define DISPATCH_32_64(x) \
+        [glue(glue(INDEX_op_, x), _i32)] = &&glue(do_, x)
+#endif
+
+/* Fetch the next operation and jump to its implementation. */
+#define tci_next()                              \
+    do {                                        \
+        insn = *tb_ptr++;                       \
+        opc = extract32(insn, 0, 8);            \
+        goto *dispatch[opc];                    \
+    } while (0)
+
+/*
+ * A brcond is always emitted as a setcond into TCG_REG_TMP followed by
+ * a brcond on that register.  Execute both together, saving a dispatch.
+ */
+#define tci_fused_brcond(BRCOND)                                \
+    do {                                                        \
+        insn = *tb_ptr;                                         \
+        if (extract32(insn, 0, 8) == BRCOND &&                  \
+            extract32(insn, 8, 4) == r0) {                      \
+            tb_ptr++;                                           \
+            if (regs[r0]) {                                     \
+                tci_args_rl(insn, tb_ptr, &r0, &ptr);           \
+                tb_ptr = ptr;                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+/*
+ * Loads from env are mostly consumed by the next operation, most often
+ * an add (e.g. base + index for guest addresses).  If the next operation
+ * is an add of the loaded register, execute it together with the load.
+ */
+#define tci_fused_add(ADD)                                      \
+    do {                                                        \
+        insn = *tb_ptr;                                         \
+        if (extract32(insn, 0, 8) == ADD) {                     \
+            tci_args_rrr(insn, &r1, &r2, &r3);                  \
+            if (r2 == r0 || r3 == r0) {                         \
+                tb_ptr++;                                       \
+                regs[r1] = regs[r2] + regs[r3];                 \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
 /* Interpret pseudo code in tb. */
 /*
  * Disable CFI checks.
@@ -469,584 +528,716 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
     tcg_target_ulong regs[TCG_TARGET_NB_REGS];
     uint64_t stack[(TCG_STATIC_CALL_ARGS_SIZE + TCG_STATIC_FRAME_SIZE)
                    / sizeof(uint64_t)];
+    uint32_t insn;
+    TCGOpcode opc;
+    TCGReg r0, r1, r2, r3, r4, r5;
+    tcg_target_ulong t1;
+    TCGCond condition;
+    target_ulong taddr;
+    uint8_t pos, len;
+    uint32_t tmp32;
+    uint64_t tmp64;
+    uint64_t T1, T2;
+    MemOpIdx oi;
+    int32_t ofs;
+    void *ptr;
+
+    /*
+     * Rather than returning to a single switch after each operation,
+     * dispatch to the next one directly from the end of the current
+     * one ("threaded code"), so that the host branch predictor sees
+     * one indirect branch per operation.  The most frequent operations
+     * are reached directly through this table, the rest via the switch.
+     */
+    static const void * const dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&do_switch,
+        [INDEX_op_call] = &&do_call,
+        [INDEX_op_br] = &&do_br,
+        [INDEX_op_setcond_i32] = &&do_setcond_i32,
+        [INDEX_op_tci_movi] = &&do_tci_movi,
+        [INDEX_op_tci_movl] = &&do_tci_movl,
+        DISPATCH_32_64(mov),
+        DISPATCH_32_64(ld8u),
+        DISPATCH_32_64(ld8s),
+        DISPATCH_32_64(ld16u),
+        DISPATCH_32_64(ld16s),
+        [INDEX_op_ld_i32] = &&do_ld32u,
+        DISPATCH_32_64(st8),
+        DISPATCH_32_64(st16),
+        [INDEX_op_st_i32] = &&do_st32,
+        DISPATCH_32_64(add),
+        DISPATCH_32_64(sub),
+        DISPATCH_32_64(and),
+        DISPATCH_32_64(or),
+        DISPATCH_32_64(xor),
+        [INDEX_op_shl_i32] = &&do_shl_i32,
+        [INDEX_op_shr_i32] = &&do_shr_i32,
+        [INDEX_op_sar_i32] = &&do_sar_i32,
+        [INDEX_op_brcond_i32] = &&do_brcond_i32,
+#if TCG_TARGET_REG_BITS == 64
+        [INDEX_op_setcond_i64] = &&do_setcond_i64,
+        [INDEX_op_ld32u_i64] = &&do_ld32u,
+        [INDEX_op_st32_i64] = &&do_st32,
+        [INDEX_op_ld_i64] = &&do_ld_i64,
+        [INDEX_op_st_i64] = &&do_st_i64,
+        [INDEX_op_shl_i64] = &&do_shl_i64,
+        [INDEX_op_shr_i64] = &&do_shr_i64,
+        [INDEX_op_sar_i64] = &&do_sar_i64,
+        [INDEX_op_brcond_i64] = &&do_brcond_i64,
+        [INDEX_op_ext32s_i64] = &&do_ext32s,
+        [INDEX_op_ext_i32_i64] = &&do_ext32s,
+        [INDEX_op_ext32u_i64] = &&do_ext32u,
+        [INDEX_op_extu_i32_i64] = &&do_ext32u,
+#endif
+        [INDEX_op_exit_tb] = &&do_exit_tb,
+        [INDEX_op_goto_tb] = &&do_goto_tb,
+        [INDEX_op_goto_ptr] = &&do_goto_ptr,
+        [INDEX_op_qemu_ld_i32] = &&do_qemu_ld_i32,
+        [INDEX_op_qemu_ld_i64] = &&do_qemu_ld_i64,
+        [INDEX_op_qemu_st_i32] = &&do_qemu_st_i32,
+        [INDEX_op_qemu_st_i64] = &&do_qemu_st_i64,
+    };
 
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = (uintptr_t)stack;
     tci_assert(tb_ptr);
 
-    for (;;) {
-        uint32_t insn;
-        TCGOpcode opc;
-        TCGReg r0, r1, r2, r3, r4, r5;
-        tcg_target_ulong t1;
-        TCGCond condition;
-        target_ulong taddr;
-        uint8_t pos, len;
-        uint32_t tmp32;
-        uint64_t tmp64;
-        uint64_t T1, T2;
-        MemOpIdx oi;
-        int32_t ofs;
-        void *ptr;
-
-        insn = *tb_ptr++;
-        opc = extract32(insn, 0, 8);
-
-        switch (opc) {
-        case INDEX_op_call:
-            {
-                void *call_slots[MAX_CALL_IARGS];
-                ffi_cif *cif;
-                void *func;
-                unsigned i, s, n;
-
-                tci_args_nl(insn, tb_ptr, &len, &ptr);
-                func = ((void **)ptr)[0];
-                cif = ((void **)ptr)[1];
-
-                n = cif->nargs;
-                for (i = s = 0; i < n; ++i) {
-                    ffi_type *t = cif->arg_types[i];
-                    call_slots[i] = &stack[s];
-                    s += DIV_ROUND_UP(t->size, 8);
-                }
-
-                /* Helper functions may need to access the "return address" */
-                tci_tb_ptr = (uintptr_t)tb_ptr;
-                ffi_call(cif, func, stack, call_slots);
+    tci_next();
+
+ do_switch:
+    switch (opc) {
+    case INDEX_op_call:
+    do_call:
+        {
+            void *call_slots[MAX_CALL_IARGS];
+            ffi_cif *cif;
+            void *func;
+            unsigned i, s, n;
+
+            tci_args_nl(insn, tb_ptr, &len, &ptr);
+            func = ((void **)ptr)[0];
+            cif = ((void **)ptr)[1];
+
+            n = cif->nargs;
+            for (i = s = 0; i < n; ++i) {
+                ffi_type *t = cif->arg_types[i];
+                call_slots[i] = &stack[s];
+                s += DIV_ROUND_UP(t->size, 8);
             }
 
-            switch (len) {
-            case 0: /* void */
-                break;
-            case 1: /* uint32_t */
-                /*
-                 * The result winds up "left-aligned" in the stack[0] slot.
-                 * Note that libffi has an odd special case in that it will
-                 * always widen an integral result to ffi_arg.
-                 */
-                if (sizeof(ffi_arg) == 8) {
-                    regs[TCG_REG_R0] = (uint32_t)stack[0];
-                } else {
-                    regs[TCG_REG_R0] = *(uint32_t *)stack;
-                }
-                break;
-            case 2: /* uint64_t */
-                /*
-                 * For TCG_TARGET_REG_BITS == 32, the register pair
-                 * must stay in host memory order.
-                 */
-                memcpy(&regs[TCG_REG_R0], stack, 8);
-                break;
-            case 3: /* Int128 */
-                memcpy(&regs[TCG_REG_R0], stack, 16);
-                break;
-            default:
-                g_assert_not_reached();
+            /* Helper functions may need to access the "return address" */
+            tci_tb_ptr = (uintptr_t)tb_ptr;
+            ffi_call(cif, func, stack, call_slots);
+        }
+
+        switch (len) {
+        case 0: /* void */
+            break;
+        case 1: /* uint32_t */
+            /*
+             * The result winds up "left-aligned" in the stack[0] slot.
+             * Note that libffi has an odd special case in that it will
+             * always widen an integral result to ffi_arg.
+             */
+            if (sizeof(ffi_arg) == 8) {
+                regs[TCG_REG_R0] = (uint32_t)stack[0];
+            } else {
+                regs[TCG_REG_R0] = *(uint32_t *)stack;
             }
             break;
-
-        case INDEX_op_br:
-            tci_args_l(insn, tb_ptr, &ptr);
-            tb_ptr = ptr;
-            continue;
-        case INDEX_op_setcond_i32:
-            tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
-            regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
+        case 2: /* uint64_t */
+            /*
+             * For TCG_TARGET_REG_BITS == 32, the register pair
+             * must stay in host memory order.
+             */
+            memcpy(&regs[TCG_REG_R0], stack, 8);
             break;
-        case INDEX_op_movcond_i32:
-            tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
-            tmp32 = tci_compare32(regs[r1], regs[r2], condition);
-            regs[r0] = regs[tmp32 ? r3 : r4];
+        case 3: /* Int128 */
+            memcpy(&regs[TCG_REG_R0], stack, 16);
             break;
+        default:
+            g_assert_not_reached();
+        }
+        tci_next();
+
+    case INDEX_op_br:
+    do_br:
+        tci_args_l(insn, tb_ptr, &ptr);
+        tb_ptr = ptr;
+        tci_next();
+    case INDEX_op_setcond_i32:
+    do_setcond_i32:
+        tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
+        regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
+        tci_fused_brcond(INDEX_op_brcond_i32);
+        tci_next();
+    case INDEX_op_movcond_i32:
+        tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
+        tmp32 = tci_compare32(regs[r1], regs[r2], condition);
+        regs[r0] = regs[tmp32 ? r3 : r4];
+        tci_next();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
-            tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
-            T1 = tci_uint64(regs[r2], regs[r1]);
-            T2 = tci_uint64(regs[r4], regs[r3]);
-            regs[r0] = tci_compare64(T1, T2, condition);
-            break;
+    case INDEX_op_setcond2_i32:
+        tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
+        T1 = tci_uint64(regs[r2], regs[r1]);
+        T2 = tci_uint64(regs[r4], regs[r3]);
+        regs[r0] = tci_compare64(T1, T2, condition);
+        tci_next();
 #elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond_i64:
-            tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
-            regs[r0] = tci_compare64(regs[r1], regs[r2], condition);
-            break;
-        case INDEX_op_movcond_i64:
-            tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
-            tmp32 = tci_compare64(regs[r1], regs[r2], condition);
-            regs[r0] = regs[tmp32 ? r3 : r4];
-            break;
+    case INDEX_op_setcond_i64:
+    do_setcond_i64:
+        tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
+        regs[r0] = tci_compare64(regs[r1], regs[r2], condition);
+        tci_fused_brcond(INDEX_op_brcond_i64);
+        tci_next();
+    case INDEX_op_movcond_i64:
+        tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
+        tmp32 = tci_compare64(regs[r1], regs[r2], condition);
+        regs[r0] = regs[tmp32 ? r3 : r4];
+        tci_next();
 #endif
-        CASE_32_64(mov)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = regs[r1];
-            break;
-        case INDEX_op_tci_movi:
-            tci_args_ri(insn, &r0, &t1);
-            regs[r0] = t1;
-            break;
-        case INDEX_op_tci_movl:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            regs[r0] = *(tcg_target_ulong *)ptr;
-            break;
-
-            /* Load/store operations (32 bit). */
-
-        CASE_32_64(ld8u)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(uint8_t *)ptr;
-            break;
-        CASE_32_64(ld8s)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(int8_t *)ptr;
-            break;
-        CASE_32_64(ld16u)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(uint16_t *)ptr;
-            break;
-        CASE_32_64(ld16s)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(int16_t *)ptr;
-            break;
-        case INDEX_op_ld_i32:
-        CASE_64(ld32u)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(uint32_t *)ptr;
-            break;
-        CASE_32_64(st8)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(uint8_t *)ptr = regs[r0];
-            break;
-        CASE_32_64(st16)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(uint16_t *)ptr = regs[r0];
-            break;
-        case INDEX_op_st_i32:
-        CASE_64(st32)
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(uint32_t *)ptr = regs[r0];
-            break;
+    CASE_32_64(mov)
+    do_mov:
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = regs[r1];
+        tci_next();
+    case INDEX_op_tci_movi:
+    do_tci_movi:
+        tci_args_ri(insn, &r0, &t1);
+        regs[r0] = t1;
+        tci_next();
+    case INDEX_op_tci_movl:
+    do_tci_movl:
+        tci_args_rl(insn, tb_ptr, &r0, &ptr);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        tci_next();
+
+        /* Load/store operations (32 bit). */
+
+    CASE_32_64(ld8u)
+    do_ld8u:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(uint8_t *)ptr;
+        tci_next();
+    CASE_32_64(ld8s)
+    do_ld8s:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(int8_t *)ptr;
+        tci_next();
+    CASE_32_64(ld16u)
+    do_ld16u:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(uint16_t *)ptr;
+        tci_next();
+    CASE_32_64(ld16s)
+    do_ld16s:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(int16_t *)ptr;
+        tci_next();
+    case INDEX_op_ld_i32:
+    CASE_64(ld32u)
+    do_ld32u:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(uint32_t *)ptr;
+        tci_fused_add(opc == INDEX_op_ld_i32 ? INDEX_op_add_i32
+                      : INDEX_op_add_i64);
+        tci_next();
+    CASE_32_64(st8)
+    do_st8:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(uint8_t *)ptr = regs[r0];
+        tci_next();
+    CASE_32_64(st16)
+    do_st16:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(uint16_t *)ptr = regs[r0];
+        tci_next();
+    case INDEX_op_st_i32:
+    CASE_64(st32)
+    do_st32:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(uint32_t *)ptr = regs[r0];
+        tci_next();
 
-            /* Arithmetic operations (mixed 32/64 bit). */
+        /* Arithmetic operations (mixed 32/64 bit). */
 
-        CASE_32_64(add)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] + regs[r2];
-            break;
-        CASE_32_64(sub)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] - regs[r2];
-            break;
-        CASE_32_64(mul)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] * regs[r2];
-            break;
-        CASE_32_64(and)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] & regs[r2];
-            break;
-        CASE_32_64(or)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] | regs[r2];
-            break;
-        CASE_32_64(xor)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] ^ regs[r2];
-            break;
+    CASE_32_64(add)
+    do_add:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] + regs[r2];
+        tci_next();
+    CASE_32_64(sub)
+    do_sub:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] - regs[r2];
+        tci_next();
+    CASE_32_64(mul)
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] * regs[r2];
+        tci_next();
+    CASE_32_64(and)
+    do_and:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] & regs[r2];
+        tci_next();
+    CASE_32_64(or)
+    do_or:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] | regs[r2];
+        tci_next();
+    CASE_32_64(xor)
+    do_xor:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ^ regs[r2];
+        tci_next();
 #if TCG_TARGET_HAS_andc_i32 || TCG_TARGET_HAS_andc_i64
-        CASE_32_64(andc)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] & ~regs[r2];
-            break;
+    CASE_32_64(andc)
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] & ~regs[r2];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_orc_i32 || TCG_TARGET_HAS_orc_i64
-        CASE_32_64(orc)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] | ~regs[r2];
-            break;
+    CASE_32_64(orc)
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] | ~regs[r2];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_eqv_i32 || TCG_TARGET_HAS_eqv_i64
-        CASE_32_64(eqv)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ~(regs[r1] ^ regs[r2]);
-            break;
+    CASE_32_64(eqv)
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ~(regs[r1] ^ regs[r2]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_nand_i32 || TCG_TARGET_HAS_nand_i64
-        CASE_32_64(nand)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ~(regs[r1] & regs[r2]);
-            break;
+    CASE_32_64(nand)
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ~(regs[r1] & regs[r2]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_nor_i32 || TCG_TARGET_HAS_nor_i64
-        CASE_32_64(nor)
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ~(regs[r1] | regs[r2]);
-            break;
+    CASE_32_64(nor)
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ~(regs[r1] | regs[r2]);
+        tci_next();
 #endif
 
-            /* Arithmetic operations (32 bit). */
+        /* Arithmetic operations (32 bit). */
 
-        case INDEX_op_div_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int32_t)regs[r1] / (int32_t)regs[r2];
-            break;
-        case INDEX_op_divu_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint32_t)regs[r1] / (uint32_t)regs[r2];
-            break;
-        case INDEX_op_rem_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int32_t)regs[r1] % (int32_t)regs[r2];
-            break;
-        case INDEX_op_remu_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint32_t)regs[r1] % (uint32_t)regs[r2];
-            break;
+    case INDEX_op_div_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int32_t)regs[r1] / (int32_t)regs[r2];
+        tci_next();
+    case INDEX_op_divu_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint32_t)regs[r1] / (uint32_t)regs[r2];
+        tci_next();
+    case INDEX_op_rem_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int32_t)regs[r1] % (int32_t)regs[r2];
+        tci_next();
+    case INDEX_op_remu_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint32_t)regs[r1] % (uint32_t)regs[r2];
+        tci_next();
 #if TCG_TARGET_HAS_clz_i32
-        case INDEX_op_clz_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            tmp32 = regs[r1];
-            regs[r0] = tmp32 ? clz32(tmp32) : regs[r2];
-            break;
+    case INDEX_op_clz_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        tmp32 = regs[r1];
+        regs[r0] = tmp32 ? clz32(tmp32) : regs[r2];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ctz_i32
-        case INDEX_op_ctz_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            tmp32 = regs[r1];
-            regs[r0] = tmp32 ? ctz32(tmp32) : regs[r2];
-            break;
+    case INDEX_op_ctz_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        tmp32 = regs[r1];
+        regs[r0] = tmp32 ? ctz32(tmp32) : regs[r2];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ctpop_i32
-        case INDEX_op_ctpop_i32:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = ctpop32(regs[r1]);
-            break;
+    case INDEX_op_ctpop_i32:
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = ctpop32(regs[r1]);
+        tci_next();
 #endif
 
-            /* Shift/rotate operations (32 bit). */
+        /* Shift/rotate operations (32 bit). */
 
-        case INDEX_op_shl_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint32_t)regs[r1] << (regs[r2] & 31);
-            break;
-        case INDEX_op_shr_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint32_t)regs[r1] >> (regs[r2] & 31);
-            break;
-        case INDEX_op_sar_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int32_t)regs[r1] >> (regs[r2] & 31);
-            break;
+    case INDEX_op_shl_i32:
+    do_shl_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint32_t)regs[r1] << (regs[r2] & 31);
+        tci_next();
+    case INDEX_op_shr_i32:
+    do_shr_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint32_t)regs[r1] >> (regs[r2] & 31);
+        tci_next();
+    case INDEX_op_sar_i32:
+    do_sar_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int32_t)regs[r1] >> (regs[r2] & 31);
+        tci_next();
 #if TCG_TARGET_HAS_rot_i32
-        case INDEX_op_rotl_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = rol32(regs[r1], regs[r2] & 31);
-            break;
-        case INDEX_op_rotr_i32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ror32(regs[r1], regs[r2] & 31);
-            break;
+    case INDEX_op_rotl_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = rol32(regs[r1], regs[r2] & 31);
+        tci_next();
+    case INDEX_op_rotr_i32:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ror32(regs[r1], regs[r2] & 31);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_deposit_i32
-        case INDEX_op_deposit_i32:
-            tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
-            regs[r0] = deposit32(regs[r1], pos, len, regs[r2]);
-            break;
+    case INDEX_op_deposit_i32:
+        tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
+        regs[r0] = deposit32(regs[r1], pos, len, regs[r2]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_extract_i32
-        case INDEX_op_extract_i32:
-            tci_args_rrbb(insn, &r0, &r1, &pos, &len);
-            regs[r0] = extract32(regs[r1], pos, len);
-            break;
+    case INDEX_op_extract_i32:
+        tci_args_rrbb(insn, &r0, &r1, &pos, &len);
+        regs[r0] = extract32(regs[r1], pos, len);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_sextract_i32
-        case INDEX_op_sextract_i32:
-            tci_args_rrbb(insn, &r0, &r1, &pos, &len);
-            regs[r0] = sextract32(regs[r1], pos, len);
-            break;
+    case INDEX_op_sextract_i32:
+        tci_args_rrbb(insn, &r0, &r1, &pos, &len);
+        regs[r0] = sextract32(regs[r1], pos, len);
+        tci_next();
 #endif
-        case INDEX_op_brcond_i32:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if ((uint32_t)regs[r0]) {
-                tb_ptr = ptr;
-            }
-            break;
+    case INDEX_op_brcond_i32:
+    do_brcond_i32:
+        tci_args_rl(insn, tb_ptr, &r0, &ptr);
+        if ((uint32_t)regs[r0]) {
+            tb_ptr = ptr;
+        }
+        tci_next();
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_add2_i32
-        case INDEX_op_add2_i32:
-            tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
-            T1 = tci_uint64(regs[r3], regs[r2]);
-            T2 = tci_uint64(regs[r5], regs[r4]);
-            tci_write_reg64(regs, r1, r0, T1 + T2);
-            break;
+    case INDEX_op_add2_i32:
+        tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
+        T1 = tci_uint64(regs[r3], regs[r2]);
+        T2 = tci_uint64(regs[r5], regs[r4]);
+        tci_write_reg64(regs, r1, r0, T1 + T2);
+        tci_next();
 #endif
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_sub2_i32
-        case INDEX_op_sub2_i32:
-            tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
-            T1 = tci_uint64(regs[r3], regs[r2]);
-            T2 = tci_uint64(regs[r5], regs[r4]);
-            tci_write_reg64(regs, r1, r0, T1 - T2);
-            break;
+    case INDEX_op_sub2_i32:
+        tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
+        T1 = tci_uint64(regs[r3], regs[r2]);
+        T2 = tci_uint64(regs[r5], regs[r4]);
+        tci_write_reg64(regs, r1, r0, T1 - T2);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_mulu2_i32
-        case INDEX_op_mulu2_i32:
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
-            tmp64 = (uint64_t)(uint32_t)regs[r2] * (uint32_t)regs[r3];
-            tci_write_reg64(regs, r1, r0, tmp64);
-            break;
+    case INDEX_op_mulu2_i32:
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        tmp64 = (uint64_t)(uint32_t)regs[r2] * (uint32_t)regs[r3];
+        tci_write_reg64(regs, r1, r0, tmp64);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_muls2_i32
-        case INDEX_op_muls2_i32:
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
-            tmp64 = (int64_t)(int32_t)regs[r2] * (int32_t)regs[r3];
-            tci_write_reg64(regs, r1, r0, tmp64);
-            break;
+    case INDEX_op_muls2_i32:
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        tmp64 = (int64_t)(int32_t)regs[r2] * (int32_t)regs[r3];
+        tci_write_reg64(regs, r1, r0, tmp64);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ext8s_i32 || TCG_TARGET_HAS_ext8s_i64
-        CASE_32_64(ext8s)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (int8_t)regs[r1];
-            break;
+    CASE_32_64(ext8s)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (int8_t)regs[r1];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ext16s_i32 || TCG_TARGET_HAS_ext16s_i64 || \
-    TCG_TARGET_HAS_bswap16_i32 || TCG_TARGET_HAS_bswap16_i64
-        CASE_32_64(ext16s)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (int16_t)regs[r1];
-            break;
+TCG_TARGET_HAS_bswap16_i32 || TCG_TARGET_HAS_bswap16_i64
+    CASE_32_64(ext16s)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (int16_t)regs[r1];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ext8u_i32 || TCG_TARGET_HAS_ext8u_i64
-        CASE_32_64(ext8u)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (uint8_t)regs[r1];
-            break;
+    CASE_32_64(ext8u)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (uint8_t)regs[r1];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ext16u_i32 || TCG_TARGET_HAS_ext16u_i64
-        CASE_32_64(ext16u)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (uint16_t)regs[r1];
-            break;
+    CASE_32_64(ext16u)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (uint16_t)regs[r1];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_bswap16_i32 || TCG_TARGET_HAS_bswap16_i64
-        CASE_32_64(bswap16)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = bswap16(regs[r1]);
-            break;
+    CASE_32_64(bswap16)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = bswap16(regs[r1]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_bswap32_i32 || TCG_TARGET_HAS_bswap32_i64
-        CASE_32_64(bswap32)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = bswap32(regs[r1]);
-            break;
+    CASE_32_64(bswap32)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = bswap32(regs[r1]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_not_i32 || TCG_TARGET_HAS_not_i64
-        CASE_32_64(not)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = ~regs[r1];
-            break;
+    CASE_32_64(not)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = ~regs[r1];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_neg_i32 || TCG_TARGET_HAS_neg_i64
-        CASE_32_64(neg)
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = -regs[r1];
-            break;
+    CASE_32_64(neg)
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = -regs[r1];
+        tci_next();
 #endif
 #if TCG_TARGET_REG_BITS == 64
-            /* Load/store operations (64 bit). */
+        /* Load/store operations (64 bit). */
 
-        case INDEX_op_ld32s_i64:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(int32_t *)ptr;
-            break;
-        case INDEX_op_ld_i64:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(uint64_t *)ptr;
-            break;
-        case INDEX_op_st_i64:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(uint64_t *)ptr = regs[r0];
-            break;
+    case INDEX_op_ld32s_i64:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(int32_t *)ptr;
+        tci_next();
+    case INDEX_op_ld_i64:
+    do_ld_i64:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(uint64_t *)ptr;
+        tci_fused_add(INDEX_op_add_i64);
+        tci_next();
+    case INDEX_op_st_i64:
+    do_st_i64:
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(uint64_t *)ptr = regs[r0];
+        tci_next();
 
-            /* Arithmetic operations (64 bit). */
+        /* Arithmetic operations (64 bit). */
 
-        case INDEX_op_div_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int64_t)regs[r1] / (int64_t)regs[r2];
-            break;
-        case INDEX_op_divu_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint64_t)regs[r1] / (uint64_t)regs[r2];
-            break;
-        case INDEX_op_rem_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int64_t)regs[r1] % (int64_t)regs[r2];
-            break;
-        case INDEX_op_remu_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint64_t)regs[r1] % (uint64_t)regs[r2];
-            break;
+    case INDEX_op_div_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int64_t)regs[r1] / (int64_t)regs[r2];
+        tci_next();
+    case INDEX_op_divu_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint64_t)regs[r1] / (uint64_t)regs[r2];
+        tci_next();
+    case INDEX_op_rem_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int64_t)regs[r1] % (int64_t)regs[r2];
+        tci_next();
+    case INDEX_op_remu_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint64_t)regs[r1] % (uint64_t)regs[r2];
+        tci_next();
 #if TCG_TARGET_HAS_clz_i64
-        case INDEX_op_clz_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] ? clz64(regs[r1]) : regs[r2];
-            break;
+    case INDEX_op_clz_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ? clz64(regs[r1]) : regs[r2];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ctz_i64
-        case INDEX_op_ctz_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] ? ctz64(regs[r1]) : regs[r2];
-            break;
+    case INDEX_op_ctz_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ? ctz64(regs[r1]) : regs[r2];
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_ctpop_i64
-        case INDEX_op_ctpop_i64:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = ctpop64(regs[r1]);
-            break;
+    case INDEX_op_ctpop_i64:
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = ctpop64(regs[r1]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_mulu2_i64
-        case INDEX_op_mulu2_i64:
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
-            mulu64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
-            break;
+    case INDEX_op_mulu2_i64:
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        mulu64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_muls2_i64
-        case INDEX_op_muls2_i64:
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
-            muls64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
-            break;
+    case INDEX_op_muls2_i64:
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        muls64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_add2_i64
-        case INDEX_op_add2_i64:
-            tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
-            T1 = regs[r2] + regs[r4];
-            T2 = regs[r3] + regs[r5] + (T1 < regs[r2]);
-            regs[r0] = T1;
-            regs[r1] = T2;
-            break;
+    case INDEX_op_add2_i64:
+        tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
+        T1 = regs[r2] + regs[r4];
+        T2 = regs[r3] + regs[r5] + (T1 < regs[r2]);
+        regs[r0] = T1;
+        regs[r1] = T2;
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_add2_i64
-        case INDEX_op_sub2_i64:
-            tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
-            T1 = regs[r2] - regs[r4];
-            T2 = regs[r3] - regs[r5] - (regs[r2] < regs[r4]);
-            regs[r0] = T1;
-            regs[r1] = T2;
-            break;
+    case INDEX_op_sub2_i64:
+        tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
+        T1 = regs[r2] - regs[r4];
+        T2 = regs[r3] - regs[r5] - (regs[r2] < regs[r4]);
+        regs[r0] = T1;
+        regs[r1] = T2;
+        tci_next();
 #endif
 
-            /* Shift/rotate operations (64 bit). */
+        /* Shift/rotate operations (64 bit). */
 
-        case INDEX_op_shl_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] << (regs[r2] & 63);
-            break;
-        case INDEX_op_shr_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] >> (regs[r2] & 63);
-            break;
-        case INDEX_op_sar_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int64_t)regs[r1] >> (regs[r2] & 63);
-            break;
+    case INDEX_op_shl_i64:
+    do_shl_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] << (regs[r2] & 63);
+        tci_next();
+    case INDEX_op_shr_i64:
+    do_shr_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] >> (regs[r2] & 63);
+        tci_next();
+    case INDEX_op_sar_i64:
+    do_sar_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int64_t)regs[r1] >> (regs[r2] & 63);
+        tci_next();
 #if TCG_TARGET_HAS_rot_i64
-        case INDEX_op_rotl_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = rol64(regs[r1], regs[r2] & 63);
-            break;
-        case INDEX_op_rotr_i64:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ror64(regs[r1], regs[r2] & 63);
-            break;
+    case INDEX_op_rotl_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = rol64(regs[r1], regs[r2] & 63);
+        tci_next();
+    case INDEX_op_rotr_i64:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ror64(regs[r1], regs[r2] & 63);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_deposit_i64
-        case INDEX_op_deposit_i64:
-            tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
-            regs[r0] = deposit64(regs[r1], pos, len, regs[r2]);
-            break;
+    case INDEX_op_deposit_i64:
+        tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
+        regs[r0] = deposit64(regs[r1], pos, len, regs[r2]);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_extract_i64
-        case INDEX_op_extract_i64:
-            tci_args_rrbb(insn, &r0, &r1, &pos, &len);
-            regs[r0] = extract64(regs[r1], pos, len);
-            break;
+    case INDEX_op_extract_i64:
+        tci_args_rrbb(insn, &r0, &r1, &pos, &len);
+        regs[r0] = extract64(regs[r1], pos, len);
+        tci_next();
 #endif
 #if TCG_TARGET_HAS_sextract_i64
-        case INDEX_op_sextract_i64:
-            tci_args_rrbb(insn, &r0, &r1, &pos, &len);
-            regs[r0] = sextract64(regs[r1], pos, len);
-            break;
+    case INDEX_op_sextract_i64:
+        tci_args_rrbb(insn, &r0, &r1, &pos, &len);
+        regs[r0] = sextract64(regs[r1], pos, len);
+        tci_next();
 #endif
-        case INDEX_op_brcond_i64:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if (regs[r0]) {
-                tb_ptr = ptr;
-            }
-            break;
-        case INDEX_op_ext32s_i64:
-        case INDEX_op_ext_i32_i64:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (int32_t)regs[r1];
-            break;
-        case INDEX_op_ext32u_i64:
-        case INDEX_op_extu_i32_i64:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (uint32_t)regs[r1];
-            break;
+    case INDEX_op_brcond_i64:
+    do_brcond_i64:
+        tci_args_rl(insn, tb_ptr, &r0, &ptr);
+        if (regs[r0]) {
+            tb_ptr = ptr;
+        }
+        tci_next();
+    case INDEX_op_ext32s_i64:
+    case INDEX_op_ext_i32_i64:
+    do_ext32s:
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (int32_t)regs[r1];
+        tci_next();
+    case INDEX_op_ext32u_i64:
+    case INDEX_op_extu_i32_i64:
+    do_ext32u:
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (uint32_t)regs[r1];
+        tci_next();
 #if TCG_TARGET_HAS_bswap64_i64
-        case INDEX_op_bswap64_i64:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = bswap64(regs[r1]);
-            break;
+    case INDEX_op_bswap64_i64:
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = bswap64(regs[r1]);
+        tci_next();
 #endif
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
-            /* QEMU specific operations. */
+        /* QEMU specific operations. */
 
-        case INDEX_op_exit_tb:
-            tci_args_l(insn, tb_ptr, &ptr);
-            return (uintptr_t)ptr;
+    case INDEX_op_exit_tb:
+    do_exit_tb:
+        tci_args_l(insn, tb_ptr, &ptr);
+        return (uintptr_t)ptr;
 
-        case INDEX_op_goto_tb:
-            tci_args_l(insn, tb_ptr, &ptr);
-            tb_ptr = *(void **)ptr;
-            break;
+    case INDEX_op_goto_tb:
+    do_goto_tb:
+        tci_args_l(insn, tb_ptr, &ptr);
+        tb_ptr = *(void **)ptr;
+        tci_next();
 
-        case INDEX_op_goto_ptr:
-            tci_args_r(insn, &r0);
-            ptr = (void *)regs[r0];
-            if (!ptr) {
-                return 0;
-            }
-            tb_ptr = ptr;
-            break;
+    case INDEX_op_goto_ptr:
+    do_goto_ptr:
+        tci_args_r(insn, &r0);
+        ptr = (void *)regs[r0];
+        if (!ptr) {
+            return 0;
+        }
+        tb_ptr = ptr;
+        tci_next();
 
-        case INDEX_op_qemu_ld_i32:
-            if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
-                tci_args_rrm(insn, &r0, &r1, &oi);
-                taddr = regs[r1];
-            } else {
-                tci_args_rrrm(insn, &r0, &r1, &r2, &oi);
-                taddr = tci_uint64(regs[r2], regs[r1]);
-            }
-            tmp32 = tci_qemu_ld(env, taddr, oi, tb_ptr);
-            regs[r0] = tmp32;
-            break;
+    case INDEX_op_qemu_ld_i32:
+    do_qemu_ld_i32:
+        if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
+            tci_args_rrm(insn, &r0, &r1, &oi);
+            taddr = regs[r1];
+        } else {
+            tci_args_rrrm(insn, &r0, &r1, &r2, &oi);
+            taddr = tci_uint64(regs[r2], regs[r1]);
+        }
+        tmp32 = tci_qemu_ld(env, taddr, oi, tb_ptr);
+        regs[r0] = tmp32;
+        tci_next();
+
+    case INDEX_op_qemu_ld_i64:
+    do_qemu_ld_i64:
+        if (TCG_TARGET_REG_BITS == 64) {
+            tci_args_rrm(insn, &r0, &r1, &oi);
+            taddr = regs[r1];
+        } else if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
+            tci_args_rrrm(insn, &r0, &r1, &r2, &oi);
+            taddr = regs[r2];
+        } else {
+            tci_args_rrrrr(insn, &r0, &r1, &r2, &r3, &r4);
+            taddr = tci_uint64(regs[r3], regs[r2]);
+            oi = regs[r4];
+        }
+        tmp64 = tci_qemu_ld(env, taddr, oi, tb_ptr);
+        if (TCG_TARGET_REG_BITS == 32) {
+            tci_write_reg64(regs, r1, r0, tmp64);
+        } else {
+            regs[r0] = tmp64;
+        }
+        tci_next();
 
-        case INDEX_op_qemu_ld_i64:
-            if (TCG_TARGET_REG_BITS == 64) {
-                tci_args_rrm(insn, &r0, &r1, &oi);
-                taddr = regs[r1];
-            } else if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
+    case INDEX_op_qemu_st_i32:
+    do_qemu_st_i32:
+        if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
+            tci_args_rrm(insn, &r0, &r1, &oi);
+            taddr = regs[r1];
+        } else {
+            tci_args_rrrm(insn, &r0, &r1, &r2, &oi);
+            taddr = tci_uint64(regs[r2], regs[r1]);
+        }
+        tmp32 = regs[r0];
+        tci_qemu_st(env, taddr, tmp32, oi, tb_ptr);
+        tci_next();
+
+    case INDEX_op_qemu_st_i64:
+    do_qemu_st_i64:
+        if (TCG_TARGET_REG_BITS == 64) {
+            tci_args_rrm(insn, &r0, &r1, &oi);
+            taddr = regs[r1];
+            tmp64 = regs[r0];
+        } else {
+            if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
                 tci_args_rrrm(insn, &r0, &r1, &r2, &oi);
                 taddr = regs[r2];
             } else {
@@ -1054,52 +1245,17 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 taddr = tci_uint64(regs[r3], regs[r2]);
                 oi = regs[r4];
             }
-            tmp64 = tci_qemu_ld(env, taddr, oi, tb_ptr);
-            if (TCG_TARGET_REG_BITS == 32) {
-                tci_write_reg64(regs, r1, r0, tmp64);
-            } else {
-                regs[r0] = tmp64;
-            }
-            break;
-
-        case INDEX_op_qemu_st_i32:
-            if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
-                tci_args_rrm(insn, &r0, &r1, &oi);
-                taddr = regs[r1];
-            } else {
-                tci_args_rrrm(insn, &r0, &r1, &r2, &oi);
-                taddr = tci_uint64(regs[r2], regs[r1]);
-            }
-            tmp32 = regs[r0];
-            tci_qemu_st(env, taddr, tmp32, oi, tb_ptr);
-            break;
-
-        case INDEX_op_qemu_st_i64:
-            if (TCG_TARGET_REG_BITS == 64) {
-                tci_args_rrm(insn, &r0, &r1, &oi);
-                taddr = regs[r1];
-                tmp64 = regs[r0];
-            } else {
-                if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
-                    tci_args_rrrm(insn, &r0, &r1, &r2, &oi);
-                    taddr = regs[r2];
-                } else {
-                    tci_args_rrrrr(insn, &r0, &r1, &r2, &r3, &r4);
-                    taddr = tci_uint64(regs[r3], regs[r2]);
-                    oi = regs[r4];
-                }
-                tmp64 = tci_uint64(regs[r1], regs[r0]);
-            }
-            tci_qemu_st(env, taddr, tmp64, oi, tb_ptr);
-            break;
-
-        case INDEX_op_mb:
-            /* Ensure ordering for all kinds */
-            smp_mb();
-            break;
-        default:
-            g_assert_not_reached();
+            tmp64 = tci_uint64(regs[r1], regs[r0]);
         }
+        tci_qemu_st(env, taddr, tmp64, oi, tb_ptr);
+        tci_next();
+
+    case INDEX_op_mb:
+        /* Ensure ordering for all kinds */
+        smp_mb();
+        tci_next();
+    default:
+        g_assert_not_reached();
     }
 }
 
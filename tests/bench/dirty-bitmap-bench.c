@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Measure the time taken to move a global dirty bitmap into a RAMBlock
+ * bitmap, as done on each migration dirty sync, for various fractions
+ * of dirty pages.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/bitops.h"
+#include "qemu/atomic.h"
+#include "qemu/timer.h"
+
+/* 256 GiB worth of 4 KiB pages */
+#define N_PAGES  (1ul << 26)
+#define N_WORDS  BITS_TO_LONGS(N_PAGES)
+
+/* Dirty pages, in parts per million */
+static const unsigned densities[] = { 0, 10, 100, 1000, 10000, 1000000 };
+
+static unsigned long *src, *dest;
+
+/* The loop used before zero runs were skipped */
+static uint64_t sync_words(void)
+{
+    uint64_t num_dirty = 0;
+    long k;
+
+    for (k = 0; k < N_WORDS; k++) {
+        if (src[k]) {
+            unsigned long bits = qatomic_xchg(&src[k], 0);
+            unsigned long new_dirty = ~dest[k] & bits;
+
+            dest[k] |= bits;
+            num_dirty += ctpopl(new_dirty);
+        }
+    }
+    return num_dirty;
+}
+
+static uint64_t sync_chunks(void)
+{
+    uint64_t num_dirty = 0;
+    long k;
+
+    for (k = bitmap_next_nonzero_word(src, 0, N_WORDS); k < N_WORDS;
+         k = bitmap_next_nonzero_word(src, k + 1, N_WORDS)) {
+        unsigned long bits = qatomic_xchg(&src[k], 0);
+        unsigned long new_dirty = ~dest[k] & bits;
+
+        dest[k] |= bits;
+        num_dirty += ctpopl(new_dirty);
+    }
+    return num_dirty;
+}
+
+static void dirty_pages(unsigned ppm)
+{
+    uint64_t n = (uint64_t)N_PAGES * ppm / 1000000;
+
+    if (ppm == 1000000) {
+        bitmap_fill(src, N_PAGES);
+        return;
+    }
+    while (n--) {
+        set_bit(g_random_int_range(0, N_PAGES), src);
+    }
+}
+
+static double run_benchmark(uint64_t (*fn)(void), unsigned ppm)
+{
+    int64_t total_ns = 0;
+    int n_runs;
+
+    for (n_runs = 0; total_ns < 1e9 || n_runs < 5; n_runs++) {
+        int64_t start_ns;
+
+        dirty_pages(ppm);
+        bitmap_zero(dest, N_PAGES);
+        start_ns = get_clock();
+        fn();
+        total_ns += get_clock() - start_ns;
+    }
+    return (double)total_ns / n_runs;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long *copy;
+    uint64_t num_dirty;
+    int i;
+
+    src = bitmap_new(N_PAGES);
+    dest = bitmap_new(N_PAGES);
+
+    /* Check that both loops find the same pages before timing them.  */
+    copy = bitmap_new(N_PAGES);
+    dirty_pages(1000);
+    bitmap_copy(copy, src, N_PAGES);
+    num_dirty = sync_words();
+    bitmap_copy(src, copy, N_PAGES);
+    bitmap_zero(dest, N_PAGES);
+    g_assert(sync_chunks() == num_dirty);
+    g_assert(bitmap_equal(dest, copy, N_PAGES));
+    g_free(copy);
+
+    printf("# %lu pages. Units: ms per sync\n", N_PAGES);
+    printf("%10s %10s %10s %9s\n", "dirty ppm", "words", "chunks", "speedup");
+    for (i = 0; i < ARRAY_SIZE(densities); i++) {
+        double words_ns = run_benchmark(sync_words, densities[i]);
+        double chunks_ns = run_benchmark(sync_chunks, densities[i]);
+
+        printf("%10u %10.3f %10.3f %8.2fx\n", densities[i],
+               words_ns / 1e6, chunks_ns / 1e6, words_ns / chunks_ns);
+    }
+
+    g_free(src);
+    g_free(dest);
+    return 0;
+}
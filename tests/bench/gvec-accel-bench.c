@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include "qemu/osdep.h"
+#include "qemu/gvec-accel.h"
+#include "qemu/timer.h"
+
+struct benchmark {
+    const char * const name;
+    size_t offset;
+};
+
+#define BENCH(NAME) { .name = #NAME, .offset = offsetof(GVecAccelOps, NAME) }
+
+static const struct benchmark benchmarks[] = {
+    BENCH(ssadd8),
+    BENCH(ssadd16),
+    BENCH(sssub8),
+    BENCH(sssub16),
+    BENCH(usadd8),
+    BENCH(usadd16),
+    BENCH(ussub8),
+    BENCH(ussub16),
+};
+
+/* Operation sizes in bytes, as seen by the out-of-line helpers.  */
+static const intptr_t sizes[] = { 8, 16, 32, 64, 256 };
+
+#define MAX_IMPLS  8
+#define N_OPS      (1024 * 1024)
+
+static uint8_t buf_d[256], buf_a[256], buf_b[256];
+
+static int64_t run_benchmark(GVecAccelFn *fn, intptr_t oprsz)
+{
+    int64_t start_ns = get_clock();
+
+    for (size_t i = 0; i < N_OPS; i++) {
+        fn(buf_d, buf_a, buf_b, oprsz);
+    }
+    return get_clock() - start_ns;
+}
+
+int main(int argc, char *argv[])
+{
+    const GVecAccelOps *impls[MAX_IMPLS];
+    size_t n_impls = 0;
+
+    while (n_impls < MAX_IMPLS &&
+           (impls[n_impls] = gvec_accel_nth(n_impls)) != NULL) {
+        n_impls++;
+    }
+    for (size_t i = 0; i < sizeof(buf_a); i++) {
+        buf_a[i] = g_random_int();
+        buf_b[i] = g_random_int();
+    }
+
+    /*
+     * The last implementation is always the generic C one, against
+     * which the speedup is reported.
+     */
+    double res[ARRAY_SIZE(benchmarks)][MAX_IMPLS][ARRAY_SIZE(sizes)];
+    for (int i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        const struct benchmark *bench = &benchmarks[i];
+        for (int j = 0; j < n_impls; j++) {
+            GVecAccelFn *fn = *(GVecAccelFn **)((void *)impls[j] +
+                                                bench->offset);
+            for (int k = 0; k < ARRAY_SIZE(sizes); k++) {
+                /* warm-up run */
+                run_benchmark(fn, sizes[k]);
+
+                int64_t total_ns = 0;
+                int64_t n_runs = 0;
+                while (total_ns < 1e8 || n_runs < 5) {
+                    total_ns += run_benchmark(fn, sizes[k]);
+                    n_runs++;
+                }
+                double ns_per_run = (double)total_ns / n_runs;
+
+                /* Throughput, in Mops/s */
+                res[i][j][k] = N_OPS / ns_per_run * 1e3;
+            }
+        }
+    }
+
+    printf("# Results' breakdown: Impl, Op and oprsz. Units: Mops/s\n");
+    printf("%9s %8s ", "Impl", "Op");
+    for (int k = 0; k < ARRAY_SIZE(sizes); k++) {
+        printf("%7" PRIdPTR "          ", sizes[k]);
+    }
+    printf("\n");
+    char separator[104];
+    memset(separator, '-', sizeof(separator) - 1);
+    separator[sizeof(separator) - 1] = '\0';
+    printf("%s\n", separator);
+    for (int i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        for (int j = n_impls - 1; j >= 0; j--) {
+            printf("%9s %8s ", impls[j]->name, benchmarks[i].name);
+            for (int k = 0; k < ARRAY_SIZE(sizes); k++) {
+                printf("%8.2f ", res[i][j][k]);
+                if (j == n_impls - 1) {
+                    printf("        ");
+                } else {
+                    double speedup = res[i][j][k] / res[i][n_impls - 1][k];
+                    printf("(%5.2fx) ", speedup);
+                }
+            }
+            printf("\n");
+        }
+    }
+    printf("%s\n", separator);
+    return 0;
+}
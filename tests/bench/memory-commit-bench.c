@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Measure the latency of memory topology updates, as seen by a guest
+ * that toggles a PAM register on an i440FX machine with many memory
+ * regions and address spaces.
+ *
+ * Usage: QTEST_QEMU_BINARY=./qemu-system-x86_64 memory-commit-bench \
+ *            [-d dimms] [-p pci devices] [-n iterations]
+ */
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "../qtest/libqtest.h"
+
+#define PCI_CONFIG_ADDR     0xcf8
+#define PCI_CONFIG_DATA     0xcfc
+#define I440FX_PAM1         0x5a
+#define PCI_LATENCY_TIMER   0x0d
+
+#define DIMM_SIZE_MB        16
+#define DEVS_PER_BRIDGE     31
+
+static unsigned n_dimms = 128;
+static unsigned n_devs = 256;
+static unsigned n_iters = 2000;
+
+static void host_bridge_writeb(QTestState *qts, uint8_t reg, uint8_t val)
+{
+    qtest_outl(qts, PCI_CONFIG_ADDR, 0x80000000u | (reg & ~3));
+    qtest_outb(qts, PCI_CONFIG_DATA + (reg & 3), val);
+}
+
+/* Return the mean time in ns of writing @reg with alternating values. */
+static double run_benchmark(QTestState *qts, uint8_t reg,
+                            uint8_t val0, uint8_t val1)
+{
+    int64_t start_ns = get_clock();
+    unsigned i;
+
+    for (i = 0; i < n_iters; i++) {
+        host_bridge_writeb(qts, reg, i & 1 ? val1 : val0);
+    }
+    return (double)(get_clock() - start_ns) / n_iters;
+}
+
+static QTestState *start_qemu(void)
+{
+    GString *cmd = g_string_new("-machine pc -nodefaults -display none");
+    QTestState *qts;
+    unsigned i;
+
+    if (n_dimms) {
+        g_string_append_printf(cmd, " -m 128M,slots=%u,maxmem=%uM",
+                               n_dimms, 128 + n_dimms * DIMM_SIZE_MB);
+    }
+    for (i = 0; i < n_dimms; i++) {
+        g_string_append_printf(cmd,
+                               " -object memory-backend-ram,id=mem%u,size=%uM"
+                               " -device pc-dimm,id=dimm%u,memdev=mem%u",
+                               i, DIMM_SIZE_MB, i, i);
+    }
+    for (i = 0; i < n_devs; i++) {
+        unsigned bridge = i / DEVS_PER_BRIDGE;
+
+        if (i % DEVS_PER_BRIDGE == 0) {
+            g_string_append_printf(cmd,
+                                   " -device pci-bridge,id=br%u,chassis_nr=%u",
+                                   bridge, bridge + 1);
+        }
+        g_string_append_printf(cmd, " -device pci-testdev,bus=br%u,addr=0x%x",
+                               bridge, i % DEVS_PER_BRIDGE + 1);
+    }
+
+    qts = qtest_init(cmd->str);
+    g_string_free(cmd, true);
+    return qts;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d dimms] [-p pci devices] [-n iterations]\n"
+            "QTEST_QEMU_BINARY must point to a qemu-system-x86_64 binary.\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    QTestState *qts;
+    double base_ns, commit_ns;
+    int c;
+
+    while ((c = getopt(argc, argv, "d:p:n:h")) != -1) {
+        switch (c) {
+        case 'd':
+            n_dimms = atoi(optarg);
+            break;
+        case 'p':
+            n_devs = atoi(optarg);
+            break;
+        case 'n':
+            n_iters = MAX(atoi(optarg), 2);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (!getenv("QTEST_QEMU_BINARY")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    qts = start_qemu();
+
+    /* warm-up run */
+    run_benchmark(qts, I440FX_PAM1, 0x33, 0x00);
+
+    /*
+     * A write to the latency timer takes the same path through qtest
+     * but does not change the memory topology.
+     */
+    base_ns = run_benchmark(qts, PCI_LATENCY_TIMER, 0x00, 0x00);
+    commit_ns = run_benchmark(qts, I440FX_PAM1, 0x33, 0x00);
+
+    printf("# dimms %u, pci devices %u, iterations %u\n",
+           n_dimms, n_devs, n_iters);
+    printf("qtest round trip   %10.2f us\n", base_ns / 1000);
+    printf("PAM toggle         %10.2f us\n", commit_ns / 1000);
+    printf("commit latency     %10.2f us\n", (commit_ns - base_ns) / 1000);
+
+    qtest_quit(qts);
+    return 0;
+}
@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Measure the single-thread throughput and ratio of the compression
+ * methods available to the multifd channels, compressing packets of
+ * pages the way each MultiFDMethods implementation does.  As every
+ * channel runs in its own thread, the throughput is per host core.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include <zlib.h>
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+#ifdef CONFIG_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#define BENCH_PAGE_SIZE  4096
+/* As MULTIFD_PACKET_SIZE */
+#define PACKET_PAGES     128
+#define N_PAGES          (16 * 1024)
+
+struct workload {
+    const char *name;
+    void (*fill)(uint8_t *page);
+};
+
+struct method {
+    const char *name;
+    int level;
+    void (*setup)(struct method *m);
+    /* Returns the compressed size of the packet */
+    size_t (*compress)(struct method *m, uint8_t **pages, uint8_t *out,
+                       size_t out_len);
+    void (*cleanup)(struct method *m);
+    void *state;
+};
+
+static uint8_t *pages;
+static uint8_t *out;
+static size_t out_len;
+
+/* Workloads */
+
+static void fill_random(uint8_t *page)
+{
+    int i;
+
+    for (i = 0; i < BENCH_PAGE_SIZE; i += 4) {
+        stl_he_p(page + i, g_random_int());
+    }
+}
+
+static void fill_text(uint8_t *page)
+{
+    static const char * const words[] = {
+        "the ", "guest ", "page ", "dirty ", "memory ", "migration ",
+        "kernel ", "buffer ", "0x7f00 ", "\n", "cache ", "struct ",
+    };
+    int i = 0;
+
+    while (i < BENCH_PAGE_SIZE) {
+        const char *w = words[g_random_int_range(0, ARRAY_SIZE(words))];
+        int len = MIN((int)strlen(w), BENCH_PAGE_SIZE - i);
+
+        memcpy(page + i, w, len);
+        i += len;
+    }
+}
+
+/* Mostly zero, with a few scattered words, like page tables */
+static void fill_sparse(uint8_t *page)
+{
+    int i;
+
+    memset(page, 0, BENCH_PAGE_SIZE);
+    for (i = 0; i < 16; i++) {
+        stq_he_p(page + g_random_int_range(0, BENCH_PAGE_SIZE / 8) * 8,
+                 ((uint64_t)g_random_int() << 12) | 0x67);
+    }
+}
+
+static const struct workload workloads[] = {
+    { "random", fill_random },
+    { "text", fill_text },
+    { "sparse", fill_sparse },
+};
+
+/* Methods */
+
+static size_t nocomp_compress(struct method *m, uint8_t **in, uint8_t *dst,
+                              size_t len)
+{
+    int i;
+
+    /* Account for the copy made by the kernel when sending the pages */
+    for (i = 0; i < PACKET_PAGES; i++) {
+        memcpy(dst + i * BENCH_PAGE_SIZE, in[i], BENCH_PAGE_SIZE);
+    }
+    return PACKET_PAGES * BENCH_PAGE_SIZE;
+}
+
+static void zlib_setup(struct method *m)
+{
+    z_stream *zs = g_new0(z_stream, 1);
+
+    g_assert(deflateInit(zs, m->level) == Z_OK);
+    m->state = zs;
+}
+
+static size_t zlib_compress(struct method *m, uint8_t **in, uint8_t *dst,
+                            size_t len)
+{
+    static uint8_t buf[BENCH_PAGE_SIZE];
+    z_stream *zs = m->state;
+    size_t out_size = 0;
+    int i, ret;
+
+    for (i = 0; i < PACKET_PAGES; i++) {
+        /* multifd-zlib copies each page before deflating it */
+        memcpy(buf, in[i], BENCH_PAGE_SIZE);
+        zs->avail_in = BENCH_PAGE_SIZE;
+        zs->next_in = buf;
+        zs->avail_out = len - out_size;
+        zs->next_out = dst + out_size;
+        do {
+            ret = deflate(zs, i == PACKET_PAGES - 1 ? Z_SYNC_FLUSH
+                                                    : Z_NO_FLUSH);
+        } while (ret == Z_OK && zs->avail_in && zs->avail_out);
+        g_assert(ret == Z_OK && !zs->avail_in);
+        out_size = len - zs->avail_out;
+    }
+    return out_size;
+}
+
+static void zlib_cleanup(struct method *m)
+{
+    deflateEnd(m->state);
+    g_free(m->state);
+}
+
+#ifdef CONFIG_ZSTD
+static void zstd_setup(struct method *m)
+{
+    ZSTD_CStream *zcs = ZSTD_createCStream();
+
+    g_assert(!ZSTD_isError(ZSTD_initCStream(zcs, m->level)));
+    m->state = zcs;
+}
+
+static size_t zstd_compress(struct method *m, uint8_t **in, uint8_t *dst,
+                            size_t len)
+{
+    ZSTD_outBuffer zout = { .dst = dst, .size = len };
+    size_t ret;
+    int i;
+
+    for (i = 0; i < PACKET_PAGES; i++) {
+        ZSTD_inBuffer zin = { .src = in[i], .size = BENCH_PAGE_SIZE };
+
+        do {
+            ret = ZSTD_compressStream2(m->state, &zout, &zin,
+                                       i == PACKET_PAGES - 1 ? ZSTD_e_flush
+                                                             : ZSTD_e_continue);
+        } while (ret > 0 && zin.pos < zin.size && zout.pos < zout.size);
+        g_assert(!ZSTD_isError(ret) && zin.pos == zin.size);
+    }
+    return zout.pos;
+}
+
+static void zstd_cleanup(struct method *m)
+{
+    ZSTD_freeCStream(m->state);
+}
+#endif
+
+#ifdef CONFIG_LZ4
+static void lz4_setup(struct method *m)
+{
+    m->state = g_malloc(m->level ? LZ4_sizeofStateHC() : LZ4_sizeofState());
+}
+
+static size_t lz4_compress(struct method *m, uint8_t **in, uint8_t *dst,
+                           size_t len)
+{
+    size_t out_size = 0;
+    int i, ret;
+
+    for (i = 0; i < PACKET_PAGES; i++) {
+        char *block = (char *)dst + out_size + 4;
+        int avail = len - out_size - 4;
+
+        if (m->level) {
+            ret = LZ4_compress_HC_extStateHC(m->state, (char *)in[i], block,
+                                             BENCH_PAGE_SIZE, avail, m->level);
+        } else {
+            ret = LZ4_compress_fast_extState(m->state, (char *)in[i], block,
+                                             BENCH_PAGE_SIZE, avail, 1);
+        }
+        g_assert(ret > 0);
+        stl_be_p(dst + out_size, ret);
+        out_size += 4 + ret;
+    }
+    return out_size;
+}
+
+static void lz4_cleanup(struct method *m)
+{
+    g_free(m->state);
+}
+#endif
+
+static struct method methods[] = {
+    { "nocomp", 0, NULL, nocomp_compress, NULL },
+    { "zlib-1", 1, zlib_setup, zlib_compress, zlib_cleanup },
+#ifdef CONFIG_ZSTD
+    { "zstd-1", 1, zstd_setup, zstd_compress, zstd_cleanup },
+    { "zstd-3", 3, zstd_setup, zstd_compress, zstd_cleanup },
+#endif
+#ifdef CONFIG_LZ4
+    { "lz4", 0, lz4_setup, lz4_compress, lz4_cleanup },
+    { "lz4hc-3", 3, lz4_setup, lz4_compress, lz4_cleanup },
+    { "lz4hc-9", 9, lz4_setup, lz4_compress, lz4_cleanup },
+#endif
+};
+
+/* Compress all the pages, in packets; returns the ns taken */
+static int64_t run_benchmark(struct method *m, uint64_t *total_out)
+{
+    uint8_t *packet[PACKET_PAGES];
+    int64_t start_ns = get_clock();
+    int i, j;
+
+    *total_out = 0;
+    for (i = 0; i < N_PAGES; i += PACKET_PAGES) {
+        for (j = 0; j < PACKET_PAGES; j++) {
+            /* multifd hands out pages in RAM order */
+            packet[j] = pages + (size_t)(i + j) * BENCH_PAGE_SIZE;
+        }
+        *total_out += m->compress(m, packet, out, out_len);
+    }
+    return get_clock() - start_ns;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, j, k;
+
+    pages = g_malloc((size_t)N_PAGES * BENCH_PAGE_SIZE);
+    /* Room for the worst case of all methods, with lz4's block headers */
+    out_len = 2 * PACKET_PAGES * BENCH_PAGE_SIZE;
+    out = g_malloc(out_len);
+
+    printf("# %d pages of %d bytes, packets of %d pages\n",
+           N_PAGES, BENCH_PAGE_SIZE, PACKET_PAGES);
+    printf("# Units: MiB/s of input per core, compression ratio\n");
+    printf("%8s %10s %10s %8s\n", "data", "method", "MiB/s", "ratio");
+    for (i = 0; i < ARRAY_SIZE(workloads); i++) {
+        for (k = 0; k < N_PAGES; k++) {
+            workloads[i].fill(pages + (size_t)k * BENCH_PAGE_SIZE);
+        }
+        for (j = 0; j < ARRAY_SIZE(methods); j++) {
+            struct method *m = &methods[j];
+            int64_t total_ns = 0;
+            uint64_t total_out;
+            int n_runs;
+
+            if (m->setup) {
+                m->setup(m);
+            }
+            /* warm-up run */
+            run_benchmark(m, &total_out);
+            for (n_runs = 0; total_ns < 5e8 || n_runs < 3; n_runs++) {
+                total_ns += run_benchmark(m, &total_out);
+            }
+            if (m->cleanup) {
+                m->cleanup(m);
+            }
+
+            printf("%8s %10s %10.1f %8.2f\n", workloads[i].name, m->name,
+                   (double)N_PAGES * BENCH_PAGE_SIZE * n_runs / MiB /
+                   (total_ns / 1e9),
+                   (double)N_PAGES * BENCH_PAGE_SIZE / total_out);
+        }
+    }
+
+    g_free(pages);
+    g_free(out);
+    return 0;
+}
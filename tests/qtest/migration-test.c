@@ -15,6 +15,7 @@
 #include "libqtest.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
+#include "qemu/cutils.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/range.h"
@@ -495,6 +496,13 @@ typedef struct {
      */
     bool hide_stderr;
     bool use_shmem;
+    /* Back the guest RAM with a shared memfd */
+    bool use_memfd;
+    /*
+     * Back the destination's guest RAM with a private, guest-writable
+     * mapping of a read-only file
+     */
+    bool use_readonly_file;
     /* only launch the target process */
     bool only_target;
     /* Use dirty ring if true; dirty logging otherwise */
@@ -577,6 +585,7 @@ typedef struct {
     /* Postcopy specific fields */
     void *postcopy_data;
     bool postcopy_preempt;
+    bool postcopy_prefetch;
 } MigrateCommon;
 
 static int test_migrate_start(QTestState **from, QTestState **to,
@@ -590,11 +599,12 @@ static int test_migrate_start(QTestState **from, QTestState **to,
     g_autofree char *bootpath = NULL;
     g_autofree char *shmem_opts = NULL;
     g_autofree char *shmem_path = NULL;
+    g_autofree char *target_mem_opts = NULL;
     const char *arch = qtest_get_arch();
     const char *machine_opts = NULL;
     const char *memory_size;
 
-    if (args->use_shmem) {
+    if (args->use_shmem || args->use_readonly_file) {
         if (!g_file_test("/dev/shm", G_FILE_TEST_IS_DIR)) {
             g_test_skip("/dev/shm is not supported");
             return -1;
@@ -667,6 +677,29 @@ static int test_migrate_start(QTestState **from, QTestState **to,
             "-object memory-backend-file,id=mem0,size=%s"
             ",mem-path=%s,share=on -numa node,memdev=mem0",
             memory_size, shmem_path);
+    } else if (args->use_memfd) {
+        shmem_path = NULL;
+        shmem_opts = g_strdup_printf(
+            "-object memory-backend-memfd,id=mem0,size=%s,share=on "
+            "-machine memory-backend=mem0", memory_size);
+    } else if (args->use_readonly_file) {
+        uint64_t size;
+        int fd;
+
+        /* A sparse file of the right size, opened read-only by the target */
+        g_assert(!qemu_strtosz(memory_size, NULL, &size));
+        shmem_path = g_strdup_printf("/dev/shm/qemu-ro-%d", getpid());
+        fd = open(shmem_path, O_CREAT | O_RDWR | O_TRUNC, 0400);
+        g_assert(fd >= 0);
+        g_assert(!ftruncate(fd, size));
+        close(fd);
+        shmem_opts = g_strdup_printf(
+            "-object memory-backend-ram,id=mem0,size=%s "
+            "-machine memory-backend=mem0", memory_size);
+        target_mem_opts = g_strdup_printf(
+            "-object memory-backend-file,id=mem0,size=%s,mem-path=%s"
+            ",readonly=on,rom=off,share=off "
+            "-machine memory-backend=mem0", memory_size, shmem_path);
     } else {
         shmem_path = NULL;
         shmem_opts = g_strdup("");
@@ -700,7 +733,8 @@ static int test_migrate_start(QTestState **from, QTestState **to,
                                  machine_opts ? " -machine " : "",
                                  machine_opts ? machine_opts : "",
                                  memory_size, tmpfs, uri,
-                                 arch_target, shmem_opts,
+                                 arch_target,
+                                 target_mem_opts ? target_mem_opts : shmem_opts,
                                  args->opts_target ? args->opts_target : "",
                                  ignore_stderr);
     *to = qtest_init(cmd_target);
@@ -709,7 +743,7 @@ static int test_migrate_start(QTestState **from, QTestState **to,
      * Remove shmem file immediately to avoid memory leak in test failed case.
      * It's valid becase QEMU has already opened this file
      */
-    if (args->use_shmem) {
+    if (args->use_shmem || args->use_readonly_file) {
         unlink(shmem_path);
     }
 
@@ -1116,6 +1150,11 @@ static int migrate_postcopy_prepare(QTestState **from_ptr,
         migrate_set_capability(to, "postcopy-preempt", true);
     }
 
+    if (args->postcopy_prefetch) {
+        migrate_set_capability(from, "postcopy-prefetch", true);
+        migrate_set_capability(to, "postcopy-prefetch", true);
+    }
+
     migrate_ensure_non_converge(from);
 
     /* Wait for the first serial output from the source */
@@ -1178,6 +1217,42 @@ static void test_postcopy_preempt(void)
     test_postcopy_common(&args);
 }
 
+/* The guest walks its memory in order, so its faults form a stream */
+static void test_postcopy_prefetch(void)
+{
+    MigrateCommon args = {
+        .postcopy_prefetch = true,
+    };
+
+    test_postcopy_common(&args);
+}
+
+static void test_postcopy_prefetch_preempt(void)
+{
+    MigrateCommon args = {
+        .postcopy_preempt = true,
+        .postcopy_prefetch = true,
+    };
+
+    test_postcopy_common(&args);
+}
+
+/*
+ * Postcopy discards all of the destination's RAM before it starts, and
+ * then the pages the source sent before they were dirtied again.  That
+ * must not write to the read-only file behind the destination's RAM.
+ */
+static void test_postcopy_readonly_file(void)
+{
+    MigrateCommon args = {
+        .start = {
+            .use_readonly_file = true,
+        },
+    };
+
+    test_postcopy_common(&args);
+}
+
 #ifdef CONFIG_GNUTLS
 static void test_postcopy_tls_psk(void)
 {
@@ -1524,6 +1599,108 @@ static void test_precopy_unix_xbzrle(void)
     test_precopy_common(&args);
 }
 
+static void *
+test_migrate_parallel_device_state_start(QTestState *from, QTestState *to)
+{
+    migrate_set_capability(from, "parallel-device-state", true);
+    migrate_set_capability(to, "parallel-device-state", true);
+
+    return NULL;
+}
+
+/* The state of each vCPU is an independent section */
+static void test_precopy_unix_parallel_device_state(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            .opts_source = "-smp 4",
+            .opts_target = "-smp 4",
+        },
+        .connect_uri = uri,
+        .listen_uri = uri,
+
+        .start_hook = test_migrate_parallel_device_state_start,
+    };
+
+    test_precopy_common(&args);
+}
+
+static void *
+test_migrate_page_dedup_start(QTestState *from, QTestState *to)
+{
+    migrate_set_capability(from, "page-dedup", true);
+    migrate_set_capability(to, "page-dedup", true);
+
+    return NULL;
+}
+
+static void test_migrate_page_dedup_finish(QTestState *from, QTestState *to,
+                                           void *opaque)
+{
+    /*
+     * The guest only writes the first byte of each page, so many pages
+     * end up with the same contents.
+     */
+    g_assert_cmpint(read_ram_property_int(from, "dedup-pages"), >, 0);
+}
+
+static void test_precopy_unix_page_dedup(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = uri,
+
+        .start_hook = test_migrate_page_dedup_start,
+        .finish_hook = test_migrate_page_dedup_finish,
+
+        .iterations = 2,
+    };
+
+    test_precopy_common(&args);
+}
+
+#ifdef CONFIG_LINUX
+static void *
+test_migrate_ram_fd_passing_start(QTestState *from, QTestState *to)
+{
+    migrate_set_capability(from, "ram-fd-passing", true);
+    migrate_set_capability(to, "ram-fd-passing", true);
+
+    return NULL;
+}
+
+static void test_migrate_ram_fd_passing_finish(QTestState *from,
+                                               QTestState *to,
+                                               void *opaque)
+{
+    /*
+     * Only the firmware and video RAM go through the stream, not the
+     * 100MB that the guest keeps writing.
+     */
+    g_assert_cmpint(read_ram_property_int(from, "transferred"), <,
+                    32 * 1024 * 1024);
+}
+
+static void test_precopy_unix_ram_fd_passing(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            .use_memfd = true,
+        },
+        .listen_uri = uri,
+        .connect_uri = uri,
+
+        .start_hook = test_migrate_ram_fd_passing_start,
+        .finish_hook = test_migrate_ram_fd_passing_finish,
+    };
+
+    test_precopy_common(&args);
+}
+#endif
+
 static void test_precopy_tcp_plain(void)
 {
     MigrateCommon args = {
@@ -1898,6 +2075,18 @@ test_migrate_precopy_tcp_multifd_start(QTestState *from,
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
 }
 
+static void *
+test_migrate_precopy_tcp_multifd_zero_page_start(QTestState *from,
+                                                 QTestState *to)
+{
+    migrate_set_capability(from, "multifd", true);
+    migrate_set_capability(to, "multifd", true);
+    migrate_set_capability(from, "multifd-zero-page", true);
+    migrate_set_capability(to, "multifd-zero-page", true);
+
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
+}
+
 static void *
 test_migrate_precopy_tcp_multifd_zlib_start(QTestState *from,
                                             QTestState *to)
@@ -1914,6 +2103,44 @@ test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
 }
 #endif /* CONFIG_ZSTD */
 
+#ifdef CONFIG_LZ4
+static void *
+test_migrate_precopy_tcp_multifd_lz4_start(QTestState *from,
+                                           QTestState *to)
+{
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "lz4");
+}
+
+static void *
+test_migrate_precopy_tcp_multifd_lz4hc_start(QTestState *from,
+                                             QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-lz4-level", 9);
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "lz4");
+}
+#endif /* CONFIG_LZ4 */
+
+static void *
+test_migrate_precopy_tcp_multifd_xbzrle_start(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "xbzrle");
+}
+
+static void test_migrate_multifd_xbzrle_finish(QTestState *from,
+                                               QTestState *to, void *opaque)
+{
+    QDict *rsp_return, *rsp_cache;
+
+    /* Pages dirtied again after the first passes are sent as deltas */
+    rsp_return = migrate_query(from);
+    rsp_cache = qdict_get_qdict(rsp_return, "xbzrle-cache");
+    g_assert(rsp_cache);
+    g_assert_cmpint(qdict_get_int(rsp_cache, "pages"), >, 0);
+    qobject_unref(rsp_return);
+}
+
 static void test_multifd_tcp_none(void)
 {
     MigrateCommon args = {
@@ -1923,6 +2150,70 @@ static void test_multifd_tcp_none(void)
     test_precopy_common(&args);
 }
 
+static void test_multifd_tcp_zero_page(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_zero_page_start,
+    };
+    test_precopy_common(&args);
+}
+
+/*
+ * Save the guest to a mapped-ram file, then load it in the destination
+ * once the source is done writing.
+ */
+static void test_precopy_file_mapped_ram_common(bool multifd)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/migfile", tmpfs);
+    MigrateStart args = {};
+    QTestState *from, *to;
+    QDict *rsp;
+
+    if (test_migrate_start(&from, &to, "defer", &args)) {
+        return;
+    }
+
+    if (multifd) {
+        migrate_set_parameter_int(from, "multifd-channels", 4);
+        migrate_set_parameter_int(to, "multifd-channels", 4);
+        migrate_set_capability(from, "multifd", true);
+        migrate_set_capability(to, "multifd", true);
+    }
+    migrate_set_capability(from, "mapped-ram", true);
+    migrate_set_capability(to, "mapped-ram", true);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_ensure_converge(from);
+    migrate_qmp(from, uri, "{}");
+    wait_for_migration_complete(from);
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+
+    rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
+                           "  'arguments': { 'uri': %s }}", uri);
+    qobject_unref(rsp);
+
+    qtest_qmp_eventwait(to, "RESUME");
+    wait_for_serial("dest_serial");
+
+    test_migrate_end(from, to, true);
+    unlink(uri + strlen("file:"));
+}
+
+static void test_precopy_file_mapped_ram(void)
+{
+    test_precopy_file_mapped_ram_common(false);
+}
+
+static void test_multifd_file_mapped_ram(void)
+{
+    test_precopy_file_mapped_ram_common(true);
+}
+
 static void test_multifd_tcp_zlib(void)
 {
     MigrateCommon args = {
@@ -1943,6 +2234,38 @@ static void test_multifd_tcp_zstd(void)
 }
 #endif
 
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_lz4_start,
+    };
+    test_precopy_common(&args);
+}
+
+static void test_multifd_tcp_lz4hc(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_lz4hc_start,
+    };
+    test_precopy_common(&args);
+}
+#endif
+
+static void test_multifd_tcp_xbzrle(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_xbzrle_start,
+        .finish_hook = test_migrate_multifd_xbzrle_finish,
+        /* The first two passes only fill the page cache */
+        .iterations = 3,
+    };
+    test_precopy_common(&args);
+}
+
 #ifdef CONFIG_GNUTLS
 static void *
 test_migrate_multifd_tcp_tls_psk_start_match(QTestState *from,
@@ -2510,11 +2833,25 @@ int main(int argc, char **argv)
         qtest_add_func("/migration/postcopy/preempt/plain", test_postcopy_preempt);
         qtest_add_func("/migration/postcopy/preempt/recovery/plain",
                        test_postcopy_preempt_recovery);
+        qtest_add_func("/migration/postcopy/prefetch/plain",
+                       test_postcopy_prefetch);
+        qtest_add_func("/migration/postcopy/prefetch/preempt",
+                       test_postcopy_prefetch_preempt);
+        qtest_add_func("/migration/postcopy/readonly-file",
+                       test_postcopy_readonly_file);
     }
 
     qtest_add_func("/migration/bad_dest", test_baddest);
     qtest_add_func("/migration/precopy/unix/plain", test_precopy_unix_plain);
     qtest_add_func("/migration/precopy/unix/xbzrle", test_precopy_unix_xbzrle);
+    qtest_add_func("/migration/precopy/unix/parallel-device-state",
+                   test_precopy_unix_parallel_device_state);
+    qtest_add_func("/migration/precopy/unix/page-dedup",
+                   test_precopy_unix_page_dedup);
+#ifdef CONFIG_LINUX
+    qtest_add_func("/migration/precopy/unix/ram-fd-passing",
+                   test_precopy_unix_ram_fd_passing);
+#endif
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/precopy/unix/tls/psk",
                    test_precopy_unix_tls_psk);
@@ -2579,6 +2916,12 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/auto_converge", test_migrate_auto_converge);
     qtest_add_func("/migration/multifd/tcp/plain/none",
                    test_multifd_tcp_none);
+    qtest_add_func("/migration/multifd/tcp/plain/zero-page",
+                   test_multifd_tcp_zero_page);
+    qtest_add_func("/migration/precopy/file/mapped-ram",
+                   test_precopy_file_mapped_ram);
+    qtest_add_func("/migration/multifd/file/mapped-ram",
+                   test_multifd_file_mapped_ram);
     /*
      * This test is flaky and sometimes fails in CI and otherwise:
      * don't run unless user opts in via environment variable.
@@ -2593,6 +2936,14 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/multifd/tcp/plain/zstd",
                    test_multifd_tcp_zstd);
 #endif
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/plain/lz4",
+                   test_multifd_tcp_lz4);
+    qtest_add_func("/migration/multifd/tcp/plain/lz4hc",
+                   test_multifd_tcp_lz4hc);
+#endif
+    qtest_add_func("/migration/multifd/tcp/plain/xbzrle",
+                   test_multifd_tcp_xbzrle);
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/multifd/tcp/tls/psk/match",
                    test_multifd_tcp_tls_psk_match);
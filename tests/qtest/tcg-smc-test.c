@@ -0,0 +1,142 @@
+/*
+ * QTest testcase for writes to pages that held translated code
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+#define LOW(x) ((x) & 0xff)
+#define HIGH(x) ((x) >> 8)
+
+/* A page that only ever holds a "ret", and data next to it */
+#define CODE_ADDR 0x9000
+#define DATA_ADDR 0x9800
+
+/*
+ * x86 boot sector: run a single instruction at CODE_ADDR, then write to
+ * DATA_ADDR, on the same page, forever.
+ */
+static uint8_t x86_boot_sector[512] = {
+    /* 7c00: xor %ax,%ax */
+    [0x00] = 0x31,
+    [0x01] = 0xc0,
+    /* 7c02: mov %ax,%ds */
+    [0x02] = 0x8e,
+    [0x03] = 0xd8,
+    /* 7c04: movb $0xc3,CODE_ADDR */
+    [0x04] = 0xc6,
+    [0x05] = 0x06,
+    [0x06] = LOW(CODE_ADDR),
+    [0x07] = HIGH(CODE_ADDR),
+    [0x08] = 0xc3,
+    /* 7c09: call CODE_ADDR */
+    [0x09] = 0xe8,
+    [0x0a] = LOW(CODE_ADDR - 0x7c0c),
+    [0x0b] = HIGH(CODE_ADDR - 0x7c0c),
+    /* 7c0c: incb DATA_ADDR */
+    [0x0c] = 0xfe,
+    [0x0d] = 0x06,
+    [0x0e] = LOW(DATA_ADDR),
+    [0x0f] = HIGH(DATA_ADDR),
+    /* 7c10: jmp 0x7c0c */
+    [0x10] = 0xeb,
+    [0x11] = LOW(-6),
+    /* End of boot sector marker */
+    [0x1FE] = 0x55,
+    [0x1FF] = 0xAA,
+};
+
+/* How long to wait for the guest to get somewhere */
+#define TIMEOUT_US (30 * G_USEC_PER_SEC)
+
+static unsigned long read_jit_counter(QTestState *qts, const char *name)
+{
+    g_autofree char *info = qtest_hmp(qts, "info jit");
+    const char *line = strstr(info, name);
+
+    g_assert(line);
+    return strtoul(line + strlen(name), NULL, 10);
+}
+
+/* Wait until the counter @name of "info jit" is above @min */
+static unsigned long wait_jit_counter_above(QTestState *qts, const char *name,
+                                            unsigned long min)
+{
+    gint64 deadline = g_get_monotonic_time() + TIMEOUT_US;
+    unsigned long count;
+
+    while ((count = read_jit_counter(qts, name)) <= min) {
+        g_assert(g_get_monotonic_time() < deadline);
+        g_usleep(10 * 1000);
+    }
+    return count;
+}
+
+/*
+ * Writes next to the code of a page are filtered without taking the
+ * page locks, but the page must still stop trapping writes once it holds
+ * no code, here after loadvm flushed all TBs, and its code bitmap must
+ * be freed.
+ */
+static void test_smc_after_flush(void)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *out = NULL;
+    unsigned long skipped, unprotected, bitmaps;
+    QTestState *qts;
+    int fd;
+
+    fd = g_file_open_tmp("qtest-tcg-smc.XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    g_assert_cmpint(write(fd, x86_boot_sector, sizeof(x86_boot_sector)), ==,
+                    sizeof(x86_boot_sector));
+    close(fd);
+
+    /* The snapshot overlay gives savevm somewhere to write to */
+    qts = qtest_initf("-accel tcg -drive file=%s,format=raw,snapshot=on",
+                      path);
+
+    wait_jit_counter_above(qts, "SMC skipped writes", 0);
+    unprotected = read_jit_counter(qts, "SMC unprotected pages");
+    bitmaps = read_jit_counter(qts, "code bitmaps");
+
+    out = qtest_hmp(qts, "savevm smc");
+    g_assert_cmpstr(out, ==, "");
+    g_free(out);
+    out = qtest_hmp(qts, "loadvm smc");
+    g_assert_cmpstr(out, ==, "");
+
+    /*
+     * The guest's next write to the former code page drops its write
+     * protection.  Only the page of the loop holds code now, so the
+     * bitmaps of all the other pages, the BIOS's and CODE_ADDR's, are
+     * gone.
+     */
+    wait_jit_counter_above(qts, "SMC unprotected pages", unprotected);
+    g_assert_cmpint(read_jit_counter(qts, "code bitmaps"), <, bitmaps);
+
+    /* Further writes to the page don't trap */
+    skipped = read_jit_counter(qts, "SMC skipped writes");
+    g_usleep(100 * 1000);
+    g_assert_cmpint(read_jit_counter(qts, "SMC skipped writes"), ==, skipped);
+
+    qtest_quit(qts);
+    unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_accel("tcg")) {
+        g_test_skip("TCG is not available");
+        return g_test_run();
+    }
+
+    qtest_add_func("/tcg/smc/after-flush", test_smc_after_flush);
+
+    return g_test_run();
+}
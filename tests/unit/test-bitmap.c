@@ -123,6 +123,43 @@ static void check_bitmap_set(void)
     bitmap_set_case(bitmap_set_atomic);
 }
 
+static long next_nonzero_word_ref(const unsigned long *map,
+                                  long start, long nr)
+{
+    while (start < nr && !map[start]) {
+        start++;
+    }
+    return start;
+}
+
+static void check_bitmap_next_nonzero_word(void)
+{
+    long nr = BMAP_SIZE;
+    unsigned long *map = g_new0(unsigned long, nr);
+    /* Sparse words around and inside the chunks skipped at once */
+    static const long set[] = {
+        0, 3, 31, 32, 33, 200, 511, 512, BMAP_SIZE - 1
+    };
+    long i, start;
+
+    for (start = 0; start <= nr; start++) {
+        g_assert_cmpint(bitmap_next_nonzero_word(map, start, nr), ==, nr);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(set); i++) {
+        map[set[i]] = 1ul << (set[i] % BITS_PER_LONG);
+        for (start = 0; start <= nr; start++) {
+            g_assert_cmpint(bitmap_next_nonzero_word(map, start, nr), ==,
+                            next_nonzero_word_ref(map, start, nr));
+            /* A shorter bitmap must not be scanned past its end */
+            g_assert_cmpint(bitmap_next_nonzero_word(map, start, nr - 1), ==,
+                            next_nonzero_word_ref(map, start, nr - 1));
+        }
+    }
+
+    g_free(map);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -131,6 +168,8 @@ int main(int argc, char **argv)
                     check_bitmap_copy_with_offset);
     g_test_add_func("/bitmap/bitmap_set",
                     check_bitmap_set);
+    g_test_add_func("/bitmap/bitmap_next_nonzero_word",
+                    check_bitmap_next_nonzero_word);
 
     g_test_run();
 
@@ -0,0 +1,119 @@
+/*
+ * Host vector kernels for out-of-line gvec helpers test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/gvec-accel.h"
+
+/* The largest operation size supported by tcg-gvec-desc.h.  */
+#define MAX_OPRSZ  256
+
+static uint8_t src_a[MAX_OPRSZ], src_b[MAX_OPRSZ];
+static uint8_t expect[MAX_OPRSZ], result[MAX_OPRSZ];
+
+static const GVecAccelOps *generic_ops(void)
+{
+    const GVecAccelOps *ops = NULL, *next;
+    unsigned n = 0;
+
+    while ((next = gvec_accel_nth(n++)) != NULL) {
+        ops = next;
+    }
+    g_assert(ops != NULL);
+    return ops;
+}
+
+static void fill_random(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_OPRSZ; i++) {
+        src_a[i] = g_test_rand_int();
+        src_b[i] = g_test_rand_int();
+    }
+    /* Make sure the saturation limits are exercised.  */
+    src_a[0] = 0x7f;
+    src_b[0] = 0x7f;
+    src_a[1] = 0x80;
+    src_b[1] = 0x80;
+    src_a[2] = 0xff;
+    src_b[2] = 0x01;
+}
+
+static void check_fn(size_t offset, const char *opname)
+{
+    const GVecAccelOps *ref = generic_ops();
+    GVecAccelFn *ref_fn = *(GVecAccelFn **)((void *)ref + offset);
+    const GVecAccelOps *ops;
+    unsigned n;
+    intptr_t oprsz;
+
+    for (n = 0; (ops = gvec_accel_nth(n)) != NULL; n++) {
+        GVecAccelFn *fn = *(GVecAccelFn **)((void *)ops + offset);
+
+        for (oprsz = 8; oprsz <= MAX_OPRSZ; oprsz += 8) {
+            fill_random();
+            ref_fn(expect, src_a, src_b, oprsz);
+            fn(result, src_a, src_b, oprsz);
+            if (memcmp(expect, result, oprsz)) {
+                g_test_message("%s/%s mismatch at oprsz %" PRIdPTR,
+                               ops->name, opname, oprsz);
+                g_test_fail();
+                return;
+            }
+
+            /* The destination may overlap the first source.  */
+            memcpy(result, src_a, MAX_OPRSZ);
+            fn(result, result, src_b, oprsz);
+            if (memcmp(expect, result, oprsz)) {
+                g_test_message("%s/%s overlap mismatch at oprsz %" PRIdPTR,
+                               ops->name, opname, oprsz);
+                g_test_fail();
+                return;
+            }
+        }
+    }
+}
+
+#define CHECK_FN(NAME) \
+    static void test_##NAME(void)                               \
+    {                                                           \
+        check_fn(offsetof(GVecAccelOps, NAME), #NAME);          \
+    }
+
+CHECK_FN(ssadd8)
+CHECK_FN(ssadd16)
+CHECK_FN(sssub8)
+CHECK_FN(sssub16)
+CHECK_FN(usadd8)
+CHECK_FN(usadd16)
+CHECK_FN(ussub8)
+CHECK_FN(ussub16)
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/gvec-accel/ssadd8", test_ssadd8);
+    g_test_add_func("/gvec-accel/ssadd16", test_ssadd16);
+    g_test_add_func("/gvec-accel/sssub8", test_sssub8);
+    g_test_add_func("/gvec-accel/sssub16", test_sssub16);
+    g_test_add_func("/gvec-accel/usadd8", test_usadd8);
+    g_test_add_func("/gvec-accel/usadd16", test_usadd16);
+    g_test_add_func("/gvec-accel/ussub8", test_ussub8);
+    g_test_add_func("/gvec-accel/ussub16", test_ussub16);
+
+    return g_test_run();
+}
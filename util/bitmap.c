@@ -13,6 +13,7 @@
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/atomic.h"
+#include "qemu/cutils.h"
 
 /*
  * bitmaps provide an array of bits, implemented using an
@@ -308,14 +309,16 @@ bool bitmap_test_and_clear_atomic(unsigned long *map, long start, long nr)
 
     /* Full words */
     if (bits_to_clear == BITS_PER_LONG) {
-        while (nr >= BITS_PER_LONG) {
-            if (*p) {
-                old_bits = qatomic_xchg(p, 0);
-                dirty |= old_bits;
-            }
-            nr -= BITS_PER_LONG;
-            p++;
+        long n = nr / BITS_PER_LONG;
+        long i;
+
+        for (i = bitmap_next_nonzero_word(p, 0, n); i < n;
+             i = bitmap_next_nonzero_word(p, i + 1, n)) {
+            old_bits = qatomic_xchg(&p[i], 0);
+            dirty |= old_bits;
         }
+        nr -= n * BITS_PER_LONG;
+        p += n;
     }
 
     /* Last word */
@@ -343,6 +346,37 @@ void bitmap_copy_and_clear_atomic(unsigned long *dst, unsigned long *src,
     }
 }
 
+/*
+ * Runs of zero words are checked this many bytes at a time, which is
+ * enough for every buffer_is_zero() accelerator to be used.
+ */
+#define ZERO_SCAN_BYTES 256
+#define ZERO_SCAN_WORDS ((long)(ZERO_SCAN_BYTES / sizeof(unsigned long)))
+
+long bitmap_next_nonzero_word_slow(const unsigned long *map,
+                                   long start, long nr)
+{
+    /* Word by word, up to a chunk boundary */
+    while (start < nr && start % ZERO_SCAN_WORDS) {
+        if (map[start]) {
+            return start;
+        }
+        start++;
+    }
+
+    /* Whole chunks, using the host's vector instructions */
+    while (nr - start >= ZERO_SCAN_WORDS &&
+           buffer_is_zero(map + start, ZERO_SCAN_BYTES)) {
+        start += ZERO_SCAN_WORDS;
+    }
+
+    /* Within the first non-zero chunk, or the tail */
+    while (start < nr && !map[start]) {
+        start++;
+    }
+    return start;
+}
+
 #define ALIGN_MASK(x,mask)      (((x)+(mask))&~(mask))
 
 /**
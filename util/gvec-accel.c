@@ -0,0 +1,307 @@
+/*
+ * Host vector kernels for out-of-line gvec helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/gvec-accel.h"
+
+/*
+ * Generic implementations.  The clamp is written with a wider
+ * intermediate, which compilers do not recognize as saturation.
+ */
+#define GEN_SAT_INT(NAME, TYPE, OP, MIN, MAX)                           \
+static void NAME##_int(void *d, const void *a, const void *b,           \
+                       intptr_t oprsz)                                  \
+{                                                                       \
+    intptr_t i;                                                         \
+    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                         \
+        int r = *(TYPE *)(a + i) OP *(TYPE *)(b + i);                   \
+        if (r > MAX) {                                                  \
+            r = MAX;                                                    \
+        } else if (r < MIN) {                                           \
+            r = MIN;                                                    \
+        }                                                               \
+        *(TYPE *)(d + i) = r;                                           \
+    }                                                                   \
+}
+
+GEN_SAT_INT(ssadd8, int8_t, +, INT8_MIN, INT8_MAX)
+GEN_SAT_INT(ssadd16, int16_t, +, INT16_MIN, INT16_MAX)
+GEN_SAT_INT(sssub8, int8_t, -, INT8_MIN, INT8_MAX)
+GEN_SAT_INT(sssub16, int16_t, -, INT16_MIN, INT16_MAX)
+GEN_SAT_INT(usadd8, uint8_t, +, 0, UINT8_MAX)
+GEN_SAT_INT(usadd16, uint16_t, +, 0, UINT16_MAX)
+GEN_SAT_INT(ussub8, uint8_t, -, 0, UINT8_MAX)
+GEN_SAT_INT(ussub16, uint16_t, -, 0, UINT16_MAX)
+
+#undef GEN_SAT_INT
+
+static const GVecAccelOps gvec_accel_int = {
+    .name = "int",
+    .ssadd8 = ssadd8_int,
+    .ssadd16 = ssadd16_int,
+    .sssub8 = sssub8_int,
+    .sssub16 = sssub16_int,
+    .usadd8 = usadd8_int,
+    .usadd16 = usadd16_int,
+    .ussub8 = ussub8_int,
+    .ussub16 = ussub16_int,
+};
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT) || \
+    defined(__SSE2__)
+#include <immintrin.h>
+
+/*
+ * Each of the wider kernels handles the final bytes, less than one
+ * vector and a multiple of 8, with 128-bit and then 64-bit operations.
+ */
+#define SSE2_TAIL(INSN)                                                 \
+    for (; i + 16 <= oprsz; i += 16) {                                  \
+        __m128i x = _mm_loadu_si128(a + i);                             \
+        __m128i y = _mm_loadu_si128(b + i);                             \
+        _mm_storeu_si128(d + i, _mm_##INSN(x, y));                      \
+    }                                                                   \
+    if (i < oprsz) {                                                    \
+        __m128i x = _mm_loadl_epi64(a + i);                             \
+        __m128i y = _mm_loadl_epi64(b + i);                             \
+        _mm_storel_epi64(d + i, _mm_##INSN(x, y));                      \
+    }
+
+#define GEN_SSE2(NAME, INSN)                                            \
+static void __attribute__((target("sse2")))                             \
+NAME##_sse2(void *d, const void *a, const void *b, intptr_t oprsz)      \
+{                                                                       \
+    intptr_t i = 0;                                                     \
+    SSE2_TAIL(INSN)                                                     \
+}
+
+GEN_SSE2(ssadd8, adds_epi8)
+GEN_SSE2(ssadd16, adds_epi16)
+GEN_SSE2(sssub8, subs_epi8)
+GEN_SSE2(sssub16, subs_epi16)
+GEN_SSE2(usadd8, adds_epu8)
+GEN_SSE2(usadd16, adds_epu16)
+GEN_SSE2(ussub8, subs_epu8)
+GEN_SSE2(ussub16, subs_epu16)
+
+static const GVecAccelOps gvec_accel_sse2 = {
+    .name = "sse2",
+    .ssadd8 = ssadd8_sse2,
+    .ssadd16 = ssadd16_sse2,
+    .sssub8 = sssub8_sse2,
+    .sssub16 = sssub16_sse2,
+    .usadd8 = usadd8_sse2,
+    .usadd16 = usadd16_sse2,
+    .ussub8 = ussub8_sse2,
+    .ussub16 = ussub16_sse2,
+};
+
+#ifdef CONFIG_AVX2_OPT
+#define GEN_AVX2(NAME, INSN)                                            \
+static void __attribute__((target("avx2")))                             \
+NAME##_avx2(void *d, const void *a, const void *b, intptr_t oprsz)      \
+{                                                                       \
+    intptr_t i = 0;                                                     \
+    for (; i + 32 <= oprsz; i += 32) {                                  \
+        __m256i x = _mm256_loadu_si256(a + i);                          \
+        __m256i y = _mm256_loadu_si256(b + i);                          \
+        _mm256_storeu_si256(d + i, _mm256_##INSN(x, y));                \
+    }                                                                   \
+    SSE2_TAIL(INSN)                                                     \
+}
+
+GEN_AVX2(ssadd8, adds_epi8)
+GEN_AVX2(ssadd16, adds_epi16)
+GEN_AVX2(sssub8, subs_epi8)
+GEN_AVX2(sssub16, subs_epi16)
+GEN_AVX2(usadd8, adds_epu8)
+GEN_AVX2(usadd16, adds_epu16)
+GEN_AVX2(ussub8, subs_epu8)
+GEN_AVX2(ussub16, subs_epu16)
+
+static const GVecAccelOps gvec_accel_avx2 = {
+    .name = "avx2",
+    .ssadd8 = ssadd8_avx2,
+    .ssadd16 = ssadd16_avx2,
+    .sssub8 = sssub8_avx2,
+    .sssub16 = sssub16_avx2,
+    .usadd8 = usadd8_avx2,
+    .usadd16 = usadd16_avx2,
+    .ussub8 = ussub8_avx2,
+    .ussub16 = ussub16_avx2,
+};
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef CONFIG_AVX512BW_OPT
+#define GEN_AVX512BW(NAME, INSN)                                        \
+static void __attribute__((target("avx512bw")))                         \
+NAME##_avx512bw(void *d, const void *a, const void *b, intptr_t oprsz)  \
+{                                                                       \
+    intptr_t i = 0;                                                     \
+    for (; i + 64 <= oprsz; i += 64) {                                  \
+        __m512i x = _mm512_loadu_si512(a + i);                          \
+        __m512i y = _mm512_loadu_si512(b + i);                          \
+        _mm512_storeu_si512(d + i, _mm512_##INSN(x, y));                \
+    }                                                                   \
+    SSE2_TAIL(INSN)                                                     \
+}
+
+GEN_AVX512BW(ssadd8, adds_epi8)
+GEN_AVX512BW(ssadd16, adds_epi16)
+GEN_AVX512BW(sssub8, subs_epi8)
+GEN_AVX512BW(sssub16, subs_epi16)
+GEN_AVX512BW(usadd8, adds_epu8)
+GEN_AVX512BW(usadd16, adds_epu16)
+GEN_AVX512BW(ussub8, subs_epu8)
+GEN_AVX512BW(ussub16, subs_epu16)
+
+static const GVecAccelOps gvec_accel_avx512bw = {
+    .name = "avx512bw",
+    .ssadd8 = ssadd8_avx512bw,
+    .ssadd16 = ssadd16_avx512bw,
+    .sssub8 = sssub8_avx512bw,
+    .sssub16 = sssub16_avx512bw,
+    .usadd8 = usadd8_avx512bw,
+    .usadd16 = usadd16_avx512bw,
+    .ussub8 = ussub8_avx512bw,
+    .ussub16 = ussub16_avx512bw,
+};
+#endif /* CONFIG_AVX512BW_OPT */
+
+/*
+ * Usable implementations, most preferred first.  Make sure that this
+ * is appropriately initialized when SSE2 is enabled on the compiler
+ * command-line, but the compiler is too old to support CONFIG_AVX2_OPT.
+ */
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
+static const GVecAccelOps *gvec_accel_list[4] = { &gvec_accel_int };
+const GVecAccelOps *gvec_accel_ops = &gvec_accel_int;
+#else
+# ifndef __SSE2__
+#  error "ISA selection confusion"
+# endif
+static const GVecAccelOps *gvec_accel_list[] = {
+    &gvec_accel_sse2, &gvec_accel_int
+};
+const GVecAccelOps *gvec_accel_ops = &gvec_accel_sse2;
+#endif
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_gvec_accel(void)
+{
+    unsigned max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned n = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        bool sse2 = d & bit_SSE2;
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            unsigned bv = xgetbv_low(0);
+            __cpuid_count(7, 0, a, b, c, d);
+#ifdef CONFIG_AVX512BW_OPT
+            /* See the comment in bufferiszero.c regarding 0xe6.  */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512BW)) {
+                gvec_accel_list[n++] = &gvec_accel_avx512bw;
+            }
+#endif
+#ifdef CONFIG_AVX2_OPT
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                gvec_accel_list[n++] = &gvec_accel_avx2;
+            }
+#endif
+        }
+        if (sse2) {
+            gvec_accel_list[n++] = &gvec_accel_sse2;
+        }
+    }
+    gvec_accel_list[n] = &gvec_accel_int;
+    gvec_accel_ops = gvec_accel_list[0];
+}
+#endif /* CONFIG_AVX512BW_OPT || CONFIG_AVX2_OPT */
+
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+/* AdvSIMD is mandatory for AArch64, so there is no runtime check.  */
+#define GEN_NEON(NAME, INSN, TYPE, SUF)                                 \
+static void NAME##_neon(void *d, const void *a, const void *b,          \
+                        intptr_t oprsz)                                 \
+{                                                                       \
+    intptr_t i = 0;                                                     \
+    for (; i + 16 <= oprsz; i += 16) {                                  \
+        vst1q_##SUF((TYPE *)(d + i),                                    \
+                    INSN##q_##SUF(vld1q_##SUF((const TYPE *)(a + i)),   \
+                                  vld1q_##SUF((const TYPE *)(b + i)))); \
+    }                                                                   \
+    if (i < oprsz) {                                                    \
+        vst1_##SUF((TYPE *)(d + i),                                     \
+                   INSN##_##SUF(vld1_##SUF((const TYPE *)(a + i)),      \
+                                vld1_##SUF((const TYPE *)(b + i))));    \
+    }                                                                   \
+}
+
+GEN_NEON(ssadd8, vqadd, int8_t, s8)
+GEN_NEON(ssadd16, vqadd, int16_t, s16)
+GEN_NEON(sssub8, vqsub, int8_t, s8)
+GEN_NEON(sssub16, vqsub, int16_t, s16)
+GEN_NEON(usadd8, vqadd, uint8_t, u8)
+GEN_NEON(usadd16, vqadd, uint16_t, u16)
+GEN_NEON(ussub8, vqsub, uint8_t, u8)
+GEN_NEON(ussub16, vqsub, uint16_t, u16)
+
+static const GVecAccelOps gvec_accel_neon = {
+    .name = "neon",
+    .ssadd8 = ssadd8_neon,
+    .ssadd16 = ssadd16_neon,
+    .sssub8 = sssub8_neon,
+    .sssub16 = sssub16_neon,
+    .usadd8 = usadd8_neon,
+    .usadd16 = usadd16_neon,
+    .ussub8 = ussub8_neon,
+    .ussub16 = ussub16_neon,
+};
+
+static const GVecAccelOps *gvec_accel_list[] = {
+    &gvec_accel_neon, &gvec_accel_int
+};
+const GVecAccelOps *gvec_accel_ops = &gvec_accel_neon;
+
+#else
+static const GVecAccelOps *gvec_accel_list[] = { &gvec_accel_int };
+const GVecAccelOps *gvec_accel_ops = &gvec_accel_int;
+#endif
+
+const GVecAccelOps *gvec_accel_nth(unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(gvec_accel_list); i++) {
+        const GVecAccelOps *ops = gvec_accel_list[i];
+        if (ops == NULL) {
+            break;
+        }
+        if (n-- == 0) {
+            return ops;
+        }
+    }
+    return NULL;
+}
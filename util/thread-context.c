@@ -165,17 +165,58 @@ static void thread_context_get_cpu_affinity(Object *obj, Visitor *v,
     qapi_free_uint16List(host_cpus);
 }
 
+unsigned long *host_nodes_to_cpus(const unsigned long *host_nodes,
+                                  unsigned long nr_nodes, int *nbits,
+                                  Error **errp)
+{
+#ifdef CONFIG_NUMA
+    unsigned long *bitmap;
+    struct bitmask *tmp_cpus;
+    unsigned long node;
+    int ret, i;
+
+    *nbits = numa_num_possible_cpus();
+    bitmap = bitmap_new(*nbits);
+    tmp_cpus = numa_allocate_cpumask();
+    for (node = find_first_bit(host_nodes, nr_nodes); node < nr_nodes;
+         node = find_next_bit(host_nodes, nr_nodes, node + 1)) {
+        numa_bitmask_clearall(tmp_cpus);
+        ret = numa_node_to_cpus(node, tmp_cpus);
+        if (ret) {
+            /* We ignore any errors, such as impossible nodes. */
+            continue;
+        }
+        for (i = 0; i < *nbits; i++) {
+            if (numa_bitmask_isbitset(tmp_cpus, i)) {
+                set_bit(i, bitmap);
+            }
+        }
+    }
+    numa_free_cpumask(tmp_cpus);
+
+    if (bitmap_empty(bitmap, *nbits)) {
+        error_setg(errp, "The nodes select no CPUs");
+        g_free(bitmap);
+        return NULL;
+    }
+    return bitmap;
+#else
+    error_setg(errp, "NUMA node affinity is not supported by this QEMU");
+    return NULL;
+#endif
+}
+
 static void thread_context_set_node_affinity(Object *obj, Visitor *v,
                                              const char *name, void *opaque,
                                              Error **errp)
 {
 #ifdef CONFIG_NUMA
-    const int nbits = numa_num_possible_cpus();
     ThreadContext *tc = THREAD_CONTEXT(obj);
     uint16List *l, *host_nodes = NULL;
     unsigned long *bitmap = NULL;
-    struct bitmask *tmp_cpus;
-    int ret, i;
+    unsigned long *nodes;
+    unsigned long nr_nodes = 0;
+    int nbits, ret;
 
     if (tc->init_cpu_bitmap) {
         error_setg(errp, "Mixing CPU and node affinity not supported");
@@ -191,25 +232,16 @@ static void thread_context_set_node_affinity(Object *obj, Visitor *v,
         goto out;
     }
 
-    bitmap = bitmap_new(nbits);
-    tmp_cpus = numa_allocate_cpumask();
     for (l = host_nodes; l; l = l->next) {
-        numa_bitmask_clearall(tmp_cpus);
-        ret = numa_node_to_cpus(l->value, tmp_cpus);
-        if (ret) {
-            /* We ignore any errors, such as impossible nodes. */
-            continue;
-        }
-        for (i = 0; i < nbits; i++) {
-            if (numa_bitmask_isbitset(tmp_cpus, i)) {
-                set_bit(i, bitmap);
-            }
-        }
+        nr_nodes = MAX(nr_nodes, l->value + 1);
     }
-    numa_free_cpumask(tmp_cpus);
-
-    if (bitmap_empty(bitmap, nbits)) {
-        error_setg(errp, "The nodes select no CPUs");
+    nodes = bitmap_new(nr_nodes);
+    for (l = host_nodes; l; l = l->next) {
+        set_bit(l->value, nodes);
+    }
+    bitmap = host_nodes_to_cpus(nodes, nr_nodes, &nbits, errp);
+    g_free(nodes);
+    if (!bitmap) {
         goto out;
     }
 